@@ -0,0 +1,429 @@
+#include "BatchModes.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "Vec3Dd.h"
+#include "DensityBinner.h"
+#include "TrackErrors.h"
+#include "ShapeDistances.h"
+
+#include "HeadlessContext.h"
+#include "FrameScheduler.h"
+#include "OffscreenTarget.h"
+#include "PngWriter.h"
+#include "WorkerProcesses.h"
+
+#include "Utils.h"
+#include "WorldPointViewer.h"
+
+int runBinningBatch(const std::vector<std::string>& args);
+int runErrorBatch(const std::vector<std::string>& args);
+int runShapeBatch(const std::vector<std::string>& args);
+bool readTrackFiles(const std::string& actualFile, const std::string& approxFile, TrackSet tracks[2]);
+bool takeOption(std::vector<std::string>& args, const char* name, std::string& value);
+bool setupHeadless(const std::string& backendName, HeadlessContext& context, int width, int height);
+int runRenderBatch(const std::vector<std::string>& batchArgs);
+int runPosterBatch(const std::vector<std::string>& batchArgs);
+bool parseView(const std::string& view, vec3dd::Vec3Dd& position);
+
+bool isBatchMode(const std::vector<std::string>& args) {
+    const char* const MODES[] = { "--bin", "--errors", "--shape", "--render", "--poster" };
+    return !args.empty() && std::find(MODES, MODES + 5, args[0]) != MODES + 5;
+}
+
+int runBatchMode(const std::vector<std::string>& args) {
+    if (args[0] == "--bin") {
+        return runBinningBatch(args);
+    }
+    if (args[0] == "--errors") {
+        return runErrorBatch(args);
+    }
+    if (args[0] == "--shape") {
+        return runShapeBatch(args);
+    }
+    // drawn on a HeadlessContext into framebuffer objects
+    return (args[0] == "--poster") ? runPosterBatch(args) : runRenderBatch(args);
+}
+
+int runBinningBatch(const std::vector<std::string>& args) {
+    if (args.size() != 4) {
+        printf("usage: WorldPointViewer --bin <order> <points file> <csv file>\n");
+        return 1;
+    }
+
+    int order = atoi(args[1].c_str());
+    if (order < 0 || order > DensityBinner::MAX_ORDER) {
+        printf("order must be 0 to %d\n", DensityBinner::MAX_ORDER);
+        return 1;
+    }
+
+    FILE* input = fopen(args[2].c_str(), "r");
+    if (!input) {
+        printf("can't open %s\n", args[2].c_str());
+        return 1;
+    }
+
+    DensityBinner binner(order);
+
+    // Points are read and binned a block at a time so the input can be
+    // bigger than memory.
+    const size_t BLOCK_POINTS = 1 << 24;
+    std::vector<float> coords;
+    coords.reserve(BLOCK_POINTS * 3);
+
+    long long start = FrameScheduler::now();
+    long long binTicks = 0;
+    unsigned long long pointCount = 0;
+
+    auto binBlock = [&]() {
+        long long binStart = FrameScheduler::now();
+        binner.bin(coords.data(), coords.size() / 3);
+        binTicks += FrameScheduler::now() - binStart;
+        pointCount += coords.size() / 3;
+        coords.clear();
+    };
+
+    // same format as the layer files: x,y,z per line, blank lines ignored
+    char line[256];
+    while (fgets(line, sizeof(line), input)) {
+        char* end = line;
+        double x = strtod(end, &end);
+        if (end == line || *end != ',') {
+            continue;
+        }
+        double y = strtod(end + 1, &end);
+        if (*end != ',') {
+            continue;
+        }
+        double z = strtod(end + 1, &end);
+
+        coords.push_back((float)x);
+        coords.push_back((float)y);
+        coords.push_back((float)z);
+        if (coords.size() == BLOCK_POINTS * 3) {
+            binBlock();
+        }
+    }
+    binBlock();
+    fclose(input);
+
+    double totalMs = FrameScheduler::ticksToMs(FrameScheduler::now() - start);
+    double binMs = FrameScheduler::ticksToMs(binTicks);
+    printf("binned %llu points at order %d in %.1f ms (%.1f ms reading, %.1f ms binning, "
+        "%.1f M points/s)\n",
+        pointCount, order, totalMs, totalMs - binMs, binMs,
+        (binMs > 0) ? (pointCount / binMs / 1000.0) : 0.0);
+
+    if (!binner.writeCsv(args[3].c_str(), EARTH_EQUITORIAL_RADIUS)) {
+        printf("can't write %s\n", args[3].c_str());
+        return 1;
+    }
+    return 0;
+}
+
+int runErrorBatch(const std::vector<std::string>& args) {
+    bool nearest = args.size() == 5 && args[4] == "nearest";
+    if (args.size() < 4 || args.size() > 5 || (args.size() == 5 && !nearest && args[4] != "index")) {
+        printf("usage: WorldPointViewer --errors <actual file> <approx file> <output prefix> "
+            "[index|nearest]\n");
+        return 1;
+    }
+
+    TrackSet tracks[2];
+    if (!readTrackFiles(args[1], args[2], tracks)) {
+        return 1;
+    }
+
+    TrackErrors errors;
+    errors.compute(tracks[0], tracks[1],
+        nearest ? TrackErrors::MATCH_BY_NEAREST : TrackErrors::MATCH_BY_INDEX);
+    return writeErrors(errors, args[3]) ? 0 : 1;
+}
+
+// Writes the Hausdorff and discrete Frechet distance of every matched pair
+// of tracks to <output prefix>.csv and .json, along with the Hausdorff
+// distance between the files as a whole.
+int runShapeBatch(const std::vector<std::string>& args) {
+    bool nearest = args.size() == 5 && args[4] == "nearest";
+    if (args.size() < 4 || args.size() > 5 || (args.size() == 5 && !nearest && args[4] != "index")) {
+        printf("usage: WorldPointViewer --shape <actual file> <approx file> <output prefix> "
+            "[index|nearest]\n");
+        return 1;
+    }
+
+    TrackSet tracks[2];
+    if (!readTrackFiles(args[1], args[2], tracks)) {
+        return 1;
+    }
+
+    long long start = FrameScheduler::now();
+    std::vector<int> matches;
+    TrackErrors::matchTracks(tracks[0], tracks[1],
+        nearest ? TrackErrors::MATCH_BY_NEAREST : TrackErrors::MATCH_BY_INDEX, matches);
+    double matchMs = FrameScheduler::ticksToMs(FrameScheduler::now() - start);
+
+    ShapeDistances distances;
+    distances.compute(tracks[0], tracks[1], matches);
+
+    unsigned int pairCount = 0;
+    double maxHausdorff = 0, maxFrechet = 0;
+    for (auto& pair : distances.getPairDistances()) {
+        if (pair.approxTrack >= 0) {
+            pairCount++;
+            maxHausdorff = std::max(maxHausdorff, pair.hausdorff);
+            maxFrechet = std::max(maxFrechet, pair.frechet);
+        }
+    }
+    printf("%u track pairs: matched in %.1f ms, Hausdorff in %.1f ms (max %.3f m), "
+        "Frechet in %.1f ms (max %.3f m); layers %.3f m apart (Hausdorff) in %.1f ms\n",
+        pairCount, matchMs, distances.getHausdorffMs(), maxHausdorff,
+        distances.getFrechetMs(), maxFrechet,
+        distances.getLayerHausdorff(), distances.getLayerHausdorffMs());
+
+    std::string csvFile = args[3] + ".csv";
+    std::string jsonFile = args[3] + ".json";
+    if (!distances.writeCsv(csvFile.c_str()) || !distances.writeJson(jsonFile.c_str())) {
+        printf("can't write %s\n", csvFile.c_str());
+        return 1;
+    }
+    printf("wrote %s and %s\n", csvFile.c_str(), jsonFile.c_str());
+    return 0;
+}
+
+bool readTrackFiles(const std::string& actualFile, const std::string& approxFile, TrackSet tracks[2]) {
+    const std::string* filenames[] = { &actualFile, &approxFile };
+    for (int i = 0; i < 2; i++) {
+        const std::string& filename = *filenames[i];
+        if (!std::ifstream(filename)) {
+            printf("can't open %s\n", filename.c_str());
+            return false;
+        }
+        TrackSet& set = tracks[i];
+        readPointFile(filename.c_str(), [&](const std::vector<vec3dd::Vec3Dd>& points) {
+            set.addTrack(points);
+        });
+    }
+    return true;
+}
+
+// Pulls "<name> <value>" out of args, wherever it is; false if it isn't
+// there.
+bool takeOption(std::vector<std::string>& args, const char* name, std::string& value) {
+    for (size_t i = 1; i + 1 < args.size(); i++) {
+        if (args[i] == name) {
+            value = args[i + 1];
+            args.erase(args.begin() + i, args.begin() + i + 2);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Makes the batch's GL context on the named backend (see HeadlessContext)
+// and loads the scene into it.
+bool setupHeadless(const std::string& backendName, HeadlessContext& context, int width, int height) {
+    HeadlessContext::Backend backend;
+    if (!HeadlessContext::parseBackend(backendName, backend)) {
+        printf("unknown GL backend %s\n", backendName.c_str());
+        return false;
+    }
+    if (!context.create(backend)) {
+        printf("can't make a headless GL context (%s)\n", backendName.c_str());
+        return false;
+    }
+    printf("%s context: %s, %s\n", HeadlessContext::getBackendName(context.getBackend()),
+        (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION));
+
+    g_programs.compilePrograms();
+    // with no upload worker running, the layers load here
+    setupData(width, height);
+    g_uploader.publishAll();
+    return true;
+}
+
+// Renders one PNG per view (see parseView), named <png prefix>_<n>.png.
+// The GL context only draws and reads back; the encoding, which takes far
+// longer, runs on PngWriter's threads.
+//
+// "--workers <n>" splits the views over n copies of this program, each
+// with its own context and its own copy of the scene: the drawables are
+// globals with one vertex array each, which a context can't share. Every
+// worker loads the layers itself, so this pays off when drawing dominates,
+// as it does on a software renderer. A worker is run with
+// "--worker <index>/<count>" and draws every count'th view.
+int runRenderBatch(const std::vector<std::string>& batchArgs) {
+    std::vector<std::string> args = batchArgs;
+    std::string backendName = "auto", workersArg, workerArg;
+    takeOption(args, "--backend", backendName);
+    takeOption(args, "--workers", workersArg);
+    takeOption(args, "--worker", workerArg);
+
+    if (args.size() < 5) {
+        printf("usage: WorldPointViewer --render <width> <height> <png prefix> <lat,lon,alt>... "
+            "[--backend egl|osmesa|wgl] [--workers <n>]\n");
+        return 1;
+    }
+
+    const int WIDTH = atoi(args[1].c_str());
+    const int HEIGHT = atoi(args[2].c_str());
+    if (WIDTH <= 0 || HEIGHT <= 0) {
+        printf("bad image size %s x %s\n", args[1].c_str(), args[2].c_str());
+        return 1;
+    }
+
+    std::vector<vec3dd::Vec3Dd> positions(args.size() - 4);
+    for (size_t i = 4; i < args.size(); i++) {
+        if (!parseView(args[i], positions[i - 4])) {
+            return 1;
+        }
+    }
+
+    const unsigned int WORKER_COUNT = workersArg.empty() ? 1 : (unsigned int)std::max(1, atoi(workersArg.c_str()));
+    if (WORKER_COUNT > 1 && workerArg.empty()) {
+        std::vector<std::vector<std::string> > workerArgs(WORKER_COUNT, args);
+        for (unsigned int w = 0; w < WORKER_COUNT; w++) {
+            workerArgs[w].push_back("--backend");
+            workerArgs[w].push_back(backendName);
+            workerArgs[w].push_back("--worker");
+            workerArgs[w].push_back(std::to_string(w) + "/" + std::to_string(WORKER_COUNT));
+        }
+
+        long long start = FrameScheduler::now();
+        unsigned int failed = WorkerProcesses::run(workerArgs);
+        printf("%u of %u render workers finished in %.1f ms\n", WORKER_COUNT - failed, WORKER_COUNT,
+            FrameScheduler::ticksToMs(FrameScheduler::now() - start));
+        return (failed == 0) ? 0 : 1;
+    }
+
+    unsigned int workerIndex = 0, workerCount = 1;
+    if (!workerArg.empty() &&
+        (sscanf(workerArg.c_str(), "%u/%u", &workerIndex, &workerCount) != 2 ||
+        workerCount == 0 || workerIndex >= workerCount)) {
+        printf("bad worker %s\n", workerArg.c_str());
+        return 1;
+    }
+
+    HeadlessContext context;
+    if (!setupHeadless(backendName, context, WIDTH, HEIGHT)) {
+        return 1;
+    }
+
+    OffscreenTarget target;
+    if (!target.setup(WIDTH, HEIGHT)) {
+        cleanupScene();
+        return 1;
+    }
+
+    redoProjectionMatrix(WIDTH, HEIGHT);
+
+    long long start = FrameScheduler::now();
+    long long renderTicks = 0;
+
+    PngWriter writer;
+    std::vector<unsigned char> pixels;
+    unsigned int viewCount = 0;
+    for (size_t i = workerIndex; i < positions.size(); i += workerCount) {
+        long long renderStart = FrameScheduler::now();
+
+        g_camera.setPosition(positions[i]);
+        target.bind();
+        renderScene();
+        target.readPixels(pixels);
+
+        renderTicks += FrameScheduler::now() - renderStart;
+
+        // named for the view's place in the whole list, whichever worker
+        // draws it
+        char suffix[32];
+        sprintf(suffix, "_%03u.png", (unsigned int)i);
+        writer.write(args[3] + suffix, WIDTH, HEIGHT, pixels);
+        viewCount++;
+    }
+    target.unbind();
+    writer.finish();
+    target.cleanup();
+    cleanupScene();
+    context.destroy();
+
+    double totalMs = FrameScheduler::ticksToMs(FrameScheduler::now() - start);
+    printf("wrote %u of %u views at %d x %d in %.1f ms (%.1f ms rendering and reading back)\n",
+        writer.getWrittenCount(), viewCount, WIDTH, HEIGHT,
+        totalMs, FrameScheduler::ticksToMs(renderTicks));
+
+    return (writer.getFailedCount() == 0) ? 0 : 1;
+}
+
+// WorldPointViewer --poster <width> <height> <bmp file> <lat,lon,alt>
+int runPosterBatch(const std::vector<std::string>& batchArgs) {
+    std::vector<std::string> args = batchArgs;
+    std::string backendName = "auto";
+    takeOption(args, "--backend", backendName);
+
+    if (args.size() != 5) {
+        printf("usage: WorldPointViewer --poster <width> <height> <bmp file> <lat,lon,alt> "
+            "[--backend egl|osmesa|wgl]\n");
+        return 1;
+    }
+
+    const int WIDTH = atoi(args[1].c_str());
+    const int HEIGHT = atoi(args[2].c_str());
+    if (WIDTH <= 0 || HEIGHT <= 0) {
+        printf("bad image size %s x %s\n", args[1].c_str(), args[2].c_str());
+        return 1;
+    }
+
+    vec3dd::Vec3Dd position;
+    if (!parseView(args[4], position)) {
+        return 1;
+    }
+    g_camera.setPosition(position);
+
+    HeadlessContext context;
+    if (!setupHeadless(backendName, context, WIDTH, HEIGHT)) {
+        return 1;
+    }
+
+    bool ok = exportPoster(args[3].c_str(), WIDTH, HEIGHT);
+    cleanupScene();
+    context.destroy();
+    return ok ? 0 : 1;
+}
+
+// A view is lat,lon,alt in degrees and meters, looking at the center of
+// the earth.
+bool parseView(const std::string& view, vec3dd::Vec3Dd& position) {
+    double lat, lon, alt;
+    if (sscanf(view.c_str(), "%lf,%lf,%lf", &lat, &lon, &alt) != 3) {
+        printf("bad view %s; expected lat,lon,alt\n", view.c_str());
+        return false;
+    }
+    double latRad = lat * PI / 180.0;
+    double lonRad = lon * PI / 180.0;
+    double dist = EARTH_EQUITORIAL_RADIUS + alt;
+    position = vec3dd::create(
+        dist * cos(latRad) * cos(lonRad),
+        dist * cos(latRad) * sin(lonRad),
+        dist * sin(latRad));
+    return true;
+}
+
+#ifndef _WIN32
+// On Windows WinMain starts the batch modes. Elsewhere there's no window,
+// so they're all the program does.
+int main(int argc, char* argv[]) {
+    std::vector<std::string> args(argv + 1, argv + argc);
+    if (!isBatchMode(args)) {
+        printf("usage: WorldPointViewer --bin|--errors|--shape|--render|--poster ...\n"
+            "(the interactive viewer needs Windows)\n");
+        return 1;
+    }
+    return runBatchMode(args);
+}
+#endif
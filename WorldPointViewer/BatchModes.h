@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// The modes that run from the command line, without a window, picked by
+// the first argument:
+//
+//   --bin <order> <points file> <csv file>
+//   --errors <actual file> <approx file> <output prefix> [index|nearest]
+//   --shape <actual file> <approx file> <output prefix> [index|nearest]
+//   --render <width> <height> <png prefix> <lat,lon,alt>... [--backend <b>] [--workers <n>]
+//   --poster <width> <height> <bmp file> <lat,lon,alt> [--backend <b>]
+//
+// They build on every platform; off Windows they are the whole program.
+
+bool isBatchMode(const std::vector<std::string>& args);
+// Runs the mode args[0] names; returns the process's exit code.
+int runBatchMode(const std::vector<std::string>& args);
@@ -4,7 +4,8 @@
 BufferDrawable::BufferDrawable() :
     m_program(0),
     m_vao(0),
-    m_vbo(0)
+    m_vbo(0),
+    m_colorVbo(0)
 {
 }
 
@@ -22,8 +23,25 @@ void BufferDrawable::setup() {
 }
 
 void BufferDrawable::cleanup() {
+    m_stream.cleanup();
     glDeleteBuffers(1, &m_vbo);
+    glDeleteBuffers(1, &m_colorVbo);
     glDeleteVertexArrays(1, &m_vao);
+    m_colorVbo = 0;
+}
+
+void BufferDrawable::setVertexColor(Color color) {
+    const GLubyte RGBA[] = {
+        (GLubyte)color.r, (GLubyte)color.g, (GLubyte)color.b, (GLubyte)color.a
+    };
+    if (!m_colorVbo) {
+        glGenBuffers(1, &m_colorVbo);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, m_colorVbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(RGBA), RGBA, GL_STATIC_DRAW);
+    glVertexAttribPointer(COLOR_ATTRIB, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, 0);
+    glVertexAttribDivisor(COLOR_ATTRIB, 1);
+    glEnableVertexAttribArray(COLOR_ATTRIB);
 }
 
 void BufferDrawable::pushCoord4d(float x, float y, float z, std::vector<GLfloat>& coords) {
@@ -4,6 +4,9 @@
 
 #include <GL/glew.h>
 
+#include "Color.h"
+#include "StreamBuffer.h"
+
 class BufferDrawable
 {
 public:
@@ -22,7 +25,22 @@ protected:
     void pushCoord3d(float x, float y, std::vector<GLfloat>& coords);
     void pushCoord2d(float x, float y, std::vector<GLfloat>& coords);
 
+    // the attribute the simple program reads its color from
+    static const GLuint COLOR_ATTRIB = 3;
+
+    // Gives every vertex drawn from the bound vertex array this color. It's
+    // a single value in m_colorVbo that the attribute steps through once
+    // per instance, so a plain draw reads it for every vertex. Drawables
+    // sharing a program then keep their colors in their own vertex arrays,
+    // and the color uniform the render queue caches per program stays put.
+    void setVertexColor(Color color);
+
     GLuint m_program;
     GLuint m_vao;
     GLuint m_vbo;
+    GLuint m_colorVbo;
+
+    // for vertices that are rewritten every frame; drawables that need it
+    // set it up themselves
+    StreamBuffer m_stream;
 };
@@ -16,7 +16,8 @@ Camera::Camera(const vec3df::Vec3Df& position, float rotation, float elevation)
 }
 
 Camera::Camera(const vec3df::Vec3Df& position, float rotation, float elevation, float twist) :
-    m_position(position) {
+    m_position(vec3dd::create(position)),
+    m_version(0) {
     //m_fwd(vec3df::create(0, 0, -1)),
     //m_side(vec3df::create(1, 0, 0)),
     //m_up(vec3df::create(0, 1, 0)) {
@@ -36,11 +37,25 @@ Camera::~Camera() {
 }
 
 vec3df::Vec3Df Camera::getPosition() const {
+    return vec3dd::toFloat(m_position);
+}
+
+vec3dd::Vec3Dd Camera::getPositionPrecise() const {
     return m_position;
 }
 
 void Camera::setPosition(const vec3df::Vec3Df& pos) {
+    m_position = vec3dd::create(pos);
+    m_version++;
+}
+
+void Camera::setPosition(const vec3dd::Vec3Dd& pos) {
     m_position = pos;
+    m_version++;
+}
+
+unsigned int Camera::getVersion() const {
+    return m_version;
 }
 
 vec3df::Vec3Df Camera::getTarget() const {
@@ -50,7 +65,7 @@ vec3df::Vec3Df Camera::getTarget() const {
 
 vec3df::Vec3Df Camera::getFwd() const {
     //return m_fwd;
-    return (m_position * -1).getUnit();
+    return vec3dd::toFloat((m_position * -1).getUnit());
 }
 
 vec3df::Vec3Df Camera::getUp() const {
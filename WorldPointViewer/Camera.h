@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Vec3Df.h"
+#include "Vec3Dd.h"
 #include "Vec4Df.h"
 #include "Matrix4Df.h"
 
@@ -14,12 +15,17 @@ public:
     ~Camera();
 
     vec3df::Vec3Df getPosition() const;
+    vec3dd::Vec3Dd getPositionPrecise() const;
     void setPosition(const vec3df::Vec3Df& pos);
+    void setPosition(const vec3dd::Vec3Dd& pos);
     vec3df::Vec3Df getTarget() const;
     vec3df::Vec3Df getFwd() const;
     vec3df::Vec3Df getUp() const;
     vec3df::Vec3Df getSide() const;
 
+    // changes whenever the camera moves
+    unsigned int getVersion() const;
+
     //void moveForward(float delta);
     //void moveSide(float delta);
     //void moveUp(float delta);
@@ -30,7 +36,10 @@ public:
     //void spinAroundUp(float theta);
 
 protected:
-    vec3df::Vec3Df m_position;
+    // kept in double so the eye can sit a meter off the surface without
+    // snapping to the half-meter float grid
+    vec3dd::Vec3Dd m_position;
+    unsigned int m_version;
     //vec3df::Vec3Df m_fwd;
     //vec3df::Vec3Df m_side;
     //vec3df::Vec3Df m_up;
@@ -0,0 +1,54 @@
+#include "ColorRamp.h"
+
+#include <algorithm>
+#include <vector>
+
+ColorRamp::ColorRamp() :
+    m_texture(0)
+{
+}
+
+ColorRamp::~ColorRamp()
+{
+}
+
+void ColorRamp::setup() {
+    // the same stops as the heatmap's ramp
+    const float STOPS[][3] = {
+        { 0, 0, 1 },
+        { 0, 1, 1 },
+        { 0, 1, 0 },
+        { 1, 1, 0 },
+        { 1, 0, 0 },
+    };
+    const int STOP_COUNT = sizeof(STOPS) / sizeof(STOPS[0]);
+
+    std::vector<GLubyte> texels(SIZE * 4);
+    for (int i = 0; i < SIZE; i++) {
+        float t = (float)i / (SIZE - 1) * (STOP_COUNT - 1);
+        int stop = std::min((int)t, STOP_COUNT - 2);
+        float f = t - stop;
+        for (int c = 0; c < 3; c++) {
+            float value = STOPS[stop][c] * (1 - f) + STOPS[stop + 1][c] * f;
+            texels[i * 4 + c] = (GLubyte)(value * 255 + 0.5f);
+        }
+        texels[i * 4 + 3] = 255;
+    }
+
+    glGenTextures(1, &m_texture);
+    glBindTexture(GL_TEXTURE_1D, m_texture);
+    glTexImage1D(GL_TEXTURE_1D, 0, GL_RGBA8, SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, texels.data());
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_1D, 0);
+}
+
+void ColorRamp::cleanup() {
+    glDeleteTextures(1, &m_texture);
+    m_texture = 0;
+}
+
+GLuint ColorRamp::getTexture() const {
+    return m_texture;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <GL/glew.h>
+
+// A 1D texture running from blue through cyan, green and yellow to red,
+// for mapping a scalar in [0, 1] to a color in a shader.
+class ColorRamp
+{
+public:
+    static const int SIZE = 256;
+
+    ColorRamp();
+    ~ColorRamp();
+
+    void setup();
+    void cleanup();
+
+    GLuint getTexture() const;
+
+protected:
+    GLuint m_texture;
+};
@@ -0,0 +1,420 @@
+#include "DensityBinner.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+
+#include <emmintrin.h>
+
+#include "Utils.h"
+
+namespace {
+    // atan(x) for x in [0, 1] to within 1e-7 radians, as in Cephes' atanf:
+    // above tan(pi / 8) it's pi / 4 + atan((x - 1) / (x + 1)), and the
+    // polynomial covers [-tan(pi / 8), tan(pi / 8)].
+    const float TAN_PI_8 = 0.41421356f;
+    const float ATAN_C0 = 8.05374449538e-2f;
+    const float ATAN_C1 = -1.38776856032e-1f;
+    const float ATAN_C2 = 1.99777106478e-1f;
+    const float ATAN_C3 = -3.33329491539e-1f;
+
+    // atan2(y, x) / (pi / 2) in [0, 4). Both the scalar and the SSE paths
+    // use this same approximation so a point gets the same cell from
+    // either.
+    float quarterTurns(float y, float x) {
+        float ax = fabsf(x);
+        float ay = fabsf(y);
+        float mx = std::max(ax, ay);
+        float mn = std::min(ax, ay);
+        float a = (mx > 0) ? (mn / mx) : 0;
+        float base = 0;
+        if (a > TAN_PI_8) {
+            a = (a - 1) / (a + 1);
+            base = (float)(PI / 4);
+        }
+        float s = a * a;
+        float r = (((ATAN_C0 * s + ATAN_C1) * s + ATAN_C2) * s + ATAN_C3) * s * a + a;
+        r = (r + base) * (float)(2 / PI);
+        if (ay > ax) {
+            r = 1 - r;
+        }
+        if (x < 0) {
+            r = 2 - r;
+        }
+        if (y < 0) {
+            r = 4 - r;
+        }
+        return (r >= 4) ? 0 : r;
+    }
+
+    __m128 quarterTurns4(__m128 y, __m128 x) {
+        const __m128 ZERO = _mm_setzero_ps();
+        const __m128 ONE = _mm_set1_ps(1);
+        const __m128 TWO = _mm_set1_ps(2);
+        const __m128 FOUR = _mm_set1_ps(4);
+        const __m128 SIGN = _mm_set1_ps(-0.0f);
+
+        __m128 ax = _mm_andnot_ps(SIGN, x);
+        __m128 ay = _mm_andnot_ps(SIGN, y);
+        __m128 mx = _mm_max_ps(ax, ay);
+        __m128 mn = _mm_min_ps(ax, ay);
+        __m128 a = _mm_and_ps(_mm_div_ps(mn, mx), _mm_cmpgt_ps(mx, ZERO));
+
+        auto select = [](__m128 mask, __m128 ifTrue, __m128 ifFalse) {
+            return _mm_or_ps(_mm_and_ps(mask, ifTrue), _mm_andnot_ps(mask, ifFalse));
+        };
+
+        __m128 big = _mm_cmpgt_ps(a, _mm_set1_ps(TAN_PI_8));
+        a = select(big, _mm_div_ps(_mm_sub_ps(a, ONE), _mm_add_ps(a, ONE)), a);
+        __m128 base = _mm_and_ps(big, _mm_set1_ps((float)(PI / 4)));
+        __m128 s = _mm_mul_ps(a, a);
+
+        __m128 r = _mm_set1_ps(ATAN_C0);
+        r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(ATAN_C1));
+        r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(ATAN_C2));
+        r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(ATAN_C3));
+        r = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(r, s), a), a);
+        r = _mm_mul_ps(_mm_add_ps(r, base), _mm_set1_ps((float)(2 / PI)));
+        r = select(_mm_cmpgt_ps(ay, ax), _mm_sub_ps(ONE, r), r);
+        r = select(_mm_cmplt_ps(x, ZERO), _mm_sub_ps(TWO, r), r);
+        r = select(_mm_cmplt_ps(y, ZERO), _mm_sub_ps(FOUR, r), r);
+        return _mm_andnot_ps(_mm_cmpge_ps(r, FOUR), r);
+    }
+
+    // spreads the low 16 bits of v to the even bits
+    unsigned int spreadBits(unsigned int v) {
+        v = (v | (v << 8)) & 0x00ff00ff;
+        v = (v | (v << 4)) & 0x0f0f0f0f;
+        v = (v | (v << 2)) & 0x33333333;
+        v = (v | (v << 1)) & 0x55555555;
+        return v;
+    }
+
+    __m128i spreadBits4(__m128i v) {
+        v = _mm_and_si128(_mm_or_si128(v, _mm_slli_epi32(v, 8)), _mm_set1_epi32(0x00ff00ff));
+        v = _mm_and_si128(_mm_or_si128(v, _mm_slli_epi32(v, 4)), _mm_set1_epi32(0x0f0f0f0f));
+        v = _mm_and_si128(_mm_or_si128(v, _mm_slli_epi32(v, 2)), _mm_set1_epi32(0x33333333));
+        v = _mm_and_si128(_mm_or_si128(v, _mm_slli_epi32(v, 1)), _mm_set1_epi32(0x55555555));
+        return v;
+    }
+
+    // the inverse of spreadBits
+    unsigned int compactBits(unsigned int v) {
+        v &= 0x55555555;
+        v = (v | (v >> 1)) & 0x33333333;
+        v = (v | (v >> 2)) & 0x0f0f0f0f;
+        v = (v | (v >> 4)) & 0x00ff00ff;
+        v = (v | (v >> 8)) & 0x0000ffff;
+        return v;
+    }
+}
+
+DensityBinner::DensityBinner(int order) :
+    m_order(std::max(0, std::min(order, MAX_ORDER)))
+{
+    clear();
+}
+
+DensityBinner::~DensityBinner()
+{
+}
+
+int DensityBinner::getOrder() const {
+    return m_order;
+}
+
+unsigned int DensityBinner::getCellCount() const {
+    return 12u << (2 * m_order);
+}
+
+double DensityBinner::getCellArea(double radius) const {
+    return 4 * PI * radius * radius / getCellCount();
+}
+
+void DensityBinner::clear() {
+    m_counts.assign(getCellCount(), 0);
+}
+
+const std::vector<unsigned long long>& DensityBinner::getCounts() const {
+    return m_counts;
+}
+
+unsigned long long DensityBinner::getTotal() const {
+    unsigned long long total = 0;
+    for (auto count : m_counts) {
+        total += count;
+    }
+    return total;
+}
+
+// HEALPix's ang2pix for the nested scheme (Gorski et al. 2005), from a
+// direction rather than angles. 1 - |z| is computed as
+// (x^2 + y^2) / (r (r + |z|)), which keeps its precision near the poles.
+unsigned int DensityBinner::cellFor(float x, float y, float z, int order) {
+    const int NSIDE = 1 << order;
+
+    float rxy2 = x * x + y * y;
+    float r = sqrtf(rxy2 + z * z);
+    float cosTheta = (r > 0) ? (z / r) : 1;
+    float tt = quarterTurns(y, x);
+
+    int face, ix, iy;
+    if (fabsf(cosTheta) <= 2.0f / 3.0f) {
+        // equatorial region
+        float temp1 = NSIDE * (0.5f + tt);
+        float temp2 = NSIDE * (cosTheta * 0.75f);
+        int jp = (int)(temp1 - temp2);
+        int jm = (int)(temp1 + temp2);
+        int ifp = jp >> order;
+        int ifm = jm >> order;
+        face = (ifp == ifm) ? (ifp | 4) : ((ifp < ifm) ? ifp : (ifm + 8));
+        ix = jm & (NSIDE - 1);
+        iy = NSIDE - (jp & (NSIDE - 1)) - 1;
+    }
+    else {
+        // polar caps
+        int ntt = std::min(3, (int)tt);
+        float tp = tt - ntt;
+        float oneMinusZ = (r > 0) ? (rxy2 / (r * (r + fabsf(z)))) : 0;
+        float tmp = NSIDE * sqrtf(3 * oneMinusZ);
+        int jp = std::min(NSIDE - 1, (int)(tp * tmp));
+        int jm = std::min(NSIDE - 1, (int)((1 - tp) * tmp));
+        if (z >= 0) {
+            face = ntt;
+            ix = NSIDE - jm - 1;
+            iy = NSIDE - jp - 1;
+        }
+        else {
+            face = ntt + 8;
+            ix = jp;
+            iy = jm;
+        }
+    }
+
+    return ((unsigned int)face << (2 * order)) +
+        (spreadBits(ix) | (spreadBits(iy) << 1));
+}
+
+void DensityBinner::cellsFor4(
+    const float* xs, const float* ys, const float* zs, int order,
+    unsigned int cells[4]) {
+
+    const int NSIDE = 1 << order;
+    const __m128 ZERO = _mm_setzero_ps();
+    const __m128 ONE = _mm_set1_ps(1);
+    const __m128 NSIDE_F = _mm_set1_ps((float)NSIDE);
+    const __m128 MAX_J = _mm_set1_ps((float)(NSIDE - 1));
+    const __m128 SIGN = _mm_set1_ps(-0.0f);
+    const __m128i NSIDE_I = _mm_set1_epi32(NSIDE);
+    const __m128i NSIDE_MASK = _mm_set1_epi32(NSIDE - 1);
+    const __m128i ONE_I = _mm_set1_epi32(1);
+
+    auto selectI = [](__m128i mask, __m128i ifTrue, __m128i ifFalse) {
+        return _mm_or_si128(_mm_and_si128(mask, ifTrue), _mm_andnot_si128(mask, ifFalse));
+    };
+
+    __m128 x = _mm_loadu_ps(xs);
+    __m128 y = _mm_loadu_ps(ys);
+    __m128 z = _mm_loadu_ps(zs);
+
+    __m128 rxy2 = _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y));
+    __m128 r = _mm_sqrt_ps(_mm_add_ps(rxy2, _mm_mul_ps(z, z)));
+    __m128 rPositive = _mm_cmpgt_ps(r, ZERO);
+    __m128 cosTheta = _mm_or_ps(
+        _mm_and_ps(rPositive, _mm_div_ps(z, r)), _mm_andnot_ps(rPositive, ONE));
+    __m128 tt = quarterTurns4(y, x);
+
+    // equatorial region
+    __m128 temp1 = _mm_mul_ps(NSIDE_F, _mm_add_ps(_mm_set1_ps(0.5f), tt));
+    __m128 temp2 = _mm_mul_ps(NSIDE_F, _mm_mul_ps(cosTheta, _mm_set1_ps(0.75f)));
+    __m128i jp = _mm_cvttps_epi32(_mm_sub_ps(temp1, temp2));
+    __m128i jm = _mm_cvttps_epi32(_mm_add_ps(temp1, temp2));
+    __m128i ifp = _mm_srli_epi32(jp, order);
+    __m128i ifm = _mm_srli_epi32(jm, order);
+    __m128i eqFace = selectI(_mm_cmpeq_epi32(ifp, ifm),
+        _mm_or_si128(ifp, _mm_set1_epi32(4)),
+        selectI(_mm_cmplt_epi32(ifp, ifm), ifp, _mm_add_epi32(ifm, _mm_set1_epi32(8))));
+    __m128i eqIx = _mm_and_si128(jm, NSIDE_MASK);
+    __m128i eqIy = _mm_sub_epi32(_mm_sub_epi32(NSIDE_I, _mm_and_si128(jp, NSIDE_MASK)), ONE_I);
+
+    // polar caps
+    __m128 ntt = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(tt)), _mm_set1_ps(3));
+    __m128 tp = _mm_sub_ps(tt, ntt);
+    __m128 oneMinusZ = _mm_and_ps(rPositive,
+        _mm_div_ps(rxy2, _mm_mul_ps(r, _mm_add_ps(r, _mm_andnot_ps(SIGN, z)))));
+    __m128 tmp = _mm_mul_ps(NSIDE_F, _mm_sqrt_ps(_mm_mul_ps(_mm_set1_ps(3), oneMinusZ)));
+    __m128i pjp = _mm_cvttps_epi32(_mm_min_ps(_mm_mul_ps(tp, tmp), MAX_J));
+    __m128i pjm = _mm_cvttps_epi32(_mm_min_ps(_mm_mul_ps(_mm_sub_ps(ONE, tp), tmp), MAX_J));
+    __m128i north = _mm_castps_si128(_mm_cmpge_ps(z, ZERO));
+    __m128i nttI = _mm_cvttps_epi32(ntt);
+    __m128i polarFace = selectI(north, nttI, _mm_add_epi32(nttI, _mm_set1_epi32(8)));
+    __m128i polarIx = selectI(north, _mm_sub_epi32(_mm_sub_epi32(NSIDE_I, pjm), ONE_I), pjp);
+    __m128i polarIy = selectI(north, _mm_sub_epi32(_mm_sub_epi32(NSIDE_I, pjp), ONE_I), pjm);
+
+    __m128i equatorial = _mm_castps_si128(
+        _mm_cmple_ps(_mm_andnot_ps(SIGN, cosTheta), _mm_set1_ps(2.0f / 3.0f)));
+    __m128i face = selectI(equatorial, eqFace, polarFace);
+    __m128i ix = selectI(equatorial, eqIx, polarIx);
+    __m128i iy = selectI(equatorial, eqIy, polarIy);
+
+    __m128i cell = _mm_add_epi32(
+        _mm_slli_epi32(face, 2 * order),
+        _mm_or_si128(spreadBits4(ix), _mm_slli_epi32(spreadBits4(iy), 1)));
+    _mm_storeu_si128((__m128i*)cells, cell);
+}
+
+void DensityBinner::cellCenter(unsigned int cell, int order, double& lat, double& lon) {
+    // HEALPix's pix2ang for the nested scheme
+    const int NSIDE = 1 << order;
+    const unsigned int FACE_CELLS = 1u << (2 * order);
+
+    // row and column of each base face in the ring/longitude layout
+    const int JRLL[12] = { 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4 };
+    const int JPLL[12] = { 1, 3, 5, 7, 0, 2, 4, 6, 1, 3, 5, 7 };
+
+    int face = cell / FACE_CELLS;
+    unsigned int inFace = cell % FACE_CELLS;
+    int ix = compactBits(inFace);
+    int iy = compactBits(inFace >> 1);
+
+    int jr = JRLL[face] * NSIDE - ix - iy - 1;
+
+    int nr;
+    double z;
+    int kshift;
+    if (jr < NSIDE) {
+        nr = jr;
+        z = 1 - nr * nr / (3.0 * NSIDE * NSIDE);
+        kshift = 0;
+    }
+    else if (jr > 3 * NSIDE) {
+        nr = 4 * NSIDE - jr;
+        z = nr * nr / (3.0 * NSIDE * NSIDE) - 1;
+        kshift = 0;
+    }
+    else {
+        nr = NSIDE;
+        z = (2 * NSIDE - jr) * 2.0 / (3.0 * NSIDE);
+        kshift = (jr - NSIDE) & 1;
+    }
+
+    int jp = (JPLL[face] * nr + ix - iy + 1 + kshift) / 2;
+    if (jp > 4 * NSIDE) {
+        jp -= 4 * NSIDE;
+    }
+    if (jp < 1) {
+        jp += 4 * NSIDE;
+    }
+
+    double phi = (jp - (kshift + 1) * 0.5) * (PI / 2) / nr;
+    lat = asin(std::max(-1.0, std::min(1.0, z))) * 180 / PI;
+    lon = phi * 180 / PI;
+    if (lon > 180) {
+        lon -= 360;
+    }
+}
+
+void DensityBinner::binRange(
+    const float* coords, size_t first, size_t last, int order,
+    unsigned int* histogram) {
+
+    size_t i = first;
+
+    float xs[4], ys[4], zs[4];
+    unsigned int cells[4];
+    for (; i + 4 <= last; i += 4) {
+        const float* p = coords + i * 3;
+        for (int k = 0; k < 4; k++) {
+            xs[k] = p[k * 3];
+            ys[k] = p[k * 3 + 1];
+            zs[k] = p[k * 3 + 2];
+        }
+        cellsFor4(xs, ys, zs, order, cells);
+        histogram[cells[0]]++;
+        histogram[cells[1]]++;
+        histogram[cells[2]]++;
+        histogram[cells[3]]++;
+    }
+
+    for (; i < last; i++) {
+        const float* p = coords + i * 3;
+        histogram[cellFor(p[0], p[1], p[2], order)]++;
+    }
+}
+
+void DensityBinner::bin(const float* coords, size_t pointCount, unsigned int threadCount) {
+    if (pointCount == 0) {
+        return;
+    }
+
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    // not worth a thread for fewer than this
+    const size_t MIN_POINTS_PER_THREAD = 1 << 16;
+    threadCount = (unsigned int)std::max((size_t)1,
+        std::min((size_t)threadCount, pointCount / MIN_POINTS_PER_THREAD));
+
+    const unsigned int CELL_COUNT = getCellCount();
+    std::vector<std::vector<unsigned int> > histograms(threadCount);
+
+    auto binWorker = [&](unsigned int t) {
+        histograms[t].assign(CELL_COUNT, 0);
+        size_t first = pointCount * t / threadCount;
+        size_t last = pointCount * (t + 1) / threadCount;
+        binRange(coords, first, last, m_order, histograms[t].data());
+    };
+
+    // Each thread then sums one range of cells across all the histograms.
+    auto mergeWorker = [&](unsigned int t) {
+        size_t first = (size_t)CELL_COUNT * t / threadCount;
+        size_t last = (size_t)CELL_COUNT * (t + 1) / threadCount;
+        for (auto& histogram : histograms) {
+            for (size_t c = first; c < last; c++) {
+                m_counts[c] += histogram[c];
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int t = 1; t < threadCount; t++) {
+        threads.push_back(std::thread(binWorker, t));
+    }
+    binWorker(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+
+    for (unsigned int t = 1; t < threadCount; t++) {
+        threads.push_back(std::thread(mergeWorker, t));
+    }
+    mergeWorker(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+bool DensityBinner::writeCsv(const char* filename, double radius) const {
+    FILE* file = fopen(filename, "w");
+    if (!file) {
+        return false;
+    }
+
+    const double CELL_AREA_KM2 = getCellArea(radius) / 1e6;
+
+    fprintf(file, "cell,lat,lon,count,per_km2\n");
+    for (unsigned int c = 0; c < (unsigned int)m_counts.size(); c++) {
+        if (m_counts[c] == 0) {
+            continue;
+        }
+        double lat, lon;
+        cellCenter(c, m_order, lat, lon);
+        fprintf(file, "%u,%.6f,%.6f,%llu,%.6g\n",
+            c, lat, lon, m_counts[c], m_counts[c] / CELL_AREA_KM2);
+    }
+
+    fclose(file);
+    return true;
+}
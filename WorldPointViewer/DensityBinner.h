@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Counts points per cell of a HEALPix grid in the nested scheme. HEALPix
+// cells all have the same area, so the counts are densities, and in the
+// nested scheme the four children of cell c at one order are cells 4c to
+// 4c + 3 at the next, so coarser counts are sums of runs of finer ones.
+//
+// The grid at order k has 12 * 4^k cells. Each worker thread keeps its own
+// full histogram, so memory is 4 bytes per cell per thread; MAX_ORDER keeps
+// that reasonable (12.6M cells, about 1.7 km across on the Earth).
+class DensityBinner
+{
+public:
+    static const int MAX_ORDER = 10;
+
+    DensityBinner(int order);
+    ~DensityBinner();
+
+    int getOrder() const;
+    unsigned int getCellCount() const;
+    // area of every cell on a sphere of the given radius
+    double getCellArea(double radius) const;
+
+    // Adds pointCount points, given as x, y, z floats, to the counts using
+    // threadCount worker threads (0 picks one per hardware thread). The
+    // points only need to be in the right direction from the center.
+    void bin(const float* coords, size_t pointCount, unsigned int threadCount = 0);
+    void clear();
+
+    const std::vector<unsigned long long>& getCounts() const;
+    unsigned long long getTotal() const;
+
+    // Writes "cell,lat,lon,count,per_km2" for every non-empty cell.
+    bool writeCsv(const char* filename, double radius) const;
+
+    static unsigned int cellFor(float x, float y, float z, int order);
+    // the same, for four points at once
+    static void cellsFor4(
+        const float* xs, const float* ys, const float* zs, int order,
+        unsigned int cells[4]);
+    // center of a cell, in degrees
+    static void cellCenter(unsigned int cell, int order, double& lat, double& lon);
+
+protected:
+    static void binRange(
+        const float* coords, size_t first, size_t last, int order,
+        unsigned int* histogram);
+
+    int m_order;
+    std::vector<unsigned long long> m_counts;
+};
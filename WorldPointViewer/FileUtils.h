@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdio>
+
+// The few file system calls that differ between Windows and POSIX.
+
+// Creates a directory; true if it was made or is already there.
+bool makeDirectory(const char* path);
+
+// fseek with a 64-bit offset, for files past 2 GB: long is 32 bits on
+// Windows.
+int seekFile(FILE* file, long long offset, int origin);
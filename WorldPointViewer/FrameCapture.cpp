@@ -0,0 +1,142 @@
+#include "FrameCapture.h"
+
+#include <cstdio>
+#include <cstring>
+
+FrameCapture::FrameCapture() :
+    m_capturing(false),
+    m_width(0),
+    m_height(0),
+    m_oldest(0),
+    m_inFlight(0),
+    m_frameCount(0),
+    m_stallCount(0)
+{
+    for (unsigned int i = 0; i < PBO_COUNT; i++) {
+        m_pbos[i] = 0;
+        m_fences[i] = 0;
+        m_frameNumbers[i] = 0;
+    }
+}
+
+FrameCapture::~FrameCapture()
+{
+}
+
+void FrameCapture::start(const std::string& prefix, int width, int height) {
+    stop();
+
+    m_prefix = prefix;
+    m_width = width;
+    m_height = height;
+    m_oldest = 0;
+    m_inFlight = 0;
+    m_frameCount = 0;
+    m_stallCount = 0;
+
+    const GLsizeiptr FRAME_BYTES = (GLsizeiptr)width * height * 4;
+    glGenBuffers(PBO_COUNT, m_pbos);
+    for (unsigned int i = 0; i < PBO_COUNT; i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbos[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, FRAME_BYTES, nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    m_writer.reset(new PngWriter());
+    m_capturing = true;
+}
+
+void FrameCapture::stop() {
+    if (!m_capturing) {
+        return;
+    }
+
+    while (m_inFlight > 0) {
+        collectOldest(true);
+    }
+    m_writer->finish();
+    printf("captured %u frames to %s_*.png, %u written, %u failed, %u stalls\n",
+        m_frameCount, m_prefix.c_str(),
+        m_writer->getWrittenCount(), m_writer->getFailedCount(), m_stallCount);
+    m_writer.reset();
+
+    glDeleteBuffers(PBO_COUNT, m_pbos);
+    for (unsigned int i = 0; i < PBO_COUNT; i++) {
+        m_pbos[i] = 0;
+    }
+    std::vector<unsigned char>().swap(m_pixels);
+    m_capturing = false;
+}
+
+bool FrameCapture::isCapturing() const {
+    return m_capturing;
+}
+
+void FrameCapture::captureFrame(int width, int height) {
+    if (!m_capturing) {
+        return;
+    }
+    if (width != m_width || height != m_height) {
+        printf("window resized; stopping capture\n");
+        stop();
+        return;
+    }
+
+    // Finished copies are written out whenever they're ready, but a full
+    // ring has to give up its oldest slot even if that means waiting.
+    while (m_inFlight > 0 && collectOldest(false)) {
+    }
+    if (m_inFlight == PBO_COUNT) {
+        m_stallCount++;
+        collectOldest(true);
+    }
+
+    unsigned int slot = (m_oldest + m_inFlight) % PBO_COUNT;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbos[slot]);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadBuffer(GL_BACK);
+    glReadPixels(0, 0, m_width, m_height, GL_BGRA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    m_fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_frameNumbers[slot] = m_frameCount++;
+    m_inFlight++;
+}
+
+bool FrameCapture::collectOldest(bool wait) {
+    unsigned int slot = m_oldest;
+
+    GLuint64 timeout = wait ? 1000000000ULL : 0;
+    GLenum result = glClientWaitSync(m_fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+    if (result == GL_TIMEOUT_EXPIRED && !wait) {
+        return false;
+    }
+    glDeleteSync(m_fences[slot]);
+    m_fences[slot] = 0;
+
+    const size_t FRAME_BYTES = (size_t)m_width * m_height * 4;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbos[slot]);
+    const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, FRAME_BYTES, GL_MAP_READ_BIT);
+    if (mapped) {
+        m_pixels.resize(FRAME_BYTES);
+        memcpy(m_pixels.data(), mapped, FRAME_BYTES);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+
+        char suffix[32];
+        sprintf(suffix, "_%05u.png", m_frameNumbers[slot]);
+        m_writer->write(m_prefix + suffix, m_width, m_height, m_pixels);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    m_oldest = (m_oldest + 1) % PBO_COUNT;
+    m_inFlight--;
+    return true;
+}
+
+unsigned int FrameCapture::getFrameCount() const {
+    return m_frameCount;
+}
+
+unsigned int FrameCapture::getStallCount() const {
+    return m_stallCount;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "PngWriter.h"
+
+// Records the window's frames as numbered PNGs. Each frame is read into
+// the next of a ring of pixel pack buffers and only mapped a couple of
+// frames later, when the copy is done, so the readback doesn't stall the
+// pipeline. Encoding happens on PngWriter's threads.
+class FrameCapture
+{
+public:
+    static const unsigned int PBO_COUNT = 3;
+
+    FrameCapture();
+    ~FrameCapture();
+
+    // Frames are written to <prefix>_<n>.png at width x height.
+    void start(const std::string& prefix, int width, int height);
+    // Writes out the frames still in flight and waits for the encoder.
+    void stop();
+    bool isCapturing() const;
+
+    // Call after drawing a frame and before swapping. Capture stops if the
+    // window is no longer the size it started at.
+    void captureFrame(int width, int height);
+
+    unsigned int getFrameCount() const;
+    // frames that had to wait for their copy because the ring was full
+    unsigned int getStallCount() const;
+
+protected:
+    // Hands the oldest frame in flight to the writer. Unless wait is set,
+    // gives up if its copy hasn't finished.
+    bool collectOldest(bool wait);
+
+    bool m_capturing;
+    std::string m_prefix;
+    int m_width;
+    int m_height;
+
+    GLuint m_pbos[PBO_COUNT];
+    GLsync m_fences[PBO_COUNT];
+    unsigned int m_frameNumbers[PBO_COUNT];
+    // the oldest slot in flight and how many are
+    unsigned int m_oldest;
+    unsigned int m_inFlight;
+
+    unsigned int m_frameCount;
+    unsigned int m_stallCount;
+
+    std::unique_ptr<PngWriter> m_writer;
+    std::vector<unsigned char> m_pixels;
+};
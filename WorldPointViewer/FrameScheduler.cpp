@@ -0,0 +1,260 @@
+#include "FrameScheduler.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include <GL/glew.h>
+#ifdef _WIN32
+#include <GL/Wglew.h>
+#endif
+
+namespace {
+    // A function rather than a global so it's safe to use from the
+    // constructors of other globals.
+    long long counterFrequency() {
+#ifdef _WIN32
+        static long long frequency = 0;
+        if (frequency == 0) {
+            LARGE_INTEGER value;
+            ::QueryPerformanceFrequency(&value);
+            frequency = value.QuadPart;
+        }
+        return frequency;
+#else
+        return 1000000000;
+#endif
+    }
+
+    void sleepMs(double ms) {
+#ifdef _WIN32
+        ::Sleep((DWORD)ms);
+#else
+        struct timespec duration;
+        duration.tv_sec = (time_t)(ms / 1000);
+        duration.tv_nsec = (long)((ms - duration.tv_sec * 1000.0) * 1e6);
+        nanosleep(&duration, nullptr);
+#endif
+    }
+
+    // nearest-rank percentile of a sorted list
+    double percentile(const std::vector<float>& sorted, double p) {
+        if (sorted.empty()) {
+            return 0;
+        }
+        size_t rank = (size_t)ceil(p * sorted.size());
+        return sorted[std::max(rank, (size_t)1) - 1];
+    }
+}
+
+FrameScheduler::FrameScheduler(double targetFps) :
+    m_targetFps(targetFps),
+    m_period((long long)(counterFrequency() / targetFps)),
+    m_nextDeadline(0),
+    m_vsync(false),
+    m_continuous(false),
+    m_frameStart(0),
+    m_lastFrameEnd(0),
+    m_nextFrame(0)
+{
+}
+
+FrameScheduler::~FrameScheduler()
+{
+    setContinuous(false);
+}
+
+bool FrameScheduler::setVsync(bool vsync) {
+#ifdef _WIN32
+    if (!WGLEW_EXT_swap_control || !wglSwapIntervalEXT(vsync ? 1 : 0)) {
+        return false;
+    }
+#else
+    if (vsync) {
+        return false;
+    }
+#endif
+    m_vsync = vsync;
+    reset();
+    return true;
+}
+
+bool FrameScheduler::isVsync() const {
+    return m_vsync;
+}
+
+void FrameScheduler::setContinuous(bool continuous) {
+#ifdef _WIN32
+    // Sleep() otherwise rounds up to the 15.6 ms scheduler tick. The finer
+    // tick costs power system-wide, so it's only held while pacing.
+    if (continuous && !m_continuous) {
+        ::timeBeginPeriod(1);
+    }
+    else if (!continuous && m_continuous) {
+        ::timeEndPeriod(1);
+    }
+#endif
+    m_continuous = continuous;
+    reset();
+}
+
+void FrameScheduler::waitForNextFrame() {
+    if (m_vsync) {
+        return;
+    }
+
+    long long current = now();
+    if (m_nextDeadline == 0 || current - m_nextDeadline > m_period) {
+        // first frame, or more than a frame behind: start over from now
+        // rather than rushing to catch up
+        m_nextDeadline = current;
+    }
+
+    // sleep for most of the wait and spin for the last bit, since a sleep
+    // can overshoot by up to a millisecond
+    const long long SPIN_TICKS = counterFrequency() * 2 / 1000;
+    if (m_nextDeadline - current > SPIN_TICKS) {
+        sleepMs(ticksToMs(m_nextDeadline - current - SPIN_TICKS));
+    }
+    while (now() < m_nextDeadline) {
+    }
+
+    // advance from the deadline, not from now, so the pacing doesn't drift
+    m_nextDeadline += m_period;
+}
+
+void FrameScheduler::beginFrame() {
+    m_frameStart = now();
+}
+
+void FrameScheduler::endFrame() {
+    long long frameEnd = now();
+
+    long long since = m_frameStart;
+    if (m_continuous && m_lastFrameEnd != 0) {
+        since = m_lastFrameEnd;
+    }
+    float ms = (float)ticksToMs(frameEnd - since);
+    m_lastFrameEnd = frameEnd;
+
+    if (m_frameTimes.size() < WINDOW_SIZE) {
+        m_frameTimes.push_back(ms);
+    }
+    else {
+        m_frameTimes[m_nextFrame] = ms;
+    }
+    m_nextFrame = (m_nextFrame + 1) % WINDOW_SIZE;
+}
+
+void FrameScheduler::reset() {
+    m_frameTimes.clear();
+    m_nextFrame = 0;
+    m_nextDeadline = 0;
+    m_lastFrameEnd = 0;
+}
+
+void FrameScheduler::sortedWindow(std::vector<float>& times) const {
+    times = m_frameTimes;
+    std::sort(times.begin(), times.end());
+}
+
+void FrameScheduler::getStats(Stats& stats) const {
+    std::vector<float> sorted;
+    sortedWindow(sorted);
+
+    const double HITCH_MS = 2000.0 / m_targetFps;
+
+    double total = 0;
+    stats.hitchCount = 0;
+    for (auto ms : sorted) {
+        total += ms;
+        if (ms > HITCH_MS) {
+            stats.hitchCount++;
+        }
+    }
+
+    stats.frameCount = (unsigned int)sorted.size();
+    stats.meanMs = sorted.empty() ? 0 : total / sorted.size();
+    stats.p50Ms = percentile(sorted, 0.50);
+    stats.p95Ms = percentile(sorted, 0.95);
+    stats.p99Ms = percentile(sorted, 0.99);
+    stats.maxMs = sorted.empty() ? 0 : sorted.back();
+}
+
+void FrameScheduler::printStats() const {
+    Stats stats;
+    getStats(stats);
+    printf("frames: %u, mean %.2f ms, p50 %.2f, p95 %.2f, p99 %.2f, max %.2f, %u hitches%s\n",
+        stats.frameCount, stats.meanMs, stats.p50Ms, stats.p95Ms, stats.p99Ms,
+        stats.maxMs, stats.hitchCount, m_vsync ? " (vsync)" : "");
+}
+
+bool FrameScheduler::writeJson(const char* filename) const {
+    FILE* file = fopen(filename, "w");
+    if (!file) {
+        return false;
+    }
+
+    Stats stats;
+    getStats(stats);
+
+    // the last bucket collects everything at or over HISTOGRAM_BUCKETS - 1 ms
+    std::vector<unsigned int> histogram(HISTOGRAM_BUCKETS, 0);
+    for (auto ms : m_frameTimes) {
+        unsigned int bucket = std::min((unsigned int)ms, HISTOGRAM_BUCKETS - 1);
+        histogram[bucket]++;
+    }
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"target_fps\": %.1f,\n", m_targetFps);
+    fprintf(file, "  \"vsync\": %s,\n", m_vsync ? "true" : "false");
+    fprintf(file, "  \"continuous\": %s,\n", m_continuous ? "true" : "false");
+    fprintf(file, "  \"frames\": %u,\n", stats.frameCount);
+    fprintf(file, "  \"mean_ms\": %.3f,\n", stats.meanMs);
+    fprintf(file, "  \"p50_ms\": %.3f,\n", stats.p50Ms);
+    fprintf(file, "  \"p95_ms\": %.3f,\n", stats.p95Ms);
+    fprintf(file, "  \"p99_ms\": %.3f,\n", stats.p99Ms);
+    fprintf(file, "  \"max_ms\": %.3f,\n", stats.maxMs);
+    fprintf(file, "  \"hitches\": %u,\n", stats.hitchCount);
+
+    fprintf(file, "  \"histogram_1ms\": [");
+    for (unsigned int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        fprintf(file, "%s%u", (i > 0) ? ", " : "", histogram[i]);
+    }
+    fprintf(file, "],\n");
+
+    // oldest first
+    fprintf(file, "  \"frame_times_ms\": [");
+    unsigned int count = (unsigned int)m_frameTimes.size();
+    unsigned int first = (count < WINDOW_SIZE) ? 0 : m_nextFrame;
+    for (unsigned int i = 0; i < count; i++) {
+        fprintf(file, "%s%.3f", (i > 0) ? ", " : "", m_frameTimes[(first + i) % count]);
+    }
+    fprintf(file, "]\n");
+    fprintf(file, "}\n");
+
+    fclose(file);
+    return true;
+}
+
+long long FrameScheduler::now() {
+#ifdef _WIN32
+    LARGE_INTEGER counter;
+    ::QueryPerformanceCounter(&counter);
+    return counter.QuadPart;
+#else
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (long long)time.tv_sec * 1000000000 + time.tv_nsec;
+#endif
+}
+
+double FrameScheduler::ticksToMs(long long ticks) {
+    return (double)ticks * 1000.0 / (double)counterFrequency();
+}
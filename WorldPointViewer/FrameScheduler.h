@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vector>
+
+// Paces continuous drawing and keeps a rolling window of frame times.
+// Times come from the performance counter (CLOCK_MONOTONIC off Windows),
+// which is monotonic and far finer than the 10-16 ms of SetTimer.
+class FrameScheduler
+{
+public:
+    struct Stats {
+        unsigned int frameCount;
+        double meanMs;
+        double p50Ms;
+        double p95Ms;
+        double p99Ms;
+        double maxMs;
+        // frames in the window that took more than twice the target
+        unsigned int hitchCount;
+    };
+
+    FrameScheduler(double targetFps);
+    ~FrameScheduler();
+
+    // Turns vsync on or off. Returns false if the driver can't change it,
+    // as it can't off Windows, where there's no window to sync.
+    bool setVsync(bool vsync);
+    bool isVsync() const;
+
+    // While continuous, a frame's time is the interval since the previous
+    // frame ended; otherwise it's how long the frame itself took. Either
+    // change clears the window. The system timer runs at 1 ms only while
+    // continuous, for waitForNextFrame's sleeps.
+    void setContinuous(bool continuous);
+
+    // Waits until the next frame is due. With vsync on the swap does the
+    // waiting, so this returns immediately.
+    void waitForNextFrame();
+
+    void beginFrame();
+    // call after SwapBuffers
+    void endFrame();
+
+    void reset();
+
+    void getStats(Stats& stats) const;
+    void printStats() const;
+
+    // Writes the stats, a 1 ms histogram and the raw frame times as JSON.
+    bool writeJson(const char* filename) const;
+
+    // performance counter ticks, or nanoseconds off Windows
+    static long long now();
+    static double ticksToMs(long long ticks);
+
+protected:
+    static const unsigned int WINDOW_SIZE = 600;
+    static const unsigned int HISTOGRAM_BUCKETS = 100;
+
+    void sortedWindow(std::vector<float>& times) const;
+
+    double m_targetFps;
+    long long m_period;
+    long long m_nextDeadline;
+
+    bool m_vsync;
+    bool m_continuous;
+
+    long long m_frameStart;
+    long long m_lastFrameEnd;
+
+    // ring buffer of frame times in ms
+    std::vector<float> m_frameTimes;
+    unsigned int m_nextFrame;
+};
@@ -0,0 +1,57 @@
+#include "FrameUniforms.h"
+
+#include <cmath>
+#include <cstring>
+
+#include "Utils.h"
+
+FrameUniforms::FrameUniforms() :
+    m_ubo(0) {
+}
+
+FrameUniforms::~FrameUniforms() {
+}
+
+void FrameUniforms::setup() {
+    glGenBuffers(1, &m_ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, m_ubo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraBlock), nullptr, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, m_ubo);
+}
+
+void FrameUniforms::cleanup() {
+    if (m_ubo) {
+        glDeleteBuffers(1, &m_ubo);
+        m_ubo = 0;
+    }
+}
+
+void FrameUniforms::update(
+    const mat4df::Mat4Df& modelView,
+    const mat4df::Mat4Df& projection,
+    const vec3dd::Vec3Dd& eye,
+    float farDist) {
+
+    CameraBlock block;
+    memcpy(block.view, modelView.getBuf(), sizeof(block.view));
+    memcpy(block.projection, projection.getBuf(), sizeof(block.projection));
+    memcpy(block.viewProjection, (projection * modelView).getBuf(), sizeof(block.viewProjection));
+
+    for (int c = 0; c < 3; c++) {
+        splitDouble(eye(c), block.eyeHigh[c], block.eyeLow[c]);
+    }
+    block.eyeHigh[3] = 0;
+    block.eyeLow[3] = 0;
+
+    block.depthParams[0] = 2.0f / (float)(log(farDist + 1.0) / log(2.0));
+    block.depthParams[1] = 0;
+    block.depthParams[2] = 0;
+    block.depthParams[3] = 0;
+
+    glBindBuffer(GL_UNIFORM_BUFFER, m_ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(block), &block);
+}
+
+unsigned int FrameUniforms::getUploadSize() const {
+    return sizeof(CameraBlock);
+}
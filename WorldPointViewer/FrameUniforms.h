@@ -0,0 +1,46 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include "Matrix4Df.h"
+#include "Vec3Dd.h"
+
+// The per-frame camera state shared by every program through the
+// CameraBlock uniform block. It's uploaded once per frame instead of once
+// per drawable.
+class FrameUniforms
+{
+public:
+    // binding point of CameraBlock
+    static const GLuint CAMERA_BLOCK_BINDING = 0;
+
+    FrameUniforms();
+    ~FrameUniforms();
+
+    void setup();
+    void cleanup();
+
+    // modelView is the relative-to-eye view, without the eye translation.
+    // farDist scales the logarithmic depth.
+    void update(
+        const mat4df::Mat4Df& modelView,
+        const mat4df::Mat4Df& projection,
+        const vec3dd::Vec3Dd& eye,
+        float farDist);
+
+    // bytes uploaded by the last update
+    unsigned int getUploadSize() const;
+
+protected:
+    // std140 layout of CameraBlock
+    struct CameraBlock {
+        GLfloat view[16];
+        GLfloat projection[16];
+        GLfloat viewProjection[16];
+        GLfloat eyeHigh[4];
+        GLfloat eyeLow[4];
+        GLfloat depthParams[4];
+    };
+
+    GLuint m_ubo;
+};
@@ -0,0 +1,165 @@
+#include "Frustum.h"
+
+#include <cmath>
+
+#include <xmmintrin.h>
+
+Frustum::Frustum() {
+    for (int i = 0; i < PLANE_COUNT; i++) {
+        m_planes[i][0] = 0;
+        m_planes[i][1] = 0;
+        m_planes[i][2] = 0;
+        m_planes[i][3] = 1;
+    }
+}
+
+Frustum::~Frustum() {
+}
+
+void Frustum::setFromMatrix(const mat4df::Mat4Df& viewProj) {
+    // Gribb/Hartmann: each plane is the w row plus or minus one of the
+    // x, y or z rows of the clip transform.
+    auto row = [&](int r, int c) {
+        return viewProj(c, r);
+    };
+
+    for (int i = 0; i < PLANE_COUNT; i++) {
+        int axisRow = i / 2;
+        float sign = (i % 2 == 0) ? 1.0f : -1.0f;
+        for (int c = 0; c < 4; c++) {
+            m_planes[i][c] = row(3, c) + sign * row(axisRow, c);
+        }
+
+        float len = sqrtf(
+            m_planes[i][0] * m_planes[i][0] +
+            m_planes[i][1] * m_planes[i][1] +
+            m_planes[i][2] * m_planes[i][2]);
+        if (len > 0) {
+            for (int c = 0; c < 4; c++) {
+                m_planes[i][c] /= len;
+            }
+        }
+    }
+}
+
+bool Frustum::intersectsSphere(const vec3df::Vec3Df& center, float radius) const {
+    for (int i = 0; i < PLANE_COUNT; i++) {
+        float dist =
+            m_planes[i][0] * center(0) +
+            m_planes[i][1] * center(1) +
+            m_planes[i][2] * center(2) +
+            m_planes[i][3];
+        if (dist < -radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Frustum::containsSphere(const vec3df::Vec3Df& center, float radius) const {
+    for (int i = 0; i < PLANE_COUNT; i++) {
+        float dist =
+            m_planes[i][0] * center(0) +
+            m_planes[i][1] * center(1) +
+            m_planes[i][2] * center(2) +
+            m_planes[i][3];
+        if (dist < radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Frustum::cullSpheres(
+    const float* xs, const float* ys, const float* zs, const float* radii,
+    unsigned int count, std::vector<unsigned int>& visible) const {
+
+    __m128 planes[PLANE_COUNT][4];
+    for (int i = 0; i < PLANE_COUNT; i++) {
+        for (int c = 0; c < 4; c++) {
+            planes[i][c] = _mm_set1_ps(m_planes[i][c]);
+        }
+    }
+
+    unsigned int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 x = _mm_loadu_ps(xs + i);
+        __m128 y = _mm_loadu_ps(ys + i);
+        __m128 z = _mm_loadu_ps(zs + i);
+        __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radii + i));
+
+        __m128 outside = _mm_setzero_ps();
+        for (int p = 0; p < PLANE_COUNT; p++) {
+            __m128 dist = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(planes[p][0], x), _mm_mul_ps(planes[p][1], y)),
+                _mm_add_ps(_mm_mul_ps(planes[p][2], z), planes[p][3]));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, negRadius));
+        }
+
+        int outsideMask = _mm_movemask_ps(outside);
+        if (outsideMask == 0xf) {
+            continue;
+        }
+        for (unsigned int lane = 0; lane < 4; lane++) {
+            if (!(outsideMask & (1 << lane))) {
+                visible.push_back(i + lane);
+            }
+        }
+    }
+
+    for (; i < count; i++) {
+        if (intersectsSphere(vec3df::create(xs[i], ys[i], zs[i]), radii[i])) {
+            visible.push_back(i);
+        }
+    }
+}
+
+void Frustum::cullSpheresMulti(
+    const Frustum* frusta, unsigned int frustumCount,
+    const float* xs, const float* ys, const float* zs, const float* radii,
+    unsigned int count, std::vector<unsigned int>* visible) {
+
+    unsigned int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        // each batch of spheres is loaded once for all of the frusta
+        __m128 x = _mm_loadu_ps(xs + i);
+        __m128 y = _mm_loadu_ps(ys + i);
+        __m128 z = _mm_loadu_ps(zs + i);
+        __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radii + i));
+
+        for (unsigned int f = 0; f < frustumCount; f++) {
+            const float (*planes)[4] = frusta[f].m_planes;
+
+            __m128 outside = _mm_setzero_ps();
+            for (int p = 0; p < PLANE_COUNT; p++) {
+                __m128 dist = _mm_add_ps(
+                    _mm_add_ps(
+                        _mm_mul_ps(_mm_set1_ps(planes[p][0]), x),
+                        _mm_mul_ps(_mm_set1_ps(planes[p][1]), y)),
+                    _mm_add_ps(
+                        _mm_mul_ps(_mm_set1_ps(planes[p][2]), z),
+                        _mm_set1_ps(planes[p][3])));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, negRadius));
+            }
+
+            int outsideMask = _mm_movemask_ps(outside);
+            if (outsideMask == 0xf) {
+                continue;
+            }
+            for (unsigned int lane = 0; lane < 4; lane++) {
+                if (!(outsideMask & (1 << lane))) {
+                    visible[f].push_back(i + lane);
+                }
+            }
+        }
+    }
+
+    for (; i < count; i++) {
+        auto center = vec3df::create(xs[i], ys[i], zs[i]);
+        for (unsigned int f = 0; f < frustumCount; f++) {
+            if (frusta[f].intersectsSphere(center, radii[i])) {
+                visible[f].push_back(i);
+            }
+        }
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+
+#include "Matrix4Df.h"
+#include "Vec3Df.h"
+
+class Frustum
+{
+public:
+    Frustum();
+    ~Frustum();
+
+    // Extracts the six clip planes from a combined projection * modelView
+    // matrix. Plane normals point into the frustum and are normalized, so
+    // the plane equation gives the signed distance in world units.
+    void setFromMatrix(const mat4df::Mat4Df& viewProj);
+
+    bool intersectsSphere(const vec3df::Vec3Df& center, float radius) const;
+    bool containsSphere(const vec3df::Vec3Df& center, float radius) const;
+
+    // Tests a structure-of-arrays batch of bounding spheres, four at a time,
+    // and appends the index of every sphere that isn't fully outside one of
+    // the planes to "visible".
+    void cullSpheres(
+        const float* xs, const float* ys, const float* zs, const float* radii,
+        unsigned int count, std::vector<unsigned int>& visible) const;
+
+    // cullSpheres() against several frusta in one pass over the spheres;
+    // visible[i] gets the spheres that may be in frusta[i].
+    static void cullSpheresMulti(
+        const Frustum* frusta, unsigned int frustumCount,
+        const float* xs, const float* ys, const float* zs, const float* radii,
+        unsigned int count, std::vector<unsigned int>* visible);
+
+protected:
+    static const int PLANE_COUNT = 6;
+
+    // a, b, c, d for each plane
+    float m_planes[PLANE_COUNT][4];
+};
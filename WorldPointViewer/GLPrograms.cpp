@@ -1,19 +1,100 @@
+#include <cstdio>
 #include <cstdlib>
 #include <string>
 
 #include <GL/glew.h>
 
 #include "GLPrograms.h"
+#include "FileUtils.h"
+#include "FrameScheduler.h"
+#include "FrameUniforms.h"
+#include "LineBatch.h"
+
+namespace {
+    // Shared by the vertex shaders that draw relative to eye.
+    //
+    // Positions are relative to eye: the view matrices hold only the view
+    // rotation, and the eye is subtracted from each vertex here. Both are
+    // split into high and low floats, and the subtraction is done in
+    // double-float arithmetic (DSFUN90's dsadd), so the result keeps double
+    // precision even 6.4e6 m from the origin. A drawable that has no low
+    // part leaves attribute 1 disabled and gets zero.
+    //
+    // Depth is logarithmic in the distance from the eye (see logDepth), so
+    // a 24 bit depth buffer resolves both a meter away and the far side of
+    // the earth. GL 4.1 has no glClipControl, which reversed-Z would need to
+    // get its precision.
+    const GLchar* const RELATIVE_TO_EYE_SOURCE =
+        "layout (location = 0) in vec3 pos_high;                        \n"
+        "layout (location = 1) in vec3 pos_low;                         \n"
+        "                                                               \n"
+        "layout (std140) uniform CameraBlock {                          \n"
+        "    mat4 mv_matrix;                                            \n"
+        "    mat4 proj_matrix;                                          \n"
+        "    mat4 mvp_matrix;                                           \n"
+        "    vec4 eye_high;                                             \n"
+        "    vec4 eye_low;                                              \n"
+        "    vec4 depth_params;                                         \n"
+        "};                                                             \n"
+        "                                                               \n"
+        "vec3 relativeToEye() {                                         \n"
+        "    precise vec3 t1 = pos_low - eye_low.xyz;                   \n"
+        "    precise vec3 e = t1 - pos_low;                             \n"
+        "    precise vec3 t2 =                                          \n"
+        "        ((-eye_low.xyz - e) + (pos_low - (t1 - e))) +          \n"
+        "        pos_high - eye_high.xyz;                               \n"
+        "    precise vec3 high_diff = t1 + t2;                          \n"
+        "    precise vec3 low_diff = t2 - (high_diff - t1);             \n"
+        "    return high_diff + low_diff;                               \n"
+        "}                                                              \n"
+        "                                                               \n"
+        "// depth_params.x is 2 / log2(far + 1)                         \n"
+        "vec4 logDepth(vec4 clip) {                                     \n"
+        "    clip.z = (log2(max(1e-6, 1.0 + clip.w)) *                  \n"
+        "        depth_params.x - 1.0) * clip.w;                        \n"
+        "    return clip;                                               \n"
+        "}                                                              \n";
+}
 
 GLPrograms::GLPrograms() :
-    m_simpleProg(0) {
+    m_simpleProg(0),
+    m_pointProg(0),
+    m_heatAccumulateProg(0),
+    m_heatRampProg(0),
+    m_occluderProg(0),
+    m_scalarRampProg(0),
+    m_paletteProg(0),
+    m_markerProg(0),
+    m_cacheSupported(false) {
 }
 
+const char* const GLPrograms::PROGRAM_CACHE_DIR = "program_cache";
+
 GLPrograms::~GLPrograms() {
 }
 
 void GLPrograms::compilePrograms() {
+    GLint binaryFormatCount = 0;
+    if (GLEW_ARB_get_program_binary) {
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormatCount);
+    }
+    m_cacheSupported = binaryFormatCount > 0;
+    if (m_cacheSupported) {
+        makeDirectory(PROGRAM_CACHE_DIR);
+    }
+
+    m_timings.clear();
+
     compileSimpleProgram();
+    compilePointProgram();
+    compileHeatAccumulateProgram();
+    compileHeatRampProgram();
+    compileOccluderProgram();
+    compileScalarRampProgram();
+    compilePaletteProgram();
+    compileMarkerProgram();
+
+    printTimings();
 }
 
 void GLPrograms::cleanupPrograms() {
@@ -25,12 +106,71 @@ void GLPrograms::cleanupPrograms() {
     };
 
     cleanupProgram(m_simpleProg);
+    cleanupProgram(m_pointProg);
+    cleanupProgram(m_heatAccumulateProg);
+    cleanupProgram(m_heatRampProg);
+    cleanupProgram(m_occluderProg);
+    cleanupProgram(m_scalarRampProg);
+    cleanupProgram(m_paletteProg);
+    cleanupProgram(m_markerProg);
 }
 
 GLuint GLPrograms::getSimpleProg() const {
     return m_simpleProg;
 }
 
+GLuint GLPrograms::getPointProg() const {
+    return m_pointProg;
+}
+
+GLuint GLPrograms::getHeatAccumulateProg() const {
+    return m_heatAccumulateProg;
+}
+
+GLuint GLPrograms::getHeatRampProg() const {
+    return m_heatRampProg;
+}
+
+GLuint GLPrograms::getOccluderProg() const {
+    return m_occluderProg;
+}
+
+GLuint GLPrograms::getScalarRampProg() const {
+    return m_scalarRampProg;
+}
+
+GLuint GLPrograms::getPaletteProg() const {
+    return m_paletteProg;
+}
+
+GLuint GLPrograms::getMarkerProg() const {
+    return m_markerProg;
+}
+
+const std::vector<GLPrograms::ProgramTiming>& GLPrograms::getTimings() const {
+    return m_timings;
+}
+
+void GLPrograms::printTimings() const {
+    double compiledMs = 0, cachedMs = 0;
+    unsigned int compiledCount = 0, cachedCount = 0;
+    for (auto& timing : m_timings) {
+        printf("program %s: %.2f ms (%s)\n",
+            timing.name, timing.ms, timing.fromCache ? "cached" : "compiled");
+        if (timing.fromCache) {
+            cachedMs += timing.ms;
+            cachedCount++;
+        }
+        else {
+            compiledMs += timing.ms;
+            compiledCount++;
+        }
+    }
+    printf("programs: %u compiled in %.2f ms, %u loaded from cache in %.2f ms%s\n",
+        compiledCount, compiledMs, cachedCount, cachedMs,
+        m_cacheSupported ? "" : " (no program binary support)");
+}
+
 GLint GLPrograms::compileShader(GLuint shaderType, const GLchar* shaderSource) {
     const GLchar* SHADER_SOURCE[] = { shaderSource };
 
@@ -56,53 +196,185 @@ GLint GLPrograms::compileShader(GLuint shaderType, const GLchar* shaderSource) {
 }
 
 GLuint GLPrograms::compileProgram(
+    const char* name,
     const GLchar* vertexShaderSource,
     const GLchar* fragmentShaderSource) {
 
-    const GLchar* VERTEX_SHADER_SOURCE[] = { vertexShaderSource };
-    const GLchar* FRAGMENT_SHADER_SOURCE[] = { fragmentShaderSource };
+    long long start = FrameScheduler::now();
 
-    // vertex shader
-    GLuint vertexShader = compileShader(GL_VERTEX_SHADER, vertexShaderSource);
-    GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentShaderSource);
-    
-    // Create program, attach shaders to it, and link it
-    GLuint prog = glCreateProgram();
-    glAttachShader(prog, vertexShader);
-    glAttachShader(prog, fragmentShader);
-    glLinkProgram(prog);
+    std::string cacheFile;
+    GLuint prog = 0;
+    if (m_cacheSupported) {
+        cacheFile = cacheFileFor(vertexShaderSource, fragmentShaderSource);
+        prog = loadCachedProgram(cacheFile);
+    }
+    const bool FROM_CACHE = prog != 0;
+
+    if (!FROM_CACHE) {
+        // vertex shader
+        GLuint vertexShader = compileShader(GL_VERTEX_SHADER, vertexShaderSource);
+        GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentShaderSource);
+
+        // Create program, attach shaders to it, and link it
+        prog = glCreateProgram();
+        glAttachShader(prog, vertexShader);
+        glAttachShader(prog, fragmentShader);
+        if (m_cacheSupported) {
+            glProgramParameteri(prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+        glLinkProgram(prog);
+
+        // Delete the shaders as the program has them now
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+
+        if (checkLinkStatus(prog, name) && m_cacheSupported) {
+            saveCachedProgram(prog, cacheFile);
+        }
+    }
+
+    // not part of the saved binary, so set either way
+    bindUniformBlocks(prog);
+
+    ProgramTiming timing;
+    timing.name = name;
+    timing.fromCache = FROM_CACHE;
+    timing.ms = FrameScheduler::ticksToMs(FrameScheduler::now() - start);
+    m_timings.push_back(timing);
+
+    return prog;
+}
+
+bool GLPrograms::checkLinkStatus(GLuint prog, const char* name) const {
+    GLint linkStatus;
+    glGetProgramiv(prog, GL_LINK_STATUS, &linkStatus);
+    if (!linkStatus) {
+        printf("program %s failed to link\n", name);
+
+        GLint logLength;
+        glGetProgramiv(prog, GL_INFO_LOG_LENGTH, &logLength);
+        GLchar* infoLog = new GLchar[logLength + 1];
+        glGetProgramInfoLog(prog, logLength, nullptr, infoLog);
+        infoLog[logLength] = 0;
+        printf("log info:\n%s", infoLog);
+        delete[] infoLog;
+    }
+    return linkStatus != 0;
+}
+
+void GLPrograms::bindUniformBlocks(GLuint prog) const {
+    GLuint cameraBlock = glGetUniformBlockIndex(prog, "CameraBlock");
+    if (cameraBlock != GL_INVALID_INDEX) {
+        glUniformBlockBinding(prog, cameraBlock, FrameUniforms::CAMERA_BLOCK_BINDING);
+    }
+    GLuint paletteBlock = glGetUniformBlockIndex(prog, "PaletteBlock");
+    if (paletteBlock != GL_INVALID_INDEX) {
+        glUniformBlockBinding(prog, paletteBlock, LineBatch::PALETTE_BLOCK_BINDING);
+    }
+}
+
+std::string GLPrograms::cacheFileFor(
+    const GLchar* vertexShaderSource,
+    const GLchar* fragmentShaderSource) const {
+
+    // 64-bit FNV-1a over the sources and the driver strings, each with its
+    // terminating zero so the boundaries count
+    unsigned long long hash = 14695981039346656037ull;
+    auto hashString = [&](const char* str) {
+        if (!str) {
+            str = "";
+        }
+        do {
+            hash ^= (unsigned char)*str;
+            hash *= 1099511628211ull;
+        } while (*str++);
+    };
+    hashString(vertexShaderSource);
+    hashString(fragmentShaderSource);
+    hashString((const char*)glGetString(GL_VENDOR));
+    hashString((const char*)glGetString(GL_RENDERER));
+    hashString((const char*)glGetString(GL_VERSION));
+
+    char filename[64];
+    sprintf(filename, "%s/%016llx.bin", PROGRAM_CACHE_DIR, hash);
+    return filename;
+}
+
+GLuint GLPrograms::loadCachedProgram(const std::string& filename) const {
+    FILE* file = fopen(filename.c_str(), "rb");
+    if (!file) {
+        return 0;
+    }
+
+    GLenum binaryFormat = 0;
+    std::vector<char> binary;
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size > (long)sizeof(binaryFormat) &&
+        fread(&binaryFormat, sizeof(binaryFormat), 1, file) == 1) {
+        binary.resize(size - sizeof(binaryFormat));
+        if (fread(binary.data(), 1, binary.size(), file) != binary.size()) {
+            binary.clear();
+        }
+    }
+    fclose(file);
 
-    // Delete the shaders as the program has them now
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
+    if (binary.empty()) {
+        return 0;
+    }
 
+    GLuint prog = glCreateProgram();
+    glProgramBinary(prog, binaryFormat, binary.data(), (GLsizei)binary.size());
+
+    // The driver can refuse a binary, e.g. after an update that kept the
+    // version string; compile it again then.
+    GLint linkStatus;
+    glGetProgramiv(prog, GL_LINK_STATUS, &linkStatus);
+    if (!linkStatus) {
+        glDeleteProgram(prog);
+        return 0;
+    }
     return prog;
 }
 
+void GLPrograms::saveCachedProgram(GLuint prog, const std::string& filename) const {
+    GLint length = 0;
+    glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+
+    std::vector<char> binary(length);
+    GLenum binaryFormat = 0;
+    glGetProgramBinary(prog, length, nullptr, &binaryFormat, binary.data());
+
+    FILE* file = fopen(filename.c_str(), "wb");
+    if (!file) {
+        return;
+    }
+    fwrite(&binaryFormat, sizeof(binaryFormat), 1, file);
+    fwrite(binary.data(), 1, binary.size(), file);
+    fclose(file);
+}
+
 void GLPrograms::compileSimpleProgram() {
-    const GLchar* VERTEX_SHADER_SOURCE =
+    const std::string VERTEX_SHADER_SOURCE = std::string(
         "#version 410 core                                              \n"
         "#extension GL_ARB_explicit_uniform_location : require          \n"
+        "                                                               \n") +
+        RELATIVE_TO_EYE_SOURCE +
         "                                                               \n"
-        "layout (location = 0) in vec4 vertex_pos;                      \n"
-        "                                                               \n"
-        "layout (location = 0) uniform mat4 mv_matrix;                  \n"
-        "layout (location = 1) uniform mat4 proj_matrix;                \n"
-        "layout (location = 2) uniform vec4 color;                      \n"
-        "layout (location = 3) uniform int dist_fade;                   \n"
+        "layout (location = 3) in vec4 vertex_color;                    \n"
+        "layout (location = 0) uniform vec4 color;                      \n"
         "                                                               \n"
         "out vec4 vs_color;                                             \n"
         "                                                               \n"
         "void main(void) {                                              \n"
-        "    gl_Position =                                              \n"
-        "        proj_matrix *                                          \n"
-        "        mv_matrix *                                            \n"
-        "        vertex_pos;                                            \n"
-        "    vs_color = color;                                          \n"
-        "    if (dist_fade != 0) {                                      \n"
-        "        vs_color.w *= clamp(                                   \n"
-        "            (6378137 * 0.5) / length(gl_Position), 0.0, 1.0);  \n"
-        "    }                                                          \n"
+        "    gl_Position = logDepth(                                    \n"
+        "        mvp_matrix * vec4(relativeToEye(), 1.0));              \n"
+        "    vs_color = color * vertex_color;                           \n"
         "}                                                              \n";
 
     const GLchar* FRAGMENT_SHADER_SOURCE =
@@ -114,7 +386,320 @@ void GLPrograms::compileSimpleProgram() {
         "    color = vs_color;  \n"
         "}                      \n";
 
-    m_simpleProg = compileProgram(
+    m_simpleProg = compileProgram("simple",
+        VERTEX_SHADER_SOURCE.c_str(),
+        FRAGMENT_SHADER_SOURCE);
+}
+
+void GLPrograms::compilePointProgram() {
+    // point_size is the diameter in pixels at one earth radius from the
+    // eye; points grow as the eye gets closer, up to MAX_POINT_SIZE. With
+    // round_points set the fragment shader trims the square sprite to a
+    // disc.
+    const std::string VERTEX_SHADER_SOURCE = std::string(
+        "#version 410 core                                              \n"
+        "#extension GL_ARB_explicit_uniform_location : require          \n"
+        "                                                               \n") +
+        RELATIVE_TO_EYE_SOURCE +
+        "                                                               \n"
+        "layout (location = 0) uniform vec4 color;                      \n"
+        "layout (location = 2) uniform float point_size;                \n"
+        "                                                               \n"
+        "const float MAX_POINT_SIZE = 32.0;                             \n"
+        "                                                               \n"
+        "out vec4 vs_color;                                             \n"
+        "                                                               \n"
+        "void main(void) {                                              \n"
+        "    vec3 pos = relativeToEye();                                \n"
+        "    gl_Position = logDepth(mvp_matrix * vec4(pos, 1.0));       \n"
+        "    float dist = max(length(pos), 1.0);                        \n"
+        "    gl_PointSize = clamp(                                      \n"
+        "        point_size * 6378137 / dist, 1.0, MAX_POINT_SIZE);     \n"
+        "    vs_color = color;                                          \n"
+        "}                                                              \n";
+
+    const GLchar* FRAGMENT_SHADER_SOURCE =
+        "#version 410 core                                              \n"
+        "#extension GL_ARB_explicit_uniform_location : require          \n"
+        "                                                               \n"
+        "layout (location = 3) uniform float round_points;              \n"
+        "                                                               \n"
+        "in vec4 vs_color;                                              \n"
+        "out vec4 color;                                                \n"
+        "void main(void) {                                              \n"
+        "    if (round_points != 0.0 &&                                 \n"
+        "        length(gl_PointCoord - vec2(0.5)) > 0.5) {             \n"
+        "        discard;                                               \n"
+        "    }                                                          \n"
+        "    color = vs_color;                                          \n"
+        "}                                                              \n";
+
+    m_pointProg = compileProgram("point",
+        VERTEX_SHADER_SOURCE.c_str(),
+        FRAGMENT_SHADER_SOURCE);
+}
+
+void GLPrograms::compileHeatAccumulateProgram() {
+    // Each point is a longitude and latitude in radians, drawn as a one
+    // texel point into an equirectangular float target. Additive blending
+    // turns the target into a per-texel point count.
+    const GLchar* VERTEX_SHADER_SOURCE =
+        "#version 410 core                                              \n"
+        "                                                               \n"
+        "layout (location = 0) in vec2 lon_lat;                         \n"
+        "                                                               \n"
+        "void main(void) {                                              \n"
+        "    gl_Position = vec4(                                        \n"
+        "        lon_lat.x / 3.14159265, lon_lat.y / 1.57079633,        \n"
+        "        0.0, 1.0);                                             \n"
+        "    gl_PointSize = 1.0;                                        \n"
+        "}                                                              \n";
+
+    const GLchar* FRAGMENT_SHADER_SOURCE =
+        "#version 410 core      \n"
+        "                       \n"
+        "out float count;       \n"
+        "void main(void) {      \n"
+        "    count = 1.0;       \n"
+        "}                      \n";
+
+    m_heatAccumulateProg = compileProgram("heat accumulate",
         VERTEX_SHADER_SOURCE,
         FRAGMENT_SHADER_SOURCE);
 }
+
+void GLPrograms::compileHeatRampProgram() {
+    // Draws a sphere textured with the point counts. The count is mapped
+    // through a log scale that reaches the top of the ramp at saturation,
+    // and empty texels and the far side of the sphere are discarded.
+    const std::string VERTEX_SHADER_SOURCE = std::string(
+        "#version 410 core                                              \n"
+        "#extension GL_ARB_explicit_uniform_location : require          \n"
+        "                                                               \n") +
+        RELATIVE_TO_EYE_SOURCE +
+        "                                                               \n"
+        "layout (location = 2) in vec2 tex_coord;                       \n"
+        "                                                               \n"
+        "layout (location = 0) uniform vec4 color;                      \n"
+        "                                                               \n"
+        "out vec4 vs_color;                                             \n"
+        "out vec2 vs_tex_coord;                                         \n"
+        "out float vs_facing;                                           \n"
+        "                                                               \n"
+        "void main(void) {                                              \n"
+        "    vec3 pos = relativeToEye();                                \n"
+        "    gl_Position = logDepth(mvp_matrix * vec4(pos, 1.0));       \n"
+        "    vec3 normal = normalize(pos_high + pos_low);               \n"
+        "    vs_facing = dot(normal, -pos);                             \n"
+        "    vs_tex_coord = tex_coord;                                  \n"
+        "    vs_color = color;                                          \n"
+        "}                                                              \n";
+
+    const GLchar* FRAGMENT_SHADER_SOURCE =
+        "#version 410 core                                              \n"
+        "#extension GL_ARB_explicit_uniform_location : require          \n"
+        "                                                               \n"
+        "layout (location = 2) uniform float saturation;                \n"
+        "uniform sampler2D counts;                                      \n"
+        "                                                               \n"
+        "in vec4 vs_color;                                              \n"
+        "in vec2 vs_tex_coord;                                          \n"
+        "in float vs_facing;                                            \n"
+        "out vec4 color;                                                \n"
+        "                                                               \n"
+        "// blue, cyan, green, yellow, red                              \n"
+        "vec3 ramp(float t) {                                           \n"
+        "    vec3 c = mix(vec3(0, 0, 1), vec3(0, 1, 1),                 \n"
+        "        clamp(t * 4.0, 0.0, 1.0));                             \n"
+        "    c = mix(c, vec3(0, 1, 0), clamp(t * 4.0 - 1.0, 0.0, 1.0)); \n"
+        "    c = mix(c, vec3(1, 1, 0), clamp(t * 4.0 - 2.0, 0.0, 1.0)); \n"
+        "    c = mix(c, vec3(1, 0, 0), clamp(t * 4.0 - 3.0, 0.0, 1.0)); \n"
+        "    return c;                                                  \n"
+        "}                                                              \n"
+        "                                                               \n"
+        "void main(void) {                                              \n"
+        "    float count = texture(counts, vs_tex_coord).r;             \n"
+        "    if (vs_facing < 0.0 || count <= 0.0) {                     \n"
+        "        discard;                                               \n"
+        "    }                                                          \n"
+        "    float t = clamp(                                           \n"
+        "        log(1.0 + count) / log(1.0 + saturation), 0.0, 1.0);   \n"
+        "    color = vec4(ramp(t), mix(0.4, 0.9, t) * vs_color.w);      \n"
+        "}                                                              \n";
+
+    m_heatRampProg = compileProgram("heat ramp",
+        VERTEX_SHADER_SOURCE.c_str(),
+        FRAGMENT_SHADER_SOURCE);
+}
+
+void GLPrograms::compileOccluderProgram() {
+    // Depth only. The occluder's triangles are large, and the log depth the
+    // vertex shader writes is only exact at the vertices, so the fragment
+    // shader writes the exact depth instead. That costs early-Z for the
+    // occluder alone, which is drawn first.
+    const std::string VERTEX_SHADER_SOURCE = std::string(
+        "#version 410 core                                              \n"
+        "                                                               \n") +
+        RELATIVE_TO_EYE_SOURCE +
+        "                                                               \n"
+        "out float vs_log_z;                                            \n"
+        "flat out float vs_depth_scale;                                 \n"
+        "                                                               \n"
+        "void main(void) {                                              \n"
+        "    gl_Position = logDepth(                                    \n"
+        "        mvp_matrix * vec4(relativeToEye(), 1.0));              \n"
+        "    vs_log_z = 1.0 + gl_Position.w;                            \n"
+        "    vs_depth_scale = depth_params.x * 0.5;                     \n"
+        "}                                                              \n";
+
+    const GLchar* FRAGMENT_SHADER_SOURCE =
+        "#version 410 core                                              \n"
+        "                                                               \n"
+        "in float vs_log_z;                                             \n"
+        "flat in float vs_depth_scale;                                  \n"
+        "void main(void) {                                              \n"
+        "    gl_FragDepth = log2(max(1e-6, vs_log_z)) * vs_depth_scale; \n"
+        "}                                                              \n";
+
+    m_occluderProg = compileProgram("occluder",
+        VERTEX_SHADER_SOURCE.c_str(),
+        FRAGMENT_SHADER_SOURCE);
+}
+
+void GLPrograms::compileScalarRampProgram() {
+    // Colors each vertex by its scalar, mapped from [range_min, range_max]
+    // onto a 1D ramp texture, so changing the range is only a uniform.
+    // Negative scalars mean no value and get the plain color.
+    const std::string VERTEX_SHADER_SOURCE = std::string(
+        "#version 410 core                                              \n"
+        "#extension GL_ARB_explicit_uniform_location : require          \n"
+        "                                                               \n") +
+        RELATIVE_TO_EYE_SOURCE +
+        "                                                               \n"
+        "layout (location = 2) in float scalar;                         \n"
+        "                                                               \n"
+        "layout (location = 2) uniform float range_min;                 \n"
+        "layout (location = 3) uniform float range_max;                 \n"
+        "                                                               \n"
+        "out float vs_scalar;                                           \n"
+        "out float vs_ramp_pos;                                         \n"
+        "                                                               \n"
+        "void main(void) {                                              \n"
+        "    gl_Position = logDepth(                                    \n"
+        "        mvp_matrix * vec4(relativeToEye(), 1.0));              \n"
+        "    vs_scalar = scalar;                                        \n"
+        "    vs_ramp_pos = (scalar - range_min) /                       \n"
+        "        max(range_max - range_min, 1e-6);                      \n"
+        "}                                                              \n";
+
+    const GLchar* FRAGMENT_SHADER_SOURCE =
+        "#version 410 core                                              \n"
+        "#extension GL_ARB_explicit_uniform_location : require          \n"
+        "                                                               \n"
+        "layout (location = 0) uniform vec4 color;                      \n"
+        "uniform sampler1D ramp;                                        \n"
+        "                                                               \n"
+        "in float vs_scalar;                                            \n"
+        "in float vs_ramp_pos;                                          \n"
+        "out vec4 frag_color;                                           \n"
+        "void main(void) {                                              \n"
+        "    if (vs_scalar < 0.0) {                                     \n"
+        "        frag_color = color;                                    \n"
+        "    }                                                          \n"
+        "    else {                                                     \n"
+        "        frag_color = vec4(texture(ramp,                        \n"
+        "            clamp(vs_ramp_pos, 0.0, 1.0)).rgb, color.a);       \n"
+        "    }                                                          \n"
+        "}                                                              \n";
+
+    m_scalarRampProg = compileProgram("scalar ramp",
+        VERTEX_SHADER_SOURCE.c_str(),
+        FRAGMENT_SHADER_SOURCE);
+}
+
+void GLPrograms::compilePaletteProgram() {
+    // Colors each vertex by its palette id. PaletteBlock holds 256 packed
+    // RGBA8 colors, four to a uvec4 since std140 pads array elements to 16
+    // bytes. The color uniform tints the result.
+    const std::string VERTEX_SHADER_SOURCE = std::string(
+        "#version 410 core                                              \n"
+        "#extension GL_ARB_explicit_uniform_location : require          \n"
+        "                                                               \n") +
+        RELATIVE_TO_EYE_SOURCE +
+        "                                                               \n"
+        "layout (location = 2) in uint palette_id;                      \n"
+        "                                                               \n"
+        "layout (std140) uniform PaletteBlock {                         \n"
+        "    uvec4 palette[64];                                         \n"
+        "};                                                             \n"
+        "                                                               \n"
+        "out vec4 vs_color;                                             \n"
+        "                                                               \n"
+        "void main(void) {                                              \n"
+        "    gl_Position = logDepth(                                    \n"
+        "        mvp_matrix * vec4(relativeToEye(), 1.0));              \n"
+        "    vs_color = unpackUnorm4x8(                                 \n"
+        "        palette[palette_id >> 2][palette_id & 3u]);            \n"
+        "}                                                              \n";
+
+    const GLchar* FRAGMENT_SHADER_SOURCE =
+        "#version 410 core                                              \n"
+        "#extension GL_ARB_explicit_uniform_location : require          \n"
+        "                                                               \n"
+        "layout (location = 0) uniform vec4 color;                      \n"
+        "                                                               \n"
+        "in vec4 vs_color;                                              \n"
+        "out vec4 frag_color;                                           \n"
+        "void main(void) {                                              \n"
+        "    frag_color = vs_color * color;                             \n"
+        "}                                                              \n";
+
+    m_paletteProg = compileProgram("palette",
+        VERTEX_SHADER_SOURCE.c_str(),
+        FRAGMENT_SHADER_SOURCE);
+}
+
+void GLPrograms::compileMarkerProgram() {
+    // Draws one glyph per instance. The position attributes are per
+    // instance; the glyph's corner is scaled to pixels and added in clip
+    // space, so the marker's size doesn't change with distance.
+    const std::string VERTEX_SHADER_SOURCE = std::string(
+        "#version 410 core                                              \n"
+        "#extension GL_ARB_explicit_uniform_location : require          \n"
+        "                                                               \n") +
+        RELATIVE_TO_EYE_SOURCE +
+        "                                                               \n"
+        "layout (location = 2) in vec2 glyph;                           \n"
+        "layout (location = 3) in vec4 marker_color;                    \n"
+        "layout (location = 4) in float marker_scale;                   \n"
+        "                                                               \n"
+        "layout (location = 2) uniform float viewport_width;            \n"
+        "layout (location = 3) uniform float viewport_height;           \n"
+        "                                                               \n"
+        "out vec4 vs_color;                                             \n"
+        "                                                               \n"
+        "void main(void) {                                              \n"
+        "    vec4 clip = logDepth(                                      \n"
+        "        mvp_matrix * vec4(relativeToEye(), 1.0));              \n"
+        "    clip.xy += glyph * marker_scale * 2.0 /                    \n"
+        "        vec2(viewport_width, viewport_height) * clip.w;        \n"
+        "    gl_Position = clip;                                        \n"
+        "    vs_color = marker_color;                                   \n"
+        "}                                                              \n";
+
+    const GLchar* FRAGMENT_SHADER_SOURCE =
+        "#version 410 core                                              \n"
+        "#extension GL_ARB_explicit_uniform_location : require          \n"
+        "                                                               \n"
+        "layout (location = 0) uniform vec4 color;                      \n"
+        "                                                               \n"
+        "in vec4 vs_color;                                              \n"
+        "out vec4 frag_color;                                           \n"
+        "void main(void) {                                              \n"
+        "    frag_color = vs_color * color;                             \n"
+        "}                                                              \n";
+
+    m_markerProg = compileProgram("marker",
+        VERTEX_SHADER_SOURCE.c_str(),
+        FRAGMENT_SHADER_SOURCE);
+}
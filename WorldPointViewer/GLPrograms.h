@@ -1,5 +1,8 @@
 #pragma once
 
+#include <string>
+#include <vector>
+
 #include <GL/gl.h>
 
 class GLPrograms
@@ -12,14 +15,63 @@ public:
     void cleanupPrograms();
 
     GLuint getSimpleProg() const;
+    GLuint getPointProg() const;
+    GLuint getHeatAccumulateProg() const;
+    GLuint getHeatRampProg() const;
+    GLuint getOccluderProg() const;
+    GLuint getScalarRampProg() const;
+    GLuint getPaletteProg() const;
+    GLuint getMarkerProg() const;
+
+    struct ProgramTiming {
+        const char* name;
+        bool fromCache;
+        double ms;
+    };
+
+    // how each program was made by the last compilePrograms
+    const std::vector<ProgramTiming>& getTimings() const;
+    void printTimings() const;
 
 protected:
+    // Linked programs are saved with glGetProgramBinary under
+    // PROGRAM_CACHE_DIR, in a file named for a hash of the shader source and
+    // the driver's vendor, renderer and version strings. A program whose
+    // file is there and that the driver accepts isn't compiled.
+    static const char* const PROGRAM_CACHE_DIR;
+
     GLint compileShader(GLuint shaderType, const GLchar* shaderSource);
     GLuint compileProgram(
+        const char* name,
         const GLchar* vertexShaderSource,
         const GLchar* fragmentShaderSource);
 
+    std::string cacheFileFor(
+        const GLchar* vertexShaderSource,
+        const GLchar* fragmentShaderSource) const;
+    GLuint loadCachedProgram(const std::string& filename) const;
+    void saveCachedProgram(GLuint prog, const std::string& filename) const;
+    bool checkLinkStatus(GLuint prog, const char* name) const;
+    void bindUniformBlocks(GLuint prog) const;
+
     void compileSimpleProgram();
+    void compilePointProgram();
+    void compileHeatAccumulateProgram();
+    void compileHeatRampProgram();
+    void compileOccluderProgram();
+    void compileScalarRampProgram();
+    void compilePaletteProgram();
+    void compileMarkerProgram();
 
     GLuint m_simpleProg;
+    GLuint m_pointProg;
+    GLuint m_heatAccumulateProg;
+    GLuint m_heatRampProg;
+    GLuint m_occluderProg;
+    GLuint m_scalarRampProg;
+    GLuint m_paletteProg;
+    GLuint m_markerProg;
+
+    bool m_cacheSupported;
+    std::vector<ProgramTiming> m_timings;
 };
@@ -4,6 +4,10 @@
 
 #include "Utils.h"
 
+namespace {
+    const Color OUTLINE_COLOR = Color{ 77, 77, 77, 255 };
+}
+
 Globe::Globe(double resolution) :
     BufferDrawable(),
     m_pointCount(0)
@@ -66,20 +70,14 @@ void Globe::setup() {
     glBufferData(GL_ARRAY_BUFFER, OUTLINE_BUFFER_SIZE, outlineCoords.data(), GL_STATIC_DRAW);
     glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
     glEnableVertexAttribArray(0);
+    setVertexColor(OUTLINE_COLOR);
 }
 
-void Globe::draw(const mat4df::Mat4Df& modelView, const mat4df::Mat4Df& projection) {
-    glUseProgram(m_program);
-
-    const GLuint PROG4_MODEL_VIEW_LOC = 0;
-    const GLuint PROG4_PROJ_LOC = 1;
-    const GLuint PROG4_COLOR_LOC = 2;
-    const GLuint PROG4_DIST_FADE_LOC = 3;
-    glUniformMatrix4fv(PROG4_MODEL_VIEW_LOC, 1, GL_FALSE, modelView.getBuf());
-    glUniformMatrix4fv(PROG4_PROJ_LOC, 1, GL_FALSE, projection.getBuf());
-    glUniform4f(PROG4_COLOR_LOC, 0.3, 0.3, 0.3, 1);
-    glUniform1i(PROG4_DIST_FADE_LOC, 1);
-
-    glBindVertexArray(m_vao);
-    glDrawArrays(GL_LINES, 0, m_pointCount);
+void Globe::submit(RenderQueue& queue) {
+    // the vertex array gives the color; the color uniform tints it
+    auto item = RenderQueue::makeItem(
+        m_program, m_vao, GL_LINES, Color{ 255, 255, 255, 255 });
+    item.pass = RenderQueue::PASS_BACKGROUND;
+    item.count = m_pointCount;
+    queue.submit(item);
 }
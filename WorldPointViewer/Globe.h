@@ -2,6 +2,7 @@
 
 #include "BufferDrawable.h"
 #include "Matrix4Df.h"
+#include "RenderQueue.h"
 
 class Globe :
     public BufferDrawable
@@ -11,7 +12,7 @@ public:
     virtual ~Globe();
 
     virtual void setup();
-    virtual void draw(const mat4df::Mat4Df& modelView, const mat4df::Mat4Df& projection);
+    virtual void submit(RenderQueue& queue);
 
 protected:
     GLuint m_pointCount;
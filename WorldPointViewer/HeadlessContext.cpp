@@ -0,0 +1,330 @@
+#include "HeadlessContext.h"
+
+#include <GL/glew.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <GL/Wglew.h>
+#endif
+
+#ifdef WPV_HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#ifdef WPV_HAVE_OSMESA
+#include <GL/osmesa.h>
+#endif
+
+#ifdef _WIN32
+namespace {
+    const char* const WINDOW_CLASS = "WorldPointViewerHeadless";
+}
+#endif
+
+HeadlessContext::HeadlessContext() :
+    m_backend(BACKEND_AUTO),
+    m_display(nullptr),
+    m_context(nullptr),
+    m_window(nullptr),
+    m_dc(nullptr)
+{
+}
+
+HeadlessContext::~HeadlessContext()
+{
+    destroy();
+}
+
+bool HeadlessContext::create(Backend backend) {
+    destroy();
+
+    bool created = false;
+    if (backend == BACKEND_EGL || backend == BACKEND_AUTO) {
+        created = createEgl();
+        m_backend = BACKEND_EGL;
+    }
+    if (!created && (backend == BACKEND_OSMESA || backend == BACKEND_AUTO)) {
+        created = createOsMesa();
+        m_backend = BACKEND_OSMESA;
+    }
+    if (!created && (backend == BACKEND_WGL || backend == BACKEND_AUTO)) {
+        created = createWgl();
+        m_backend = BACKEND_WGL;
+    }
+    if (!created) {
+        m_backend = BACKEND_AUTO;
+        return false;
+    }
+
+    // a core context has no GL_EXTENSIONS string, which GLEW otherwise
+    // relies on to load the entry points
+    glewExperimental = GL_TRUE;
+    GLenum glewResult = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    // GLEW 2.1 and up, built for GLX, loads the GL entry points and only
+    // then gives up on finding a GLX display, which EGL and OSMesa contexts
+    // don't have
+    if (glewResult == GLEW_ERROR_NO_GLX_DISPLAY) {
+        glewResult = GLEW_OK;
+    }
+#endif
+    if (glewResult != GLEW_OK) {
+        destroy();
+        return false;
+    }
+    // glewInit trips GL_INVALID_ENUM on core contexts; don't leave it for
+    // the first caller that checks
+    glGetError();
+    return true;
+}
+
+bool HeadlessContext::createEgl() {
+#ifdef WPV_HAVE_EGL
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (!getPlatformDisplay) {
+        return false;
+    }
+
+    EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    EGLint major, minor;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+        return false;
+    }
+    m_display = display;
+
+    EGLContext context = EGL_NO_CONTEXT;
+    if (eglBindAPI(EGL_OPENGL_API)) {
+        const EGLint CONFIG_ATTRIBS[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE
+        };
+        EGLConfig config;
+        EGLint configCount = 0;
+        if (!eglChooseConfig(display, CONFIG_ATTRIBS, &config, 1, &configCount) || configCount == 0) {
+            // EGL_KHR_no_config_context
+            config = (EGLConfig)0;
+        }
+
+        const EGLint CONTEXT_ATTRIBS[] = {
+            EGL_CONTEXT_MAJOR_VERSION, MAJOR_VERSION,
+            EGL_CONTEXT_MINOR_VERSION, MINOR_VERSION,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, CONTEXT_ATTRIBS);
+    }
+    m_context = context;
+
+    // EGL_KHR_surfaceless_context: no surface, the frames go to FBOs
+    if (context == EGL_NO_CONTEXT ||
+        !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        m_backend = BACKEND_EGL;
+        destroy();
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool HeadlessContext::createOsMesa() {
+#ifdef WPV_HAVE_OSMESA
+    const int CONTEXT_ATTRIBS[] = {
+        OSMESA_FORMAT, OSMESA_RGBA,
+        OSMESA_DEPTH_BITS, 0,
+        OSMESA_PROFILE, OSMESA_CORE_PROFILE,
+        OSMESA_CONTEXT_MAJOR_VERSION, MAJOR_VERSION,
+        OSMESA_CONTEXT_MINOR_VERSION, MINOR_VERSION,
+        0
+    };
+    OSMesaContext context = OSMesaCreateContextAttribs(CONTEXT_ATTRIBS, nullptr);
+    if (!context) {
+        return false;
+    }
+    m_context = context;
+
+    m_osMesaBuffer.assign(4, 0);
+    if (!OSMesaMakeCurrent(context, m_osMesaBuffer.data(), GL_UNSIGNED_BYTE, 1, 1)) {
+        m_backend = BACKEND_OSMESA;
+        destroy();
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool HeadlessContext::createWgl() {
+#ifdef _WIN32
+    HINSTANCE instance = ::GetModuleHandle(nullptr);
+
+    WNDCLASSA wndclass = {};
+    wndclass.lpfnWndProc = ::DefWindowProcA;
+    wndclass.hInstance = instance;
+    wndclass.lpszClassName = WINDOW_CLASS;
+    if (!::RegisterClassA(&wndclass) && ::GetLastError() != ERROR_CLASS_ALREADY_EXISTS) {
+        return false;
+    }
+
+    // never shown
+    HWND window = ::CreateWindowA(WINDOW_CLASS, WINDOW_CLASS, WS_OVERLAPPEDWINDOW,
+        0, 0, 1, 1, nullptr, nullptr, instance, nullptr);
+    if (!window) {
+        return false;
+    }
+    m_window = window;
+    HDC dc = ::GetDC(window);
+    m_dc = dc;
+
+    PIXELFORMATDESCRIPTOR pfd = {};
+    pfd.nSize = sizeof(PIXELFORMATDESCRIPTOR);
+    pfd.nVersion = 1;
+    pfd.dwFlags = PFD_DRAW_TO_WINDOW | PFD_SUPPORT_OPENGL;
+    pfd.iPixelType = PFD_TYPE_RGBA;
+    pfd.cColorBits = 32;
+    pfd.iLayerType = PFD_MAIN_PLANE;
+
+    int pixelFormat = ::ChoosePixelFormat(dc, &pfd);
+    HGLRC tempContext = nullptr;
+    if (pixelFormat && ::SetPixelFormat(dc, pixelFormat, &pfd)) {
+        tempContext = wglCreateContext(dc);
+    }
+    if (!tempContext) {
+        m_backend = BACKEND_WGL;
+        destroy();
+        return false;
+    }
+
+    // the old-style context is only for loading wglCreateContextAttribsARB
+    wglMakeCurrent(dc, tempContext);
+    glewExperimental = GL_TRUE;
+    glewInit();
+
+    HGLRC context = nullptr;
+    if (wglewIsSupported("WGL_ARB_create_context") == 1) {
+        const int CONTEXT_ATTRIBS[] = {
+            WGL_CONTEXT_MAJOR_VERSION_ARB, MAJOR_VERSION,
+            WGL_CONTEXT_MINOR_VERSION_ARB, MINOR_VERSION,
+            0
+        };
+        context = wglCreateContextAttribsARB(dc, 0, CONTEXT_ATTRIBS);
+    }
+    wglMakeCurrent(nullptr, nullptr);
+    wglDeleteContext(tempContext);
+    m_context = context;
+
+    if (!context || !wglMakeCurrent(dc, context)) {
+        m_backend = BACKEND_WGL;
+        destroy();
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+void HeadlessContext::destroy() {
+    switch (m_backend) {
+#ifdef WPV_HAVE_EGL
+    case BACKEND_EGL:
+        if (m_display) {
+            eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            if (m_context) {
+                eglDestroyContext(m_display, m_context);
+            }
+            eglTerminate(m_display);
+        }
+        break;
+#endif
+
+#ifdef WPV_HAVE_OSMESA
+    case BACKEND_OSMESA:
+        if (m_context) {
+            OSMesaDestroyContext((OSMesaContext)m_context);
+        }
+        m_osMesaBuffer.clear();
+        break;
+#endif
+
+#ifdef _WIN32
+    case BACKEND_WGL:
+        if (m_context) {
+            wglMakeCurrent(nullptr, nullptr);
+            wglDeleteContext((HGLRC)m_context);
+        }
+        if (m_dc) {
+            ::ReleaseDC((HWND)m_window, (HDC)m_dc);
+        }
+        if (m_window) {
+            ::DestroyWindow((HWND)m_window);
+        }
+        break;
+#endif
+
+    default:
+        break;
+    }
+
+    m_backend = BACKEND_AUTO;
+    m_display = nullptr;
+    m_context = nullptr;
+    m_window = nullptr;
+    m_dc = nullptr;
+}
+
+bool HeadlessContext::makeCurrent() {
+    switch (m_backend) {
+#ifdef WPV_HAVE_EGL
+    case BACKEND_EGL:
+        return eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_context) == EGL_TRUE;
+#endif
+
+#ifdef WPV_HAVE_OSMESA
+    case BACKEND_OSMESA:
+        return OSMesaMakeCurrent((OSMesaContext)m_context, m_osMesaBuffer.data(),
+            GL_UNSIGNED_BYTE, 1, 1) == GL_TRUE;
+#endif
+
+#ifdef _WIN32
+    case BACKEND_WGL:
+        return wglMakeCurrent((HDC)m_dc, (HGLRC)m_context) == TRUE;
+#endif
+
+    default:
+        return false;
+    }
+}
+
+HeadlessContext::Backend HeadlessContext::getBackend() const {
+    return m_backend;
+}
+
+const char* HeadlessContext::getBackendName(Backend backend) {
+    switch (backend) {
+    case BACKEND_EGL:
+        return "egl";
+    case BACKEND_OSMESA:
+        return "osmesa";
+    case BACKEND_WGL:
+        return "wgl";
+    default:
+        return "auto";
+    }
+}
+
+bool HeadlessContext::parseBackend(const std::string& name, Backend& backend) {
+    const Backend BACKENDS[] = { BACKEND_AUTO, BACKEND_EGL, BACKEND_OSMESA, BACKEND_WGL };
+    for (Backend b : BACKENDS) {
+        if (name == getBackendName(b)) {
+            backend = b;
+            return true;
+        }
+    }
+    return false;
+}
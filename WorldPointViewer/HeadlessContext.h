@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// A GL 4.1 core context with no window, for batch rendering into
+// framebuffer objects on machines without a display or a GPU.
+//
+// BACKEND_EGL uses Mesa's surfaceless EGL platform
+// (EGL_MESA_platform_surfaceless), so it needs neither a window system nor
+// a GPU; on Mesa's llvmpipe it renders in software. BACKEND_OSMESA is
+// Mesa's off-screen software renderer. BACKEND_WGL makes a hidden window
+// for drivers that only offer WGL, and so needs a desktop. A backend is
+// compiled in when its headers are: WPV_HAVE_EGL, WPV_HAVE_OSMESA and
+// _WIN32.
+//
+// create() also initializes GLEW on the new context. GLEW has to be built
+// for the backend's loader: with GLEW_OSMESA for OSMesa, and on Linux its
+// GLX loader resolves the entry points of EGL contexts through libglvnd.
+// The Linux build (CMakeLists.txt) compiles in EGL and OSMesa when it
+// finds them.
+class HeadlessContext
+{
+public:
+    enum Backend {
+        BACKEND_AUTO,
+        BACKEND_EGL,
+        BACKEND_OSMESA,
+        BACKEND_WGL,
+    };
+
+    HeadlessContext();
+    ~HeadlessContext();
+
+    // Makes the context current on the calling thread. BACKEND_AUTO tries
+    // the compiled-in backends in the order above.
+    bool create(Backend backend = BACKEND_AUTO);
+    void destroy();
+    bool makeCurrent();
+
+    Backend getBackend() const;
+
+    static const char* getBackendName(Backend backend);
+    // accepts auto, egl, osmesa and wgl
+    static bool parseBackend(const std::string& name, Backend& backend);
+
+protected:
+    static const int MAJOR_VERSION = 4;
+    static const int MINOR_VERSION = 1;
+
+    bool createEgl();
+    bool createOsMesa();
+    bool createWgl();
+
+    Backend m_backend;
+
+    // The backend's handles, as void* so that this header doesn't pull in
+    // any window system's: the EGL display and context, the OSMesa context,
+    // or the hidden window, its DC and the WGL context.
+    void* m_display;
+    void* m_context;
+    void* m_window;
+    void* m_dc;
+
+    // OSMesa always draws into a client buffer; the frames themselves go
+    // to framebuffer objects, so it's a single pixel.
+    std::vector<unsigned char> m_osMesaBuffer;
+};
@@ -0,0 +1,256 @@
+#include "HeatmapLayer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "Utils.h"
+
+namespace {
+    const GLsizei POINT_SIZE = 2 * sizeof(GLfloat);
+    // points per stream segment
+    const GLsizeiptr SEGMENT_POINTS = 1 << 20;
+
+    // sphere vertices: high x, y, z, low x, y, z, u, v
+    const GLsizei VERTEX_SIZE = 8 * sizeof(GLfloat);
+}
+
+HeatmapLayer::HeatmapLayer(int width, int height) :
+    BufferDrawable(),
+    m_width(width),
+    m_height(height),
+    m_accumulateProgram(0),
+    m_accumulateVao(0),
+    m_texture(0),
+    m_fbo(0),
+    m_pendingStart(0),
+    m_pendingCount(0),
+    m_countedPoints(0),
+    m_saturation(1000)
+{
+}
+
+HeatmapLayer::~HeatmapLayer()
+{
+}
+
+void HeatmapLayer::setAccumulateProgram(GLuint program) {
+    m_accumulateProgram = program;
+}
+
+void HeatmapLayer::setup() {
+
+    BufferDrawable::setup();
+
+    // the counts
+    glGenTextures(1, &m_texture);
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, m_width, m_height, 0, GL_RED, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glGenFramebuffers(1, &m_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_texture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        printf("heatmap framebuffer is incomplete\n");
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    clear();
+
+    // the queued points are streamed through m_stream
+    m_stream.setup(SEGMENT_POINTS * POINT_SIZE);
+
+    glGenVertexArrays(1, &m_accumulateVao);
+    glBindVertexArray(m_accumulateVao);
+    glBindBuffer(GL_ARRAY_BUFFER, m_stream.getBuffer());
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, POINT_SIZE, 0);
+    glEnableVertexAttribArray(0);
+
+    // the sphere the counts are drawn on, in one degree steps
+    std::vector<GLfloat> vertices;
+    auto pushVertex = [&](int lat, int lon) {
+        double latRad = lat * PI / 180.0;
+        double lonRad = lon * PI / 180.0;
+        double p[3] = {
+            EARTH_EQUITORIAL_RADIUS * cos(latRad) * cos(lonRad),
+            EARTH_EQUITORIAL_RADIUS * cos(latRad) * sin(lonRad),
+            EARTH_EQUITORIAL_RADIUS * sin(latRad),
+        };
+        float high[3], low[3];
+        for (int c = 0; c < 3; c++) {
+            splitDouble(p[c], high[c], low[c]);
+        }
+        pushCoord3d(high[0], high[1], high[2], vertices);
+        pushCoord3d(low[0], low[1], low[2], vertices);
+        pushCoord2d((lon + 180) / 360.0f, (lat + 90) / 180.0f, vertices);
+    };
+
+    const size_t COMPONENTS_PER_VERTEX = 8;
+    m_bandStarts.clear();
+    m_bandCounts.clear();
+    for (int lat = -90; lat < 90; lat++) {
+        m_bandStarts.push_back((GLint)(vertices.size() / COMPONENTS_PER_VERTEX));
+        for (int lon = -180; lon <= 180; lon++) {
+            pushVertex(lat + 1, lon);
+            pushVertex(lat, lon);
+        }
+        m_bandCounts.push_back((GLsizei)(vertices.size() / COMPONENTS_PER_VERTEX) - m_bandStarts.back());
+    }
+
+    glBindVertexArray(m_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, VERTEX_SIZE, 0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, VERTEX_SIZE,
+        (const GLvoid*)(3 * sizeof(GLfloat)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, VERTEX_SIZE,
+        (const GLvoid*)(6 * sizeof(GLfloat)));
+    glEnableVertexAttribArray(2);
+}
+
+void HeatmapLayer::cleanup() {
+    BufferDrawable::cleanup();
+
+    glDeleteVertexArrays(1, &m_accumulateVao);
+    glDeleteFramebuffers(1, &m_fbo);
+    glDeleteTextures(1, &m_texture);
+    m_accumulateVao = 0;
+    m_fbo = 0;
+    m_texture = 0;
+}
+
+void HeatmapLayer::pushLonLat(double x, double y, double z, std::vector<GLfloat>& lonLat) {
+    lonLat.push_back((GLfloat)atan2(y, x));
+    lonLat.push_back((GLfloat)atan2(z, sqrt(x * x + y * y)));
+}
+
+void HeatmapLayer::addPoints(const PolylineSet& points) {
+    std::vector<GLfloat> lonLat;
+    toLonLat(points, lonLat);
+    addLonLat(lonLat);
+}
+
+void HeatmapLayer::addPoints(const std::vector<vec3dd::Vec3Dd>& points) {
+    std::vector<GLfloat> lonLat;
+    lonLat.reserve(points.size() * 2);
+    for (auto& p : points) {
+        pushLonLat(p(0), p(1), p(2), lonLat);
+    }
+    addLonLat(lonLat);
+}
+
+void HeatmapLayer::toLonLat(const PolylineSet& points, std::vector<GLfloat>& lonLat) {
+    lonLat.reserve(lonLat.size() + points.pointCount * 2);
+    for (unsigned int i = 0; i < points.pointCount; i++) {
+        const GLfloat* p = &points.coords[i * 3];
+        pushLonLat(p[0], p[1], p[2], lonLat);
+    }
+}
+
+void HeatmapLayer::addLonLat(std::vector<GLfloat>& lonLat) {
+    if (lonLat.size() < 2) {
+        return;
+    }
+    m_pendingCount += (unsigned int)(lonLat.size() / 2);
+    m_pending.push_back(std::vector<GLfloat>());
+    m_pending.back().swap(lonLat);
+}
+
+bool HeatmapLayer::update(unsigned int maxPoints) {
+    unsigned int remaining = std::min(getPendingCount(), maxPoints);
+    if (remaining == 0) {
+        return false;
+    }
+
+    // the scene may be going to an offscreen target rather than the window
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    GLint framebuffer;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    glViewport(0, 0, m_width, m_height);
+
+    glUseProgram(m_accumulateProgram);
+    glBindVertexArray(m_accumulateVao);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+
+    while (remaining > 0) {
+        const std::vector<GLfloat>& chunk = m_pending.front();
+        unsigned int count = std::min(remaining, (unsigned int)SEGMENT_POINTS);
+        count = std::min(count, (unsigned int)((chunk.size() - m_pendingStart) / 2));
+
+        // the points stay queued for a later frame if this fails
+        void* dest = m_stream.beginWrite();
+        if (!dest) {
+            break;
+        }
+        memcpy(dest, &chunk[m_pendingStart], count * POINT_SIZE);
+        GLintptr offset = m_stream.endWrite();
+
+        glDrawArrays(GL_POINTS, (GLint)(offset / POINT_SIZE), count);
+        m_stream.fence();
+
+        m_pendingStart += count * 2;
+        m_pendingCount -= count;
+        m_countedPoints += count;
+        remaining -= count;
+
+        if (m_pendingStart + 1 >= chunk.size()) {
+            m_pending.pop_front();
+            m_pendingStart = 0;
+        }
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+    return true;
+}
+
+void HeatmapLayer::clear() {
+    const GLfloat ZERO[] = { 0, 0, 0, 0 };
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    glClearBufferfv(GL_COLOR, 0, ZERO);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    m_countedPoints = 0;
+}
+
+unsigned int HeatmapLayer::getPendingCount() const {
+    return m_pendingCount;
+}
+
+unsigned int HeatmapLayer::getCountedPoints() const {
+    return m_countedPoints;
+}
+
+void HeatmapLayer::setSaturation(float saturation) {
+    m_saturation = saturation;
+}
+
+float HeatmapLayer::getSaturation() const {
+    return m_saturation;
+}
+
+void HeatmapLayer::submit(RenderQueue& queue) {
+    if (m_countedPoints == 0) {
+        return;
+    }
+
+    auto item = RenderQueue::makeItem(m_program, m_vao, GL_TRIANGLE_STRIP, Color{ 255, 255, 255, 255 });
+    item.texture = m_texture;
+    item.params[0] = m_saturation;
+    item.paramCount = 1;
+    item.starts = m_bandStarts.data();
+    item.counts = m_bandCounts.data();
+    item.drawCount = (GLsizei)m_bandStarts.size();
+    queue.submit(item);
+}
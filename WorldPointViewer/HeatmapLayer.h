@@ -0,0 +1,84 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+
+#include "BufferDrawable.h"
+#include "PolylineSet.h"
+#include "RenderQueue.h"
+#include "Vec3Dd.h"
+
+// Point density over the globe. Points are counted per texel of an
+// equirectangular GL_R32F texture by drawing them into it with additive
+// blending, and the counts are drawn over the globe through a color ramp.
+//
+// Counting is incremental: addPoints only queues points, and update()
+// accumulates the queued ones, streaming them through m_stream, so points
+// that are already counted are never drawn again.
+class HeatmapLayer :
+    public BufferDrawable
+{
+public:
+    HeatmapLayer(int width, int height);
+    virtual ~HeatmapLayer();
+
+    // setProgram takes the ramp program that draws the sphere
+    void setAccumulateProgram(GLuint program);
+
+    virtual void setup();
+    virtual void cleanup();
+
+    void addPoints(const PolylineSet& points);
+    void addPoints(const std::vector<vec3dd::Vec3Dd>& points);
+
+    // Converts points to the longitude and latitude pairs that are queued,
+    // so the conversion can be done off the drawing thread.
+    static void toLonLat(const PolylineSet& points, std::vector<GLfloat>& lonLat);
+    // Queues converted points. The pairs are moved out of lonLat, as a
+    // chunk of their own, so queueing takes the same time however many
+    // points are already waiting.
+    void addLonLat(std::vector<GLfloat>& lonLat);
+
+    // Counts up to maxPoints of the queued points. It changes the bound
+    // framebuffer, viewport, program, vertex array and blend mode, and
+    // restores only the framebuffer and viewport. Returns whether it drew
+    // anything.
+    bool update(unsigned int maxPoints);
+
+    // Zeroes the counts.
+    void clear();
+
+    unsigned int getPendingCount() const;
+    unsigned int getCountedPoints() const;
+
+    // count at which the ramp tops out
+    void setSaturation(float saturation);
+    float getSaturation() const;
+
+    virtual void submit(RenderQueue& queue);
+
+protected:
+    static void pushLonLat(double x, double y, double z, std::vector<GLfloat>& lonLat);
+
+    int m_width;
+    int m_height;
+
+    GLuint m_accumulateProgram;
+    GLuint m_accumulateVao;
+    GLuint m_texture;
+    GLuint m_fbo;
+
+    // longitude and latitude of the queued points, in radians, a chunk per
+    // addLonLat; m_pendingStart is where the first chunk's uncounted
+    // points begin
+    std::deque<std::vector<GLfloat> > m_pending;
+    size_t m_pendingStart;
+    unsigned int m_pendingCount;
+    unsigned int m_countedPoints;
+
+    float m_saturation;
+
+    // one triangle strip per band of latitude
+    std::vector<GLint> m_bandStarts;
+    std::vector<GLsizei> m_bandCounts;
+};
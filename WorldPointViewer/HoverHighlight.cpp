@@ -0,0 +1,77 @@
+#include "HoverHighlight.h"
+
+namespace {
+    // interleaved high and low xyz
+    const GLsizei VERTEX_SIZE = 6 * sizeof(GLfloat);
+}
+
+HoverHighlight::HoverHighlight(Color color) :
+    BufferDrawable(),
+    m_color(color),
+    m_written(false)
+{
+}
+
+HoverHighlight::~HoverHighlight()
+{
+}
+
+void HoverHighlight::setup() {
+
+    BufferDrawable::setup();
+
+    const GLsizeiptr INITIAL_POINTS = 4096;
+    setupStream(INITIAL_POINTS * VERTEX_SIZE);
+    setVertexColor(m_color);
+}
+
+void HoverHighlight::setupStream(GLsizeiptr segmentSize) {
+    m_stream.setup(segmentSize);
+
+    glBindVertexArray(m_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, m_stream.getBuffer());
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, VERTEX_SIZE, 0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, VERTEX_SIZE,
+        (const GLvoid*)(3 * sizeof(GLfloat)));
+    glEnableVertexAttribArray(1);
+}
+
+void HoverHighlight::submit(RenderQueue& queue, const LineLayer& layer, unsigned int polyline) {
+
+    if (m_written) {
+        queue.submit(m_item);
+        return;
+    }
+    if (polyline >= layer.getPolylineCount()) {
+        return;
+    }
+
+    const GLsizei COUNT = layer.getPolylineSet().counts[polyline];
+    if ((GLsizeiptr)COUNT * VERTEX_SIZE > m_stream.getSegmentSize()) {
+        setupStream((GLsizeiptr)COUNT * VERTEX_SIZE * 2);
+    }
+
+    GLfloat* dest = (GLfloat*)m_stream.beginWrite();
+    if (!dest) {
+        return;
+    }
+    layer.copyPolyline(polyline, dest);
+    GLintptr offset = m_stream.endWrite();
+    m_written = true;
+
+    // the vertex array gives the color; the color uniform tints it
+    auto item = RenderQueue::makeItem(m_program, m_vao, GL_LINE_STRIP, Color{ 255, 255, 255, 255 });
+    item.pass = RenderQueue::PASS_OVERLAY;
+    item.first = (GLint)(offset / VERTEX_SIZE);
+    item.count = COUNT;
+    queue.submit(item);
+    m_item = item;
+}
+
+void HoverHighlight::endFrame() {
+    if (m_written) {
+        m_stream.fence();
+        m_written = false;
+    }
+}
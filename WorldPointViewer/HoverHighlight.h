@@ -0,0 +1,32 @@
+#pragma once
+
+#include "BufferDrawable.h"
+#include "Color.h"
+#include "LineLayer.h"
+#include "RenderQueue.h"
+
+// Draws one polyline of a layer over everything else. The polyline is
+// written into the stream buffer each frame rather than drawn out of the
+// layer's own buffer.
+class HoverHighlight :
+    public BufferDrawable
+{
+public:
+    HoverHighlight(Color color);
+    virtual ~HoverHighlight();
+
+    virtual void setup();
+    // Submitting again in the same frame, for another view, reuses the
+    // polyline written by the first submit.
+    virtual void submit(RenderQueue& queue, const LineLayer& layer, unsigned int polyline);
+
+    // call after the queue has been flushed
+    void endFrame();
+
+protected:
+    void setupStream(GLsizeiptr segmentSize);
+
+    Color m_color;
+    bool m_written;
+    RenderQueue::DrawItem m_item;
+};
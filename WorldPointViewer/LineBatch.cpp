@@ -0,0 +1,182 @@
+#include "LineBatch.h"
+
+#include <algorithm>
+
+LineBatch::LineBatch() :
+    BufferDrawable(),
+    m_pointCount(0),
+    m_ready(false),
+    m_idVbo(0),
+    m_paletteUbo(0),
+    m_palette(PALETTE_SIZE, 0xffffffff)
+{
+}
+
+LineBatch::~LineBatch()
+{
+}
+
+void LineBatch::setLayers(const std::vector<LineLayer*>& layers) {
+    m_layers = layers;
+    for (unsigned int i = 0; i < m_layers.size() && i < PALETTE_SIZE; i++) {
+        setPaletteColor(i, m_layers[i]->getColor());
+    }
+}
+
+void LineBatch::setup() {
+    upload();
+    publish();
+}
+
+void LineBatch::upload() {
+    m_layerFirsts.clear();
+    m_pointCount = 0;
+    for (auto layer : m_layers) {
+        m_layerFirsts.push_back((GLint)m_pointCount);
+        m_pointCount += layer->getPointCount();
+    }
+
+    const GLsizeiptr VERTEX_SIZE = sizeof(GLfloat) * 3;
+    const GLsizeiptr HALF_BUFFER_SIZE = VERTEX_SIZE * m_pointCount;
+
+    // the high parts followed by the low parts, like each layer's, so both
+    // halves of a layer are copied as they are
+    glGenBuffers(1, &m_vbo);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_vbo);
+    glBufferData(GL_COPY_WRITE_BUFFER, HALF_BUFFER_SIZE * 2, nullptr, GL_STATIC_DRAW);
+    for (size_t i = 0; i < m_layers.size(); i++) {
+        const GLsizeiptr LAYER_SIZE = VERTEX_SIZE * m_layers[i]->getPointCount();
+        if (LAYER_SIZE == 0) {
+            continue;
+        }
+        const GLintptr DEST_OFFSET = VERTEX_SIZE * m_layerFirsts[i];
+        glBindBuffer(GL_COPY_READ_BUFFER, m_layers[i]->getVertexBuffer());
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+            0, DEST_OFFSET, LAYER_SIZE);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+            LAYER_SIZE, HALF_BUFFER_SIZE + DEST_OFFSET, LAYER_SIZE);
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    std::vector<GLubyte> ids(m_pointCount);
+    for (size_t i = 0; i < m_layers.size(); i++) {
+        std::fill_n(ids.begin() + m_layerFirsts[i], m_layers[i]->getPointCount(),
+            (GLubyte)std::min(i, (size_t)(PALETTE_SIZE - 1)));
+    }
+
+    glGenBuffers(1, &m_idVbo);
+    glBindBuffer(GL_ARRAY_BUFFER, m_idVbo);
+    glBufferData(GL_ARRAY_BUFFER, ids.size(), ids.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void LineBatch::publish() {
+
+    const GLsizeiptr HALF_BUFFER_SIZE = sizeof(GLfloat) * 3 * m_pointCount;
+
+    glGenVertexArrays(1, &m_vao);
+    glBindVertexArray(m_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (const GLvoid*)HALF_BUFFER_SIZE);
+    glEnableVertexAttribArray(1);
+    glBindBuffer(GL_ARRAY_BUFFER, m_idVbo);
+    glVertexAttribIPointer(2, 1, GL_UNSIGNED_BYTE, 0, 0);
+    glEnableVertexAttribArray(2);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glGenBuffers(1, &m_paletteUbo);
+    glBindBuffer(GL_UNIFORM_BUFFER, m_paletteUbo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(GLuint) * PALETTE_SIZE, m_palette.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, PALETTE_BLOCK_BINDING, m_paletteUbo);
+
+    // the copies are complete by now, so the layers' own buffers can go
+    for (size_t i = 0; i < m_layers.size(); i++) {
+        m_layers[i]->moveToBuffer(m_vbo, m_layerFirsts[i], HALF_BUFFER_SIZE);
+    }
+
+    m_ready = true;
+}
+
+void LineBatch::cleanup() {
+    glDeleteBuffers(1, &m_idVbo);
+    glDeleteBuffers(1, &m_paletteUbo);
+    m_idVbo = 0;
+    m_paletteUbo = 0;
+    m_ready = false;
+    BufferDrawable::cleanup();
+}
+
+bool LineBatch::isReady() const {
+    return m_ready;
+}
+
+void LineBatch::setPaletteColor(unsigned int id, Color color) {
+    if (id >= PALETTE_SIZE) {
+        return;
+    }
+
+    m_palette[id] = color.r | (color.g << 8) | (color.b << 16) | ((GLuint)color.a << 24);
+    if (m_ready) {
+        writePalette();
+    }
+}
+
+void LineBatch::writePalette() {
+    glBindBuffer(GL_UNIFORM_BUFFER, m_paletteUbo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(GLuint) * PALETTE_SIZE, m_palette.data());
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void LineBatch::setPolylinePalette(unsigned int layer, unsigned int polyline, unsigned char id) {
+    if (!m_ready || layer >= m_layers.size() || polyline >= m_layers[layer]->getPolylineCount()) {
+        return;
+    }
+
+    PolylineSet set = m_layers[layer]->getPolylineSet();
+    std::vector<GLubyte> ids(set.counts[polyline], id);
+    glBindBuffer(GL_ARRAY_BUFFER, m_idVbo);
+    glBufferSubData(GL_ARRAY_BUFFER, m_layerFirsts[layer] + set.starts[polyline],
+        ids.size(), ids.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void LineBatch::submit(RenderQueue& queue, unsigned int layerMask, unsigned int view) {
+    if (!m_ready || view >= MAX_VIEWS) {
+        return;
+    }
+
+    std::vector<GLint>& starts = m_starts[view];
+    std::vector<GLsizei>& counts = m_counts[view];
+    starts.clear();
+    counts.clear();
+    for (unsigned int i = 0; i < m_layers.size() && i < 32; i++) {
+        if (!(layerMask & (1u << i))) {
+            continue;
+        }
+        const LineLayer::DrawList& list = m_layers[i]->getDrawList(view);
+        const GLint FIRST = m_layerFirsts[i];
+        for (size_t j = 0; j < list.starts.size(); j++) {
+            starts.push_back(FIRST + list.starts[j]);
+        }
+        counts.insert(counts.end(), list.counts.begin(), list.counts.end());
+    }
+    if (starts.empty()) {
+        return;
+    }
+
+    // the palette gives the color; the color uniform tints it
+    auto item = RenderQueue::makeItem(m_program, m_vao, GL_LINE_STRIP, Color{ 255, 255, 255, 255 });
+    item.starts = starts.data();
+    item.counts = counts.data();
+    item.drawCount = (GLsizei)starts.size();
+    queue.submit(item);
+}
+
+unsigned int LineBatch::getPointCount() const {
+    return m_pointCount;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+
+#include "BufferDrawable.h"
+#include "Color.h"
+#include "LineLayer.h"
+#include "RenderQueue.h"
+
+// Several line layers merged into one vertex buffer, with a palette id per
+// vertex in place of each layer's color uniform, so the visible polylines
+// of every layer are drawn with a single glMultiDrawArrays. The ids index
+// PaletteBlock, a uniform buffer of PALETTE_SIZE packed RGBA8 colors.
+//
+// Each layer is uploaded into a buffer of its own, so it can be drawn as
+// soon as it's loaded. Once they all are, the batch copies them into its
+// buffer as consecutive ranges and moves every layer onto its range (see
+// LineLayer::moveToBuffer), freeing the layers' buffers, so the points are
+// on the GPU once. The layers keep their bounds and culling; the batch
+// gathers their draw lists each frame.
+class LineBatch :
+    public BufferDrawable
+{
+public:
+    // binding point of PaletteBlock
+    static const GLuint PALETTE_BLOCK_BINDING = 1;
+    static const unsigned int PALETTE_SIZE = 256;
+
+    LineBatch();
+    virtual ~LineBatch();
+
+    // Layer i starts out as palette id i, in the layer's color. The layers
+    // must outlive the batch, and at most 32 fit in a layer mask.
+    void setLayers(const std::vector<LineLayer*>& layers);
+
+    // Like LineLayer's: upload() copies the layers' vertex buffers into the
+    // batch's and may run on a shared context once they're uploaded;
+    // publish() makes the vertex array and palette on the drawing context
+    // and moves the layers onto the batch's buffer.
+    virtual void setup();
+    virtual void upload();
+    virtual void publish();
+    virtual void cleanup();
+    bool isReady() const;
+
+    void setPaletteColor(unsigned int id, Color color);
+    // Gives one of a layer's polylines its own palette id; giving it the
+    // layer's id puts it back.
+    void setPolylinePalette(unsigned int layer, unsigned int polyline, unsigned char id);
+
+    // Draws the layers whose bit is set in layerMask from the draw lists
+    // they were last culled into for view.
+    void submit(RenderQueue& queue, unsigned int layerMask, unsigned int view = 0);
+
+    unsigned int getPointCount() const;
+
+protected:
+    static const unsigned int MAX_VIEWS = LineLayer::MAX_VIEWS;
+
+    void writePalette();
+
+    std::vector<LineLayer*> m_layers;
+    // the first vertex of each layer in the batch's buffer
+    std::vector<GLint> m_layerFirsts;
+    unsigned int m_pointCount;
+    bool m_ready;
+
+    // one palette id per vertex
+    GLuint m_idVbo;
+    GLuint m_paletteUbo;
+    // packed with r in the low byte, for unpackUnorm4x8
+    std::vector<GLuint> m_palette;
+
+    // the merged draw lists of the last submit, one per view
+    std::vector<GLint> m_starts[MAX_VIEWS];
+    std::vector<GLsizei> m_counts[MAX_VIEWS];
+};
@@ -0,0 +1,341 @@
+#include "LineLayer.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Utils.h"
+
+LineLayer::LineLayer(Color color) :
+    BufferDrawable(),
+    m_color(color),
+    m_version(0),
+    m_ready(false),
+    m_sharedVbo(false),
+    m_scalarVbo(0),
+    m_scalarProgram(0),
+    m_rampTexture(0),
+    m_scalarMin(0),
+    m_scalarMax(1)
+{
+}
+
+LineLayer::~LineLayer()
+{
+}
+
+void LineLayer::addPolyline(const std::vector<vec3dd::Vec3Dd>& points) {
+    if (points.empty()) {
+        return;
+    }
+
+    const size_t COMPONENTS_PER_VERTEX = 3;
+    m_starts.push_back((GLint)(m_coords.size() / COMPONENTS_PER_VERTEX));
+    m_counts.push_back((GLsizei)points.size());
+    m_version++;
+
+    for (auto& p : points) {
+        float high[3], low[3];
+        for (int c = 0; c < 3; c++) {
+            splitDouble(p(c), high[c], low[c]);
+        }
+        pushCoord3d(high[0], high[1], high[2], m_coords);
+        pushCoord3d(low[0], low[1], low[2], m_coordsLow);
+    }
+}
+
+void LineLayer::setup() {
+    upload();
+    publish();
+}
+
+void LineLayer::upload() {
+
+    computeBounds();
+
+    // the high parts followed by the low parts
+    const GLsizeiptr HALF_BUFFER_SIZE = sizeof(GLfloat) * m_coords.size();
+
+    glGenBuffers(1, &m_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    glBufferData(GL_ARRAY_BUFFER, HALF_BUFFER_SIZE * 2, nullptr, GL_STATIC_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, HALF_BUFFER_SIZE, m_coords.data());
+    glBufferSubData(GL_ARRAY_BUFFER, HALF_BUFFER_SIZE, HALF_BUFFER_SIZE, m_coordsLow.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void LineLayer::publish() {
+
+    const GLsizeiptr HALF_BUFFER_SIZE = sizeof(GLfloat) * m_coords.size();
+
+    // Vertex arrays aren't shared between contexts, so it's made here
+    // rather than in upload().
+    glGenVertexArrays(1, &m_vao);
+    glBindVertexArray(m_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (const GLvoid*)HALF_BUFFER_SIZE);
+    glEnableVertexAttribArray(1);
+    setVertexColor(m_color);
+
+    // Until the first cull everything is visible.
+    for (auto& list : m_drawLists) {
+        list.visible.clear();
+        for (unsigned int i = 0; i < getPolylineCount(); i++) {
+            list.visible.push_back(i);
+        }
+        list.starts = m_starts;
+        list.counts = m_counts;
+    }
+
+    m_version++;
+    m_ready = true;
+}
+
+void LineLayer::cleanup() {
+    glDeleteBuffers(1, &m_scalarVbo);
+    m_scalarVbo = 0;
+    m_scalarProgram = 0;
+    if (m_sharedVbo) {
+        m_vbo = 0;
+        m_sharedVbo = false;
+    }
+    BufferDrawable::cleanup();
+}
+
+bool LineLayer::isReady() const {
+    return m_ready;
+}
+
+void LineLayer::setScalars(const std::vector<float>& values, GLuint program, GLuint rampTexture) {
+    if (!m_ready || values.size() != getPointCount()) {
+        return;
+    }
+
+    const GLsizeiptr BUFFER_SIZE = sizeof(GLfloat) * values.size();
+    if (!m_scalarVbo) {
+        glGenBuffers(1, &m_scalarVbo);
+        glBindBuffer(GL_ARRAY_BUFFER, m_scalarVbo);
+        glBufferData(GL_ARRAY_BUFFER, BUFFER_SIZE, values.data(), GL_STATIC_DRAW);
+
+        glBindVertexArray(m_vao);
+        glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, 0, 0);
+        glEnableVertexAttribArray(2);
+        glBindVertexArray(0);
+    }
+    else {
+        glBindBuffer(GL_ARRAY_BUFFER, m_scalarVbo);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, BUFFER_SIZE, values.data());
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    m_scalarProgram = program;
+    m_rampTexture = rampTexture;
+    m_version++;
+}
+
+void LineLayer::setScalarRange(float min, float max) {
+    m_scalarMin = min;
+    m_scalarMax = max;
+    m_version++;
+}
+
+void LineLayer::clearScalars() {
+    // The buffer stays attached for the next setScalars(); the plain
+    // program doesn't read it.
+    m_scalarProgram = 0;
+    m_version++;
+}
+
+bool LineLayer::hasScalars() const {
+    return m_scalarProgram != 0;
+}
+
+void LineLayer::computeBounds() {
+    unsigned int polylineCount = getPolylineCount();
+
+    m_boundsX.resize(polylineCount);
+    m_boundsY.resize(polylineCount);
+    m_boundsZ.resize(polylineCount);
+    m_boundsRadius.resize(polylineCount);
+
+    for (unsigned int i = 0; i < polylineCount; i++) {
+        const GLfloat* coords = &m_coords[m_starts[i] * 3];
+        GLsizei count = m_counts[i];
+
+        float minX = coords[0], minY = coords[1], minZ = coords[2];
+        float maxX = minX, maxY = minY, maxZ = minZ;
+        for (GLsizei j = 1; j < count; j++) {
+            const GLfloat* p = coords + j * 3;
+            minX = std::min(minX, p[0]);
+            minY = std::min(minY, p[1]);
+            minZ = std::min(minZ, p[2]);
+            maxX = std::max(maxX, p[0]);
+            maxY = std::max(maxY, p[1]);
+            maxZ = std::max(maxZ, p[2]);
+        }
+
+        float cx = (minX + maxX) * 0.5f;
+        float cy = (minY + maxY) * 0.5f;
+        float cz = (minZ + maxZ) * 0.5f;
+
+        float radiusSq = 0;
+        for (GLsizei j = 0; j < count; j++) {
+            const GLfloat* p = coords + j * 3;
+            float dx = p[0] - cx;
+            float dy = p[1] - cy;
+            float dz = p[2] - cz;
+            radiusSq = std::max(radiusSq, dx * dx + dy * dy + dz * dz);
+        }
+
+        m_boundsX[i] = cx;
+        m_boundsY[i] = cy;
+        m_boundsZ[i] = cz;
+        // pad for float error in the center
+        m_boundsRadius[i] = sqrtf(radiusSq) * 1.0001f + 1.0f;
+    }
+}
+
+void LineLayer::cull(const Frustum& frustum) {
+    cullViews(&frustum, 1);
+}
+
+void LineLayer::cullViews(const Frustum* frusta, unsigned int viewCount) {
+    if (!m_ready) {
+        return;
+    }
+    viewCount = std::min(viewCount, MAX_VIEWS);
+
+    std::vector<unsigned int> visible[MAX_VIEWS];
+    for (unsigned int v = 0; v < viewCount; v++) {
+        // reuse the lists' storage
+        visible[v].swap(m_drawLists[v].visible);
+        visible[v].clear();
+    }
+
+    if (viewCount == 1) {
+        frusta[0].cullSpheres(
+            m_boundsX.data(), m_boundsY.data(), m_boundsZ.data(), m_boundsRadius.data(),
+            getPolylineCount(), visible[0]);
+    }
+    else {
+        Frustum::cullSpheresMulti(frusta, viewCount,
+            m_boundsX.data(), m_boundsY.data(), m_boundsZ.data(), m_boundsRadius.data(),
+            getPolylineCount(), visible);
+    }
+
+    for (unsigned int v = 0; v < viewCount; v++) {
+        DrawList& list = m_drawLists[v];
+        list.visible.swap(visible[v]);
+        list.starts.resize(list.visible.size());
+        list.counts.resize(list.visible.size());
+        for (size_t i = 0; i < list.visible.size(); i++) {
+            list.starts[i] = m_starts[list.visible[i]];
+            list.counts[i] = m_counts[list.visible[i]];
+        }
+    }
+}
+
+void LineLayer::submit(RenderQueue& queue, unsigned int view) {
+    if (!m_ready || view >= MAX_VIEWS) {
+        return;
+    }
+
+    // The plain program takes the color from the vertex array, and the
+    // color uniform tints it; the scalar program colors negative values
+    // with the uniform.
+    const DrawList& list = m_drawLists[view];
+    auto item = RenderQueue::makeItem(m_program, m_vao, GL_LINE_STRIP, Color{ 255, 255, 255, 255 });
+    if (m_scalarProgram) {
+        item.color = m_color;
+        item.program = m_scalarProgram;
+        item.texture = m_rampTexture;
+        item.textureTarget = GL_TEXTURE_1D;
+        item.params[0] = m_scalarMin;
+        item.params[1] = m_scalarMax;
+        item.paramCount = 2;
+    }
+    item.starts = list.starts.data();
+    item.counts = list.counts.data();
+    item.drawCount = (GLsizei)list.starts.size();
+    queue.submit(item);
+}
+
+unsigned int LineLayer::getPolylineCount() const {
+    return (unsigned int)m_starts.size();
+}
+
+unsigned int LineLayer::getPointCount() const {
+    return (unsigned int)(m_coords.size() / 3);
+}
+
+unsigned int LineLayer::getVisibleCount(unsigned int view) const {
+    return (view < MAX_VIEWS) ? (unsigned int)m_drawLists[view].visible.size() : 0;
+}
+
+const LineLayer::DrawList& LineLayer::getDrawList(unsigned int view) const {
+    return m_drawLists[std::min(view, MAX_VIEWS - 1)];
+}
+
+Color LineLayer::getColor() const {
+    return m_color;
+}
+
+GLuint LineLayer::getVertexBuffer() const {
+    return m_vbo;
+}
+
+void LineLayer::moveToBuffer(GLuint buffer, GLint first, GLsizeiptr halfSize) {
+    if (!m_ready) {
+        return;
+    }
+
+    const GLintptr OFFSET = sizeof(GLfloat) * 3 * first;
+    glBindVertexArray(m_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (const GLvoid*)OFFSET);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (const GLvoid*)(halfSize + OFFSET));
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    if (!m_sharedVbo) {
+        glDeleteBuffers(1, &m_vbo);
+    }
+    m_vbo = buffer;
+    m_sharedVbo = true;
+}
+
+unsigned int LineLayer::getVersion() const {
+    // the loading thread may still be changing it
+    return m_ready ? m_version : 0;
+}
+
+void LineLayer::copyPolyline(unsigned int polyline, GLfloat* dest) const {
+    const GLfloat* high = &m_coords[m_starts[polyline] * 3];
+    const GLfloat* low = &m_coordsLow[m_starts[polyline] * 3];
+    for (GLsizei i = 0; i < m_counts[polyline] * 3; i += 3) {
+        *dest++ = high[i];
+        *dest++ = high[i + 1];
+        *dest++ = high[i + 2];
+        *dest++ = low[i];
+        *dest++ = low[i + 1];
+        *dest++ = low[i + 2];
+    }
+}
+
+vec3dd::Vec3Dd LineLayer::getPoint(unsigned int point) const {
+    const GLfloat* high = &m_coords[point * 3];
+    const GLfloat* low = &m_coordsLow[point * 3];
+    return vec3dd::create(
+        (double)high[0] + low[0], (double)high[1] + low[1], (double)high[2] + low[2]);
+}
+
+PolylineSet LineLayer::getPolylineSet() const {
+    PolylineSet set;
+    set.coords = m_coords.data();
+    set.starts = m_starts.data();
+    set.counts = m_counts.data();
+    set.polylineCount = getPolylineCount();
+    set.pointCount = getPointCount();
+    return set;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <vector>
+
+#include "BufferDrawable.h"
+#include "Frustum.h"
+#include "Matrix4Df.h"
+#include "Vec3Dd.h"
+#include "Color.h"
+#include "PolylineSet.h"
+#include "RenderQueue.h"
+
+// A set of polylines that share a color. All of the points live in one
+// vertex buffer and each polyline is a range of it, so a frame's visible
+// polylines can be drawn with a single glMultiDrawArrays.
+class LineLayer :
+    public BufferDrawable
+{
+public:
+    // most views a frame can cull the layer for
+    static const unsigned int MAX_VIEWS = 4;
+
+    LineLayer(Color color);
+    virtual ~LineLayer();
+
+    void addPolyline(const std::vector<vec3dd::Vec3Dd>& points);
+
+    // setup() is upload() then publish(). upload() fills the vertex buffer
+    // and may run on a context that shares objects with the drawing one;
+    // publish() makes the vertex array on the drawing context once the
+    // upload has completed. Until then only the uploading thread may touch
+    // the layer, and it isn't drawn.
+    virtual void setup();
+    virtual void upload();
+    virtual void publish();
+    virtual void cleanup();
+    bool isReady() const;
+
+    // Colors the layer by a value per point, one for each point in the
+    // order they were added, mapped through rampTexture (a 1D texture) by
+    // program. Negative values keep the layer's color. Only the layer's
+    // scalar buffer is written, and changing the range rewrites nothing.
+    void setScalars(const std::vector<float>& values, GLuint program, GLuint rampTexture);
+    void setScalarRange(float min, float max);
+    void clearScalars();
+    bool hasScalars() const;
+
+    // cull() builds view 0's draw list. cullViews() builds one per frustum
+    // in a single pass over the bounds, for views that share the layer's
+    // buffers; submit() then draws the given view's list.
+    void cull(const Frustum& frustum);
+    virtual void cullViews(const Frustum* frusta, unsigned int viewCount);
+    virtual void submit(RenderQueue& queue, unsigned int view = 0);
+
+    unsigned int getPolylineCount() const;
+    unsigned int getPointCount() const;
+    unsigned int getVisibleCount(unsigned int view = 0) const;
+
+    struct DrawList {
+        std::vector<unsigned int> visible;
+        std::vector<GLint> starts;
+        std::vector<GLsizei> counts;
+    };
+
+    // the list built for view by the last cull
+    const DrawList& getDrawList(unsigned int view = 0) const;
+
+    Color getColor() const;
+    // high parts of every point followed by the low parts
+    GLuint getVertexBuffer() const;
+
+    // Draws the layer out of a buffer that holds its points from vertex
+    // first on, laid out like the layer's own buffer but within halves of
+    // halfSize bytes that other layers' points share, and deletes the
+    // layer's own buffer. The new buffer isn't the layer's to delete.
+    void moveToBuffer(GLuint buffer, GLint first, GLsizeiptr halfSize);
+
+    // changes whenever the layer's points do
+    unsigned int getVersion() const;
+
+    PolylineSet getPolylineSet() const;
+
+    // Writes the polyline's points as interleaved high and low x, y, z.
+    void copyPolyline(unsigned int polyline, GLfloat* dest) const;
+    // the point at full precision, high plus low
+    vec3dd::Vec3Dd getPoint(unsigned int point) const;
+
+protected:
+    void computeBounds();
+
+    Color m_color;
+    unsigned int m_version;
+    bool m_ready;
+    // set once m_vbo belongs to someone else (see moveToBuffer)
+    bool m_sharedVbo;
+
+    // set while the layer is colored by scalars
+    GLuint m_scalarVbo;
+    GLuint m_scalarProgram;
+    GLuint m_rampTexture;
+    float m_scalarMin;
+    float m_scalarMax;
+
+    // x, y, z for every point of every polyline, split into the nearest
+    // float and the float remainder (see splitDouble) for relative-to-eye
+    // drawing
+    std::vector<GLfloat> m_coords;
+    std::vector<GLfloat> m_coordsLow;
+    std::vector<GLint> m_starts;
+    std::vector<GLsizei> m_counts;
+
+    // bounding spheres, one per polyline
+    std::vector<float> m_boundsX;
+    std::vector<float> m_boundsY;
+    std::vector<float> m_boundsZ;
+    std::vector<float> m_boundsRadius;
+
+    // the draw lists produced by the last cull, one per view
+    DrawList m_drawLists[MAX_VIEWS];
+};
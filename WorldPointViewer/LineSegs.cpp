@@ -34,24 +34,13 @@ void LineSegs::setup(const std::vector<vec3df::Vec3Df>& points) {
     glBufferData(GL_ARRAY_BUFFER, OUTLINE_BUFFER_SIZE, outlineCoords.data(), GL_STATIC_DRAW);
     glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
     glEnableVertexAttribArray(0);
+    setVertexColor(m_color);
 }
 
-void LineSegs::draw(const mat4df::Mat4Df& modelView, const mat4df::Mat4Df& projection) {
-    glUseProgram(m_program);
-
-    const GLuint PROG4_MODEL_VIEW_LOC = 0;
-    const GLuint PROG4_PROJ_LOC = 1;
-    const GLuint PROG4_COLOR_LOC = 2;
-    const GLuint PROG4_DIST_FADE_LOC = 3;
-    glUniformMatrix4fv(PROG4_MODEL_VIEW_LOC, 1, GL_FALSE, modelView.getBuf());
-    glUniformMatrix4fv(PROG4_PROJ_LOC, 1, GL_FALSE, projection.getBuf());
-    glUniform4f(PROG4_COLOR_LOC,
-        (float)m_color.r / 255.0f,
-        (float)m_color.g / 255.0f,
-        (float)m_color.b / 255.0f,
-        (float)m_color.a / 255.0f);
-    glUniform1i(PROG4_DIST_FADE_LOC, 0);
-
-    glBindVertexArray(m_vao);
-    glDrawArrays(GL_LINE_STRIP, 0, m_pointCount);
+void LineSegs::submit(RenderQueue& queue) {
+    // the vertex array gives the color; the color uniform tints it
+    auto item = RenderQueue::makeItem(m_program, m_vao, GL_LINE_STRIP, Color{ 255, 255, 255, 255 });
+    item.pass = RenderQueue::PASS_BACKGROUND;
+    item.count = m_pointCount;
+    queue.submit(item);
 }
@@ -5,6 +5,7 @@
 #include "BufferDrawable.h"
 #include "Matrix4Df.h"
 #include "Color.h"
+#include "RenderQueue.h"
 
 class LineSegs :
     public BufferDrawable
@@ -14,7 +15,7 @@ public:
     virtual ~LineSegs();
 
     virtual void setup(const std::vector<vec3df::Vec3Df>& points);
-    virtual void draw(const mat4df::Mat4Df& modelView, const mat4df::Mat4Df& projection);
+    virtual void submit(RenderQueue& queue);
 
 protected:
     GLuint m_pointCount;
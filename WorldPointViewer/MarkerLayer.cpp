@@ -0,0 +1,123 @@
+#include "MarkerLayer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#include "Utils.h"
+
+MarkerLayer::MarkerLayer() :
+    BufferDrawable(),
+    m_instanceVbo(0),
+    m_glyphVertexCount(0),
+    m_ready(false),
+    m_viewportWidth(1),
+    m_viewportHeight(1)
+{
+}
+
+MarkerLayer::~MarkerLayer()
+{
+}
+
+void MarkerLayer::addMarker(const vec3dd::Vec3Dd& position, Color color, float scale, unsigned int id) {
+    Instance instance;
+    for (int c = 0; c < 3; c++) {
+        splitDouble(position(c), instance.high[c], instance.low[c]);
+    }
+    instance.color = color.r | (color.g << 8) | (color.b << 16) | ((GLuint)color.a << 24);
+    instance.scale = scale;
+    instance.id = id;
+    m_instances.push_back(instance);
+}
+
+void MarkerLayer::setup() {
+    upload();
+    publish();
+}
+
+void MarkerLayer::upload() {
+
+    // a triangle fan around the center, in units of the marker's scale
+    std::vector<GLfloat> glyph;
+    pushCoord2d(0, 0, glyph);
+    for (int i = 0; i <= GLYPH_SEGMENTS; i++) {
+        float angle = RAD_PER_CIRCLE * i / GLYPH_SEGMENTS;
+        pushCoord2d(cosf(angle), sinf(angle), glyph);
+    }
+    m_glyphVertexCount = (GLsizei)(glyph.size() / 2);
+
+    glGenBuffers(1, &m_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * glyph.size(), glyph.data(), GL_STATIC_DRAW);
+
+    glGenBuffers(1, &m_instanceVbo);
+    glBindBuffer(GL_ARRAY_BUFFER, m_instanceVbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(Instance) * m_instances.size(),
+        m_instances.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void MarkerLayer::publish() {
+
+    glGenVertexArrays(1, &m_vao);
+    glBindVertexArray(m_vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
+    glEnableVertexAttribArray(2);
+
+    // the position takes the relative-to-eye locations, once per instance
+    const GLsizei STRIDE = sizeof(Instance);
+    glBindBuffer(GL_ARRAY_BUFFER, m_instanceVbo);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, STRIDE, (const GLvoid*)offsetof(Instance, high));
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, STRIDE, (const GLvoid*)offsetof(Instance, low));
+    glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE, STRIDE, (const GLvoid*)offsetof(Instance, color));
+    glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, STRIDE, (const GLvoid*)offsetof(Instance, scale));
+    glVertexAttribIPointer(5, 1, GL_UNSIGNED_INT, STRIDE, (const GLvoid*)offsetof(Instance, id));
+    const GLuint INSTANCE_ATTRIBS[] = { 0, 1, 3, 4, 5 };
+    for (GLuint attrib : INSTANCE_ATTRIBS) {
+        glEnableVertexAttribArray(attrib);
+        glVertexAttribDivisor(attrib, 1);
+    }
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    m_ready = true;
+}
+
+void MarkerLayer::cleanup() {
+    glDeleteBuffers(1, &m_instanceVbo);
+    m_instanceVbo = 0;
+    m_ready = false;
+    BufferDrawable::cleanup();
+}
+
+bool MarkerLayer::isReady() const {
+    return m_ready;
+}
+
+void MarkerLayer::setViewportSize(int width, int height) {
+    m_viewportWidth = (float)std::max(width, 1);
+    m_viewportHeight = (float)std::max(height, 1);
+}
+
+void MarkerLayer::submit(RenderQueue& queue) {
+    if (!m_ready || m_instances.empty()) {
+        return;
+    }
+
+    // the instances give the color; the color uniform tints it
+    auto item = RenderQueue::makeItem(m_program, m_vao, GL_TRIANGLE_FAN, Color{ 255, 255, 255, 255 });
+    item.params[0] = m_viewportWidth;
+    item.params[1] = m_viewportHeight;
+    item.paramCount = 2;
+    item.count = m_glyphVertexCount;
+    item.instanceCount = (GLsizei)m_instances.size();
+    queue.submit(item);
+}
+
+unsigned int MarkerLayer::getMarkerCount() const {
+    return (unsigned int)m_instances.size();
+}
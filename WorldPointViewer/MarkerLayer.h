@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+
+#include "BufferDrawable.h"
+#include "Color.h"
+#include "RenderQueue.h"
+#include "Vec3Dd.h"
+
+// Markers drawn as instances of one small glyph, a filled circle. Each
+// marker is a record in the instance buffer with its position, color,
+// size and an id, and the whole layer is one glDrawArraysInstanced. The
+// vertex shader sizes the glyph in pixels, so markers stay the same size
+// on screen at any distance.
+class MarkerLayer :
+    public BufferDrawable
+{
+public:
+    MarkerLayer();
+    virtual ~MarkerLayer();
+
+    // scale is the glyph's radius in pixels. The id is the caller's and is
+    // kept with the marker for picking.
+    void addMarker(const vec3dd::Vec3Dd& position, Color color, float scale, unsigned int id);
+
+    // Like LineLayer's: upload() fills the buffers and may run on a shared
+    // context; publish() makes the vertex array on the drawing context.
+    virtual void setup();
+    virtual void upload();
+    virtual void publish();
+    virtual void cleanup();
+    bool isReady() const;
+
+    // size in pixels of the viewport the next submit() draws into
+    void setViewportSize(int width, int height);
+    void submit(RenderQueue& queue);
+
+    unsigned int getMarkerCount() const;
+
+protected:
+    static const int GLYPH_SEGMENTS = 12;
+
+    // one per marker; the position is split like LineLayer's coords
+    struct Instance {
+        GLfloat high[3];
+        GLfloat low[3];
+        // RGBA8 with r in the low byte
+        GLuint color;
+        GLfloat scale;
+        GLuint id;
+    };
+
+    std::vector<Instance> m_instances;
+    GLuint m_instanceVbo;
+    GLsizei m_glyphVertexCount;
+    bool m_ready;
+
+    float m_viewportWidth;
+    float m_viewportHeight;
+};
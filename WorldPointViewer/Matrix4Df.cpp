@@ -98,4 +98,56 @@ Mat4Df createRotationAbout(const vec3df::Vec3Df& vec, float theta) {
     return r3 * r2 * r1;
 }
 
+bool invert(const Mat4Df& mat, Mat4Df& inverse) {
+    // Gauss-Jordan with partial pivoting, done in double so that view
+    // matrices with large translations keep their precision.
+    double a[4][8];
+    for (int row = 0; row < 4; row++) {
+        for (int col = 0; col < 4; col++) {
+            a[row][col] = mat(col, row);
+            a[row][col + 4] = (row == col) ? 1 : 0;
+        }
+    }
+
+    for (int col = 0; col < 4; col++) {
+        int pivot = col;
+        for (int row = col + 1; row < 4; row++) {
+            if (fabs(a[row][col]) > fabs(a[pivot][col])) {
+                pivot = row;
+            }
+        }
+        if (a[pivot][col] == 0) {
+            return false;
+        }
+        if (pivot != col) {
+            for (int k = 0; k < 8; k++) {
+                double temp = a[col][k];
+                a[col][k] = a[pivot][k];
+                a[pivot][k] = temp;
+            }
+        }
+
+        double scale = 1.0 / a[col][col];
+        for (int k = 0; k < 8; k++) {
+            a[col][k] *= scale;
+        }
+
+        for (int row = 0; row < 4; row++) {
+            if (row != col && a[row][col] != 0) {
+                double factor = a[row][col];
+                for (int k = 0; k < 8; k++) {
+                    a[row][k] -= factor * a[col][k];
+                }
+            }
+        }
+    }
+
+    for (int row = 0; row < 4; row++) {
+        for (int col = 0; col < 4; col++) {
+            inverse(col, row) = (float)a[row][col + 4];
+        }
+    }
+    return true;
+}
+
 } // of namespace mat4df
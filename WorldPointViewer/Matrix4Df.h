@@ -19,5 +19,6 @@ vec3df::Vec3Df mul(const Mat4Df& mat, const vec3df::Vec3Df& vec);
 Mat4Df createRotationAbout(const vec3df::Vec3Df& vec, float theta);
 Mat4Df createRotationAbout(const vec4df::Vec4Df& vec, float theta);
 Mat4Df createRotationAbout(const vec3df::Vec3Df& vec, float theta, const vec3df::Vec3Df& theVec);
+bool invert(const Mat4Df& mat, Mat4Df& inverse);
 
 } // of namespace mat4df
@@ -0,0 +1,74 @@
+#include "Occluder.h"
+
+#include <cmath>
+
+#include "Utils.h"
+
+namespace {
+    // high x, y, z, low x, y, z
+    const GLsizei VERTEX_SIZE = 6 * sizeof(GLfloat);
+}
+
+Occluder::Occluder() :
+    BufferDrawable()
+{
+}
+
+Occluder::~Occluder()
+{
+}
+
+void Occluder::setup() {
+
+    BufferDrawable::setup();
+
+    const double RAD = EARTH_EQUITORIAL_RADIUS - DEPTH_BELOW_SURFACE;
+
+    std::vector<GLfloat> vertices;
+    auto pushVertex = [&](int lat, int lon) {
+        double latRad = lat * PI / 180.0;
+        double lonRad = lon * PI / 180.0;
+        double p[3] = {
+            RAD * cos(latRad) * cos(lonRad),
+            RAD * cos(latRad) * sin(lonRad),
+            RAD * sin(latRad),
+        };
+        float high[3], low[3];
+        for (int c = 0; c < 3; c++) {
+            splitDouble(p[c], high[c], low[c]);
+        }
+        pushCoord3d(high[0], high[1], high[2], vertices);
+        pushCoord3d(low[0], low[1], low[2], vertices);
+    };
+
+    const size_t COMPONENTS_PER_VERTEX = 6;
+    m_bandStarts.clear();
+    m_bandCounts.clear();
+    for (int lat = -90; lat < 90; lat++) {
+        m_bandStarts.push_back((GLint)(vertices.size() / COMPONENTS_PER_VERTEX));
+        for (int lon = -180; lon <= 180; lon++) {
+            pushVertex(lat + 1, lon);
+            pushVertex(lat, lon);
+        }
+        m_bandCounts.push_back((GLsizei)(vertices.size() / COMPONENTS_PER_VERTEX) - m_bandStarts.back());
+    }
+
+    glBindVertexArray(m_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, VERTEX_SIZE, 0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, VERTEX_SIZE,
+        (const GLvoid*)(3 * sizeof(GLfloat)));
+    glEnableVertexAttribArray(1);
+}
+
+void Occluder::submit(RenderQueue& queue) {
+    auto item = RenderQueue::makeItem(m_program, m_vao, GL_TRIANGLE_STRIP, Color{ 0, 0, 0, 255 });
+    item.pass = RenderQueue::PASS_DEPTH;
+    item.blend = RenderQueue::BLEND_DEPTH_ONLY;
+    item.starts = m_bandStarts.data();
+    item.counts = m_bandCounts.data();
+    item.drawCount = (GLsizei)m_bandStarts.size();
+    queue.submit(item);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+
+#include "BufferDrawable.h"
+#include "RenderQueue.h"
+
+// An opaque sphere just under the surface that's drawn into the depth
+// buffer before anything else. Whatever is on the far side of the earth
+// then fails the depth test instead of being blended over the near side.
+class Occluder :
+    public BufferDrawable
+{
+public:
+    // how far under EARTH_EQUITORIAL_RADIUS the sphere is, in meters. It
+    // has to stay below the data on the near side even where the flat
+    // triangles cut under the curve.
+    static const int DEPTH_BELOW_SURFACE = 5000;
+
+    Occluder();
+    virtual ~Occluder();
+
+    virtual void setup();
+    virtual void submit(RenderQueue& queue);
+
+protected:
+    // one triangle strip per one degree latitude band
+    std::vector<GLint> m_bandStarts;
+    std::vector<GLsizei> m_bandCounts;
+};
@@ -0,0 +1,77 @@
+#include "OffscreenTarget.h"
+
+#include <cstdio>
+
+OffscreenTarget::OffscreenTarget() :
+    m_width(0),
+    m_height(0),
+    m_fbo(0),
+    m_colorBuffer(0),
+    m_depthBuffer(0)
+{
+}
+
+OffscreenTarget::~OffscreenTarget()
+{
+}
+
+bool OffscreenTarget::setup(int width, int height) {
+    m_width = width;
+    m_height = height;
+
+    glGenRenderbuffers(1, &m_colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+    glGenRenderbuffers(1, &m_depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &m_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_colorBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depthBuffer);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        printf("offscreen framebuffer of %d x %d is incomplete\n", width, height);
+        cleanup();
+        return false;
+    }
+    return true;
+}
+
+void OffscreenTarget::cleanup() {
+    glDeleteFramebuffers(1, &m_fbo);
+    glDeleteRenderbuffers(1, &m_colorBuffer);
+    glDeleteRenderbuffers(1, &m_depthBuffer);
+    m_fbo = 0;
+    m_colorBuffer = 0;
+    m_depthBuffer = 0;
+}
+
+void OffscreenTarget::bind() const {
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    glViewport(0, 0, m_width, m_height);
+}
+
+void OffscreenTarget::unbind() const {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void OffscreenTarget::readPixels(std::vector<unsigned char>& pixels) const {
+    pixels.resize((size_t)m_width * m_height * 4);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_fbo);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, m_width, m_height, GL_BGRA, GL_UNSIGNED_BYTE, pixels.data());
+}
+
+int OffscreenTarget::getWidth() const {
+    return m_width;
+}
+
+int OffscreenTarget::getHeight() const {
+    return m_height;
+}
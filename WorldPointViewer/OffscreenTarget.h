@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vector>
+
+#include <GL/glew.h>
+
+// A framebuffer object with a color and a depth renderbuffer, for drawing
+// frames that never reach the window.
+class OffscreenTarget
+{
+public:
+    OffscreenTarget();
+    ~OffscreenTarget();
+
+    // false if the driver can't make a complete framebuffer of this size
+    bool setup(int width, int height);
+    void cleanup();
+
+    // Binds the framebuffer and sets the viewport to cover it.
+    void bind() const;
+    void unbind() const;
+
+    // Reads the color buffer as BGRA rows, bottom row first.
+    void readPixels(std::vector<unsigned char>& pixels) const;
+
+    int getWidth() const;
+    int getHeight() const;
+
+protected:
+    int m_width;
+    int m_height;
+
+    GLuint m_fbo;
+    GLuint m_colorBuffer;
+    GLuint m_depthBuffer;
+};
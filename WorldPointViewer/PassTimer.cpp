@@ -0,0 +1,261 @@
+#include "PassTimer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "FrameScheduler.h"
+
+PassTimer::PassTimer() :
+    m_setUp(false),
+    m_inFrame(false),
+    m_inSection(false),
+    m_frame(0),
+    m_nextTrace(0),
+    m_droppedCount(0)
+{
+}
+
+PassTimer::~PassTimer()
+{
+}
+
+void PassTimer::setup() {
+    for (auto& slot : m_slots) {
+        glGenQueries(MAX_SECTIONS, slot.queries);
+        slot.records.clear();
+    }
+    m_setUp = true;
+}
+
+void PassTimer::cleanup() {
+    if (!m_setUp) {
+        return;
+    }
+    for (auto& slot : m_slots) {
+        glDeleteQueries(MAX_SECTIONS, slot.queries);
+    }
+    m_setUp = false;
+}
+
+void PassTimer::beginFrame() {
+    if (!m_setUp) {
+        return;
+    }
+
+    // This slot was last used QUERY_LATENCY frames ago.
+    FrameSlot& slot = m_slots[m_frame % QUERY_LATENCY];
+    collect(slot);
+    slot.records.clear();
+
+    m_inFrame = true;
+}
+
+void PassTimer::endFrame() {
+    end();
+    if (m_inFrame) {
+        m_frame++;
+    }
+    m_inFrame = false;
+}
+
+void PassTimer::begin(const char* name) {
+    if (!m_inFrame) {
+        return;
+    }
+    end();
+
+    FrameSlot& slot = m_slots[m_frame % QUERY_LATENCY];
+    if (slot.records.size() == MAX_SECTIONS) {
+        return;
+    }
+
+    Record record;
+    record.section = sectionFor(name);
+    record.cpuBegin = FrameScheduler::now();
+    record.cpuEnd = record.cpuBegin;
+    record.gpuMs = -1;
+
+    glBeginQuery(GL_TIME_ELAPSED, slot.queries[slot.records.size()]);
+    slot.records.push_back(record);
+    m_inSection = true;
+}
+
+void PassTimer::end() {
+    if (!m_inSection) {
+        return;
+    }
+    glEndQuery(GL_TIME_ELAPSED);
+    m_slots[m_frame % QUERY_LATENCY].records.back().cpuEnd = FrameScheduler::now();
+    m_inSection = false;
+}
+
+unsigned int PassTimer::sectionFor(const char* name) {
+    for (unsigned int i = 0; i < m_sections.size(); i++) {
+        if (m_sections[i].name == name || strcmp(m_sections[i].name, name) == 0) {
+            return i;
+        }
+    }
+
+    Section section;
+    section.name = name;
+    section.nextCpu = 0;
+    section.nextGpu = 0;
+    m_sections.push_back(section);
+    return (unsigned int)(m_sections.size() - 1);
+}
+
+void PassTimer::collect(FrameSlot& slot) {
+    if (slot.records.empty()) {
+        return;
+    }
+
+    // per section totals for the frame; a negative GPU total means one of
+    // its results wasn't ready
+    std::vector<float> cpuMs(m_sections.size(), 0.0f);
+    std::vector<float> gpuMs(m_sections.size(), 0.0f);
+    std::vector<bool> timed(m_sections.size(), false);
+
+    for (size_t i = 0; i < slot.records.size(); i++) {
+        Record& record = slot.records[i];
+        unsigned int section = record.section;
+        timed[section] = true;
+
+        cpuMs[section] += (float)FrameScheduler::ticksToMs(record.cpuEnd - record.cpuBegin);
+
+        GLint available = 0;
+        glGetQueryObjectiv(slot.queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(slot.queries[i], GL_QUERY_RESULT, &ns);
+            record.gpuMs = (float)(ns / 1e6);
+            if (gpuMs[section] >= 0) {
+                gpuMs[section] += record.gpuMs;
+            }
+        }
+        else {
+            gpuMs[section] = -1;
+            m_droppedCount++;
+        }
+    }
+
+    for (size_t i = 0; i < m_sections.size(); i++) {
+        if (!timed[i]) {
+            continue;
+        }
+        Section& section = m_sections[i];
+        addSample(section.cpuMs, section.nextCpu, cpuMs[i]);
+        if (gpuMs[i] >= 0) {
+            addSample(section.gpuMs, section.nextGpu, gpuMs[i]);
+        }
+    }
+
+    if (m_trace.size() < TRACE_FRAMES) {
+        m_trace.push_back(slot.records);
+    }
+    else {
+        m_trace[m_nextTrace] = slot.records;
+    }
+    m_nextTrace = (m_nextTrace + 1) % TRACE_FRAMES;
+}
+
+void PassTimer::addSample(std::vector<float>& ring, unsigned int& next, float ms) {
+    if (ring.size() < WINDOW_SIZE) {
+        ring.push_back(ms);
+    }
+    else {
+        ring[next] = ms;
+    }
+    next = (next + 1) % WINDOW_SIZE;
+}
+
+void PassTimer::getStats(std::vector<SectionStats>& stats) const {
+    stats.clear();
+    for (auto& section : m_sections) {
+        SectionStats s;
+        s.name = section.name;
+        s.samples = (unsigned int)section.cpuMs.size();
+
+        double total = 0;
+        s.cpuMaxMs = 0;
+        for (auto ms : section.cpuMs) {
+            total += ms;
+            s.cpuMaxMs = std::max(s.cpuMaxMs, (double)ms);
+        }
+        s.cpuMeanMs = section.cpuMs.empty() ? 0 : total / section.cpuMs.size();
+
+        std::vector<float> sorted(section.gpuMs);
+        std::sort(sorted.begin(), sorted.end());
+        total = 0;
+        for (auto ms : sorted) {
+            total += ms;
+        }
+        s.gpuMeanMs = sorted.empty() ? 0 : total / sorted.size();
+        s.gpuP95Ms = sorted.empty() ? 0 : sorted[(size_t)((sorted.size() - 1) * 0.95)];
+        s.gpuMaxMs = sorted.empty() ? 0 : sorted.back();
+
+        stats.push_back(s);
+    }
+}
+
+void PassTimer::printStats() const {
+    std::vector<SectionStats> stats;
+    getStats(stats);
+    for (auto& s : stats) {
+        printf("  %-10s cpu mean %.3f max %.3f ms, gpu mean %.3f p95 %.3f max %.3f ms\n",
+            s.name, s.cpuMeanMs, s.cpuMaxMs, s.gpuMeanMs, s.gpuP95Ms, s.gpuMaxMs);
+    }
+    if (m_droppedCount > 0) {
+        printf("  %u gpu times weren't ready after %u frames\n", m_droppedCount, QUERY_LATENCY);
+    }
+}
+
+bool PassTimer::writeTrace(const char* filename) const {
+    FILE* file = fopen(filename, "w");
+    if (!file) {
+        return false;
+    }
+
+    // Elapsed-time queries give durations but not start times, so each
+    // GPU section is placed at its CPU start or the end of the previous GPU
+    // section, whichever is later.
+    unsigned int count = (unsigned int)m_trace.size();
+    unsigned int first = (count < TRACE_FRAMES) ? 0 : m_nextTrace;
+    long long origin = 0;
+    if (count > 0 && !m_trace[first].empty()) {
+        origin = m_trace[first][0].cpuBegin;
+    }
+
+    fprintf(file, "{\"traceEvents\": [\n");
+    bool firstEvent = true;
+    auto writeEvent = [&](const char* name, int tid, double beginMs, double durationMs) {
+        fprintf(file, "%s  {\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+            "\"ts\": %.1f, \"dur\": %.1f}",
+            firstEvent ? "" : ",\n", name, tid, beginMs * 1000.0, durationMs * 1000.0);
+        firstEvent = false;
+    };
+
+    const int CPU_TRACK = 1;
+    const int GPU_TRACK = 2;
+    double gpuEndMs = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        for (auto& record : m_trace[(first + i) % count]) {
+            const char* name = m_sections[record.section].name;
+            double beginMs = FrameScheduler::ticksToMs(record.cpuBegin - origin);
+            double cpuMs = FrameScheduler::ticksToMs(record.cpuEnd - record.cpuBegin);
+            writeEvent(name, CPU_TRACK, beginMs, cpuMs);
+
+            if (record.gpuMs >= 0) {
+                double gpuBeginMs = std::max(beginMs, gpuEndMs);
+                writeEvent(name, GPU_TRACK, gpuBeginMs, record.gpuMs);
+                gpuEndMs = gpuBeginMs + record.gpuMs;
+            }
+        }
+    }
+
+    fprintf(file, "\n],\n");
+    fprintf(file, "\"metadata\": {\"tracks\": {\"%d\": \"cpu\", \"%d\": \"gpu\"}}}\n",
+        CPU_TRACK, GPU_TRACK);
+    fclose(file);
+    return true;
+}
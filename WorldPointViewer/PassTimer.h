@@ -0,0 +1,95 @@
+#pragma once
+
+#include <vector>
+
+#include <GL/glew.h>
+
+// Times the sections of a frame on both the CPU and the GPU. GPU times come
+// from GL_TIME_ELAPSED queries, which are only read back QUERY_LATENCY
+// frames later, and only if they're already available, so timing never
+// stalls the pipeline. Sections run back to back and can't nest, since
+// elapsed-time queries can't. A section begun more than once in a frame,
+// like a pass drawn once per view, gets the sum of its times.
+class PassTimer
+{
+public:
+    // sections begun per frame; later ones aren't timed
+    static const unsigned int MAX_SECTIONS = 32;
+    // frames a query has to finish before its result is read
+    static const unsigned int QUERY_LATENCY = 4;
+
+    struct SectionStats {
+        const char* name;
+        unsigned int samples;
+        double cpuMeanMs;
+        double cpuMaxMs;
+        double gpuMeanMs;
+        double gpuP95Ms;
+        double gpuMaxMs;
+    };
+
+    PassTimer();
+    ~PassTimer();
+
+    void setup();
+    void cleanup();
+
+    // Outside beginFrame() and endFrame(), begin() and end() do nothing.
+    void beginFrame();
+    void endFrame();
+
+    // Ends the section in progress, if any, and starts one. name must
+    // outlive the timer; sections are told apart by it.
+    void begin(const char* name);
+    void end();
+
+    void getStats(std::vector<SectionStats>& stats) const;
+    void printStats() const;
+
+    // Writes the last TRACE_FRAMES frames in Chrome's trace event format,
+    // with a CPU and a GPU track.
+    bool writeTrace(const char* filename) const;
+
+protected:
+    static const unsigned int WINDOW_SIZE = 600;
+    static const unsigned int TRACE_FRAMES = 300;
+
+    struct Record {
+        unsigned int section;
+        long long cpuBegin;
+        long long cpuEnd;
+        // negative if the result wasn't ready in time
+        float gpuMs;
+    };
+
+    struct FrameSlot {
+        GLuint queries[MAX_SECTIONS];
+        std::vector<Record> records;
+    };
+
+    struct Section {
+        const char* name;
+        // rings of the last WINDOW_SIZE times in ms
+        std::vector<float> cpuMs;
+        std::vector<float> gpuMs;
+        unsigned int nextCpu;
+        unsigned int nextGpu;
+    };
+
+    unsigned int sectionFor(const char* name);
+    void collect(FrameSlot& slot);
+    static void addSample(std::vector<float>& ring, unsigned int& next, float ms);
+
+    bool m_setUp;
+    bool m_inFrame;
+    bool m_inSection;
+    unsigned int m_frame;
+
+    FrameSlot m_slots[QUERY_LATENCY];
+    std::vector<Section> m_sections;
+
+    // finished frames, oldest first
+    std::vector<std::vector<Record> > m_trace;
+    unsigned int m_nextTrace;
+    unsigned int m_droppedCount;
+};
@@ -0,0 +1,105 @@
+#include "Picking.h"
+
+#include <cmath>
+
+namespace picking {
+
+bool unprojectRay(
+    float winX, float winY, float width, float height,
+    const mat4df::Mat4Df& modelView, const mat4df::Mat4Df& projection,
+    vec3df::Vec3Df& origin, vec3df::Vec3Df& dir) {
+
+    mat4df::Mat4Df invProjection;
+    mat4df::Mat4Df invModelView;
+    if (!mat4df::invert(projection, invProjection) ||
+        !mat4df::invert(modelView, invModelView)) {
+        return false;
+    }
+
+    float ndcX = 2.0f * winX / width - 1.0f;
+    float ndcY = 1.0f - 2.0f * winY / height;
+
+    // Unproject the point on the near plane in eye space, where the numbers
+    // are small, then rotate the direction into the world. The eye is the
+    // eye space origin, so the near point is the direction. Going through
+    // the combined matrix would lose it to the eye's large translation, and
+    // the far plane is too far out to unproject in float.
+    auto eyeNear = mat4df::mul(invProjection, vec4df::create(ndcX, ndcY, -1, 1));
+    if (eyeNear(3) == 0) {
+        return false;
+    }
+    auto eyeDir = vec4df::create(
+        eyeNear(0) / eyeNear(3),
+        eyeNear(1) / eyeNear(3),
+        eyeNear(2) / eyeNear(3),
+        0);
+
+    auto worldDir = mat4df::mul(invModelView, eyeDir);
+    auto worldEye = mat4df::mul(invModelView, vec4df::create(0, 0, 0, 1));
+
+    origin = vec3df::create(worldEye(0), worldEye(1), worldEye(2));
+    dir = vec3df::create(worldDir(0), worldDir(1), worldDir(2)).getUnit();
+    return true;
+}
+
+bool intersectEllipsoid(
+    const vec3df::Vec3Df& origin, const vec3df::Vec3Df& dir,
+    double equatorialRadius, double polarRadius,
+    vec3df::Vec3Df& hit) {
+
+    // Scale the ellipsoid to the unit sphere and solve |o + t d|^2 = 1.
+    double o[3] = {
+        origin(0) / equatorialRadius,
+        origin(1) / equatorialRadius,
+        origin(2) / polarRadius };
+    double d[3] = {
+        dir(0) / equatorialRadius,
+        dir(1) / equatorialRadius,
+        dir(2) / polarRadius };
+
+    double a = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+    double b = 2 * (o[0] * d[0] + o[1] * d[1] + o[2] * d[2]);
+    double c = o[0] * o[0] + o[1] * o[1] + o[2] * o[2] - 1;
+
+    double discriminant = b * b - 4 * a * c;
+    if (a == 0 || discriminant < 0) {
+        return false;
+    }
+
+    // numerically stable form of the quadratic formula
+    double q = -0.5 * (b + ((b < 0) ? -sqrt(discriminant) : sqrt(discriminant)));
+    double t0 = q / a;
+    double t1 = (q != 0) ? c / q : t0;
+    if (t0 > t1) {
+        double temp = t0;
+        t0 = t1;
+        t1 = temp;
+    }
+
+    double t = (t0 >= 0) ? t0 : t1;
+    if (t < 0) {
+        return false;
+    }
+
+    hit = vec3df::create(
+        (float)(origin(0) + t * dir(0)),
+        (float)(origin(1) + t * dir(1)),
+        (float)(origin(2) + t * dir(2)));
+    return true;
+}
+
+float radiansPerPixel(
+    float winX, float winY, float width, float height,
+    const mat4df::Mat4Df& modelView, const mat4df::Mat4Df& projection) {
+
+    vec3df::Vec3Df origin, dir1, dir2;
+    if (!unprojectRay(winX, winY, width, height, modelView, projection, origin, dir1) ||
+        !unprojectRay(winX + 1, winY, width, height, modelView, projection, origin, dir2)) {
+        return 0;
+    }
+
+    float chord = (dir1 - dir2).length();
+    return 2.0f * asinf(chord * 0.5f);
+}
+
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Matrix4Df.h"
+#include "Vec3Df.h"
+
+namespace picking {
+
+// Builds the world-space ray under a window position (pixels, y down).
+// The ray starts at the eye, which is the inverse model view's origin.
+bool unprojectRay(
+    float winX, float winY, float width, float height,
+    const mat4df::Mat4Df& modelView, const mat4df::Mat4Df& projection,
+    vec3df::Vec3Df& origin, vec3df::Vec3Df& dir);
+
+// Nearest intersection of a ray with an origin-centered ellipsoid of
+// revolution about the z axis.
+bool intersectEllipsoid(
+    const vec3df::Vec3Df& origin, const vec3df::Vec3Df& dir,
+    double equatorialRadius, double polarRadius,
+    vec3df::Vec3Df& hit);
+
+// The angle, in radians, covered by one pixel at a window position.
+float radiansPerPixel(
+    float winX, float winY, float width, float height,
+    const mat4df::Mat4Df& modelView, const mat4df::Mat4Df& projection);
+
+}
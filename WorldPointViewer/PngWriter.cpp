@@ -0,0 +1,437 @@
+#include "PngWriter.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+    // PNG's chunk checksum, the CRC-32 of ISO 3309
+    class CrcTable {
+    public:
+        CrcTable() {
+            for (unsigned int n = 0; n < 256; n++) {
+                unsigned int c = n;
+                for (int k = 0; k < 8; k++) {
+                    c = (c & 1) ? (0xedb88320u ^ (c >> 1)) : (c >> 1);
+                }
+                m_table[n] = c;
+            }
+        }
+
+        unsigned int update(unsigned int crc, const unsigned char* data, size_t size) const {
+            crc = ~crc;
+            for (size_t i = 0; i < size; i++) {
+                crc = m_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+            }
+            return ~crc;
+        }
+
+    protected:
+        unsigned int m_table[256];
+    };
+
+    // filled before main, so the encoding threads never race to build it
+    const CrcTable CRC_TABLE;
+
+    // zlib's checksum of the uncompressed data
+    unsigned int adler32(const unsigned char* data, size_t size) {
+        unsigned int a = 1;
+        unsigned int b = 0;
+        while (size > 0) {
+            // the most bytes that can be summed before b overflows
+            size_t block = std::min(size, (size_t)5552);
+            size -= block;
+            while (block-- > 0) {
+                a += *data++;
+                b += a;
+            }
+            a %= 65521;
+            b %= 65521;
+        }
+        return (b << 16) | a;
+    }
+
+    void putBE(unsigned char* dest, unsigned int value) {
+        dest[0] = (unsigned char)(value >> 24);
+        dest[1] = (unsigned char)(value >> 16);
+        dest[2] = (unsigned char)(value >> 8);
+        dest[3] = (unsigned char)value;
+    }
+
+    // Deflate's bit stream: values go in least significant bit first, but
+    // Huffman codes most significant bit first.
+    class BitWriter {
+    public:
+        BitWriter(std::vector<unsigned char>& out) :
+            m_out(out),
+            m_bits(0),
+            m_count(0) {
+        }
+
+        void write(unsigned int value, int count) {
+            m_bits |= value << m_count;
+            m_count += count;
+            while (m_count >= 8) {
+                m_out.push_back((unsigned char)m_bits);
+                m_bits >>= 8;
+                m_count -= 8;
+            }
+        }
+
+        void writeCode(unsigned int code, int length) {
+            unsigned int reversed = 0;
+            for (int i = 0; i < length; i++) {
+                reversed = (reversed << 1) | ((code >> i) & 1);
+            }
+            write(reversed, length);
+        }
+
+        // pads the last byte with zeros
+        void flush() {
+            if (m_count > 0) {
+                m_out.push_back((unsigned char)m_bits);
+            }
+            m_bits = 0;
+            m_count = 0;
+        }
+
+    protected:
+        std::vector<unsigned char>& m_out;
+        unsigned int m_bits;
+        int m_count;
+    };
+
+    // the first length and distance of each deflate code, and how many
+    // extra bits follow it
+    const int LENGTH_BASE[] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+    };
+    const int LENGTH_EXTRA[] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+    };
+    const int DISTANCE_BASE[] = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+    };
+    const int DISTANCE_EXTRA[] = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+    };
+    const int LENGTH_CODES = sizeof(LENGTH_BASE) / sizeof(LENGTH_BASE[0]);
+    const int DISTANCE_CODES = sizeof(DISTANCE_BASE) / sizeof(DISTANCE_BASE[0]);
+
+    // a literal byte, a length code or the end of the block, in deflate's
+    // fixed Huffman code
+    void writeSymbol(BitWriter& bits, int symbol) {
+        if (symbol < 144) {
+            bits.writeCode(0x30 + symbol, 8);
+        }
+        else if (symbol < 256) {
+            bits.writeCode(0x190 + symbol - 144, 9);
+        }
+        else if (symbol < 280) {
+            bits.writeCode(symbol - 256, 7);
+        }
+        else {
+            bits.writeCode(0xc0 + symbol - 280, 8);
+        }
+    }
+
+    void writeMatch(BitWriter& bits, int length, int distance) {
+        int code = 0;
+        while (code + 1 < LENGTH_CODES && LENGTH_BASE[code + 1] <= length) {
+            code++;
+        }
+        writeSymbol(bits, 257 + code);
+        bits.write(length - LENGTH_BASE[code], LENGTH_EXTRA[code]);
+
+        code = 0;
+        while (code + 1 < DISTANCE_CODES && DISTANCE_BASE[code + 1] <= distance) {
+            code++;
+        }
+        bits.writeCode(code, 5);
+        bits.write(distance - DISTANCE_BASE[code], DISTANCE_EXTRA[code]);
+    }
+
+    // Compresses data into a zlib stream of one deflate block with the
+    // fixed Huffman codes, finding matches through hash chains. zlib's
+    // dynamic codes would do a little better, but rendered frames are
+    // mostly long runs of a few colors, which the matching alone catches.
+    void deflate(const std::vector<unsigned char>& data, std::vector<unsigned char>& out) {
+        const int WINDOW_SIZE = 32768;
+        const int MIN_MATCH = 3;
+        const int MAX_MATCH = 258;
+        const int HASH_BITS = 15;
+        // earlier positions tried for each match; more is smaller and slower
+        const int MAX_CHAIN = 16;
+
+        // 32K window, no preset dictionary; the pair is a multiple of 31
+        out.push_back(0x78);
+        out.push_back(0x01);
+
+        BitWriter bits(out);
+        // the final block, with the fixed codes
+        bits.write(1, 1);
+        bits.write(1, 2);
+
+        // head holds the last position with each hash, and prev the one
+        // before each position, so together they chain the positions that
+        // may match, newest first
+        const size_t SIZE = data.size();
+        std::vector<int> head(1 << HASH_BITS, -1);
+        std::vector<int> prev(WINDOW_SIZE, -1);
+        auto hash = [&](size_t i) {
+            return ((data[i] << 10) ^ (data[i + 1] << 5) ^ data[i + 2]) & ((1 << HASH_BITS) - 1);
+        };
+        auto insert = [&](size_t i) {
+            if (i + MIN_MATCH <= SIZE) {
+                int h = hash(i);
+                prev[i & (WINDOW_SIZE - 1)] = head[h];
+                head[h] = (int)i;
+            }
+        };
+
+        size_t i = 0;
+        while (i < SIZE) {
+            int bestLength = 0;
+            int bestDistance = 0;
+            if (i + MIN_MATCH <= SIZE) {
+                const int MAX_LENGTH = (int)std::min((size_t)MAX_MATCH, SIZE - i);
+                int candidate = head[hash(i)];
+                for (int chain = 0; chain < MAX_CHAIN && candidate >= 0 &&
+                    (int)i - candidate <= WINDOW_SIZE; chain++) {
+
+                    int length = 0;
+                    while (length < MAX_LENGTH && data[candidate + length] == data[i + length]) {
+                        length++;
+                    }
+                    if (length > bestLength) {
+                        bestLength = length;
+                        bestDistance = (int)i - candidate;
+                        if (length == MAX_LENGTH) {
+                            break;
+                        }
+                    }
+
+                    int next = prev[candidate & (WINDOW_SIZE - 1)];
+                    if (next >= candidate) {
+                        break;
+                    }
+                    candidate = next;
+                }
+            }
+
+            if (bestLength >= MIN_MATCH) {
+                writeMatch(bits, bestLength, bestDistance);
+                for (int k = 0; k < bestLength; k++) {
+                    insert(i + k);
+                }
+                i += bestLength;
+            }
+            else {
+                writeSymbol(bits, data[i]);
+                insert(i);
+                i++;
+            }
+        }
+        writeSymbol(bits, 256);
+        bits.flush();
+
+        unsigned char checksum[4];
+        putBE(checksum, adler32(data.data(), SIZE));
+        out.insert(out.end(), checksum, checksum + 4);
+    }
+
+    int paeth(int a, int b, int c) {
+        int p = a + b - c;
+        int pa = abs(p - a);
+        int pb = abs(p - b);
+        int pc = abs(p - c);
+        if (pa <= pb && pa <= pc) {
+            return a;
+        }
+        return (pb <= pc) ? b : c;
+    }
+
+    // Turns bottom-up BGRA pixels into PNG's top-down RGB rows, each led
+    // by its filter type. A row gets whichever of the five filters leaves
+    // the smallest sum of absolute differences, as the PNG spec suggests.
+    void filterRows(int width, int height, const unsigned char* pixels, std::vector<unsigned char>& out) {
+        const int FILTER_COUNT = 5;
+        const size_t ROW_BYTES = (size_t)width * 3;
+
+        std::vector<unsigned char> row(ROW_BYTES);
+        std::vector<unsigned char> above(ROW_BYTES, 0);
+        std::vector<unsigned char> filtered[FILTER_COUNT];
+        for (int f = 0; f < FILTER_COUNT; f++) {
+            filtered[f].resize(ROW_BYTES);
+        }
+
+        for (int y = 0; y < height; y++) {
+            const unsigned char* source = pixels + (size_t)(height - 1 - y) * width * 4;
+            for (int x = 0; x < width; x++) {
+                row[x * 3] = source[x * 4 + 2];
+                row[x * 3 + 1] = source[x * 4 + 1];
+                row[x * 3 + 2] = source[x * 4];
+            }
+
+            int bestFilter = 0;
+            unsigned long long bestSum = ~0ull;
+            for (int f = 0; f < FILTER_COUNT; f++) {
+                unsigned long long sum = 0;
+                for (size_t i = 0; i < ROW_BYTES; i++) {
+                    int left = (i >= 3) ? row[i - 3] : 0;
+                    int up = above[i];
+                    int upLeft = (i >= 3) ? above[i - 3] : 0;
+                    int predicted =
+                        (f == 1) ? left :
+                        (f == 2) ? up :
+                        (f == 3) ? (left + up) / 2 :
+                        (f == 4) ? paeth(left, up, upLeft) : 0;
+                    unsigned char value = (unsigned char)(row[i] - predicted);
+                    filtered[f][i] = value;
+                    sum += (value < 128) ? value : 256 - value;
+                }
+                if (sum < bestSum) {
+                    bestSum = sum;
+                    bestFilter = f;
+                }
+            }
+
+            out.push_back((unsigned char)bestFilter);
+            out.insert(out.end(), filtered[bestFilter].begin(), filtered[bestFilter].end());
+            above.swap(row);
+        }
+    }
+
+    bool writeChunk(FILE* file, const char* type, const unsigned char* data, size_t size) {
+        unsigned char length[4];
+        putBE(length, (unsigned int)size);
+        unsigned int crc = CRC_TABLE.update(0, (const unsigned char*)type, 4);
+        crc = CRC_TABLE.update(crc, data, size);
+        unsigned char checksum[4];
+        putBE(checksum, crc);
+
+        return fwrite(length, 4, 1, file) == 1 &&
+            fwrite(type, 4, 1, file) == 1 &&
+            (size == 0 || fwrite(data, size, 1, file) == 1) &&
+            fwrite(checksum, 4, 1, file) == 1;
+    }
+}
+
+PngWriter::PngWriter(unsigned int threadCount, unsigned int maxQueued) :
+    m_maxQueued(std::max(1u, maxQueued)),
+    m_finishing(false),
+    m_written(0),
+    m_failed(0)
+{
+    if (threadCount == 0) {
+        unsigned int hardwareThreads = std::thread::hardware_concurrency();
+        threadCount = (hardwareThreads > 1) ?
+            std::min(hardwareThreads - 1, (unsigned int)MAX_AUTO_THREADS) : 1;
+    }
+    for (unsigned int i = 0; i < threadCount; i++) {
+        m_workers.push_back(std::thread([this]() { workerLoop(); }));
+    }
+}
+
+PngWriter::~PngWriter()
+{
+    finish();
+}
+
+void PngWriter::write(
+    const std::string& filename, int width, int height, std::vector<unsigned char>& pixels) {
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_queueChanged.wait(lock, [this]() { return m_queue.size() < m_maxQueued; });
+
+    m_queue.push_back(Frame());
+    Frame& frame = m_queue.back();
+    frame.filename = filename;
+    frame.width = width;
+    frame.height = height;
+    frame.pixels.swap(pixels);
+
+    m_queueChanged.notify_all();
+}
+
+void PngWriter::finish() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_finishing = true;
+    }
+    m_queueChanged.notify_all();
+
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+    m_workers.clear();
+}
+
+void PngWriter::workerLoop() {
+    while (true) {
+        Frame frame;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_queueChanged.wait(lock, [this]() { return !m_queue.empty() || m_finishing; });
+            if (m_queue.empty()) {
+                return;
+            }
+            frame = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+        m_queueChanged.notify_all();
+
+        bool ok = encode(frame.filename, frame.width, frame.height, frame.pixels.data());
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (ok) {
+            m_written++;
+        }
+        else {
+            m_failed++;
+        }
+    }
+}
+
+unsigned int PngWriter::getWrittenCount() const {
+    return m_written;
+}
+
+unsigned int PngWriter::getFailedCount() const {
+    return m_failed;
+}
+
+bool PngWriter::encode(
+    const std::string& filename, int width, int height, const unsigned char* pixels) {
+
+    std::vector<unsigned char> rows;
+    rows.reserve(((size_t)width * 3 + 1) * height);
+    filterRows(width, height, pixels, rows);
+
+    std::vector<unsigned char> compressed;
+    compressed.reserve(rows.size() / 4);
+    deflate(rows, compressed);
+
+    // 8 bits per channel, RGB, deflate, adaptive filters, not interlaced
+    unsigned char header[13] = {};
+    putBE(header, width);
+    putBE(header + 4, height);
+    header[8] = 8;
+    header[9] = 2;
+
+    FILE* file = fopen(filename.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+
+    const unsigned char SIGNATURE[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    bool ok = fwrite(SIGNATURE, sizeof(SIGNATURE), 1, file) == 1 &&
+        writeChunk(file, "IHDR", header, sizeof(header)) &&
+        writeChunk(file, "IDAT", compressed.data(), compressed.size()) &&
+        writeChunk(file, "IEND", nullptr, 0);
+    return (fclose(file) == 0) && ok;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Encodes frames to PNG files on a pool of worker threads, so the thread
+// that owns the GL context can go on to the next frame while the last one
+// is compressed. The encoder is built in, so it needs no image library on
+// any platform; it favors speed over the smallest file.
+class PngWriter
+{
+public:
+    // threadCount 0 picks one per hardware thread but one, to leave the
+    // drawing thread and the driver a core, and at most MAX_AUTO_THREADS.
+    // write() blocks while maxQueued frames are waiting, to bound the
+    // memory held.
+    static const unsigned int MAX_AUTO_THREADS = 4;
+
+    PngWriter(unsigned int threadCount = 0, unsigned int maxQueued = 8);
+    ~PngWriter();
+
+    // Queues bottom-up BGRA pixels, as OffscreenTarget reads them, to be
+    // written to filename. The pixels are moved out of the vector.
+    void write(const std::string& filename, int width, int height, std::vector<unsigned char>& pixels);
+
+    // Waits for every queued frame to be written and stops the workers.
+    void finish();
+
+    unsigned int getWrittenCount() const;
+    unsigned int getFailedCount() const;
+
+    // Writes one frame on the calling thread.
+    static bool encode(const std::string& filename, int width, int height, const unsigned char* pixels);
+
+protected:
+    struct Frame {
+        std::string filename;
+        int width;
+        int height;
+        std::vector<unsigned char> pixels;
+    };
+
+    void workerLoop();
+
+    unsigned int m_maxQueued;
+    std::vector<std::thread> m_workers;
+
+    std::mutex m_mutex;
+    std::condition_variable m_queueChanged;
+    std::deque<Frame> m_queue;
+    bool m_finishing;
+
+    unsigned int m_written;
+    unsigned int m_failed;
+};
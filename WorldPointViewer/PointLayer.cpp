@@ -0,0 +1,132 @@
+#include "PointLayer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <utility>
+
+#include "SphereIndex.h"
+#include "Utils.h"
+
+PointLayer::PointLayer(Color color, float pointSize, bool roundPoints) :
+    LineLayer(color),
+    m_pointSize(pointSize),
+    m_roundPoints(roundPoints),
+    m_pointBudget(0),
+    m_drawnPointCount(0)
+{
+}
+
+PointLayer::~PointLayer()
+{
+}
+
+void PointLayer::addPoints(const std::vector<vec3dd::Vec3Dd>& points) {
+    for (auto& p : points) {
+        float high[3], low[3];
+        for (int c = 0; c < 3; c++) {
+            splitDouble(p(c), high[c], low[c]);
+        }
+        pushCoord3d(high[0], high[1], high[2], m_coords);
+        pushCoord3d(low[0], low[1], low[2], m_coordsLow);
+    }
+    m_version++;
+}
+
+void PointLayer::upload() {
+    sortIntoChunks();
+    LineLayer::upload();
+}
+
+void PointLayer::sortIntoChunks() {
+    const unsigned int POINT_COUNT = getPointCount();
+
+    std::vector<std::pair<unsigned long long, unsigned int> > keys(POINT_COUNT);
+    for (unsigned int i = 0; i < POINT_COUNT; i++) {
+        const GLfloat* p = &m_coords[i * 3];
+        keys[i].first = SphereIndex::cellIdFor(p[0], p[1], p[2]);
+        keys[i].second = i;
+    }
+    std::sort(keys.begin(), keys.end());
+
+    m_starts.clear();
+    m_counts.clear();
+    for (unsigned int start = 0; start < POINT_COUNT; start += CHUNK_SIZE) {
+        unsigned int count = (POINT_COUNT - start < CHUNK_SIZE) ?
+            (POINT_COUNT - start) : CHUNK_SIZE;
+        m_starts.push_back((GLint)start);
+        m_counts.push_back((GLsizei)count);
+
+        // fixed seed, so a layer always thins the same way
+        std::minstd_rand random(start);
+        for (unsigned int i = count - 1; i > 0; i--) {
+            unsigned int j = random() % (i + 1);
+            std::swap(keys[start + i], keys[start + j]);
+        }
+    }
+
+    std::vector<GLfloat> coords(m_coords.size());
+    std::vector<GLfloat> coordsLow(m_coordsLow.size());
+    for (unsigned int i = 0; i < POINT_COUNT; i++) {
+        const unsigned int FROM = keys[i].second * 3;
+        for (int c = 0; c < 3; c++) {
+            coords[i * 3 + c] = m_coords[FROM + c];
+            coordsLow[i * 3 + c] = m_coordsLow[FROM + c];
+        }
+    }
+    m_coords.swap(coords);
+    m_coordsLow.swap(coordsLow);
+}
+
+void PointLayer::cullViews(const Frustum* frusta, unsigned int viewCount) {
+    if (!m_ready) {
+        return;
+    }
+    LineLayer::cullViews(frusta, viewCount);
+
+    unsigned long long drawnPoints = 0;
+    for (unsigned int v = 0; v < std::min(viewCount, MAX_VIEWS); v++) {
+        std::vector<GLsizei>& counts = m_drawLists[v].counts;
+
+        unsigned long long visiblePoints = 0;
+        for (auto count : counts) {
+            visiblePoints += count;
+        }
+
+        if (m_pointBudget > 0 && visiblePoints > m_pointBudget) {
+            double fraction = (double)m_pointBudget / (double)visiblePoints;
+            visiblePoints = 0;
+            for (auto& count : counts) {
+                count = std::max((GLsizei)1, (GLsizei)ceil(count * fraction));
+                visiblePoints += count;
+            }
+        }
+        drawnPoints += visiblePoints;
+    }
+
+    m_drawnPointCount = (unsigned int)drawnPoints;
+}
+
+void PointLayer::submit(RenderQueue& queue, unsigned int view) {
+    if (!m_ready || view >= MAX_VIEWS) {
+        return;
+    }
+
+    const DrawList& list = m_drawLists[view];
+    auto item = RenderQueue::makeItem(m_program, m_vao, GL_POINTS, m_color);
+    item.params[0] = m_pointSize;
+    item.params[1] = m_roundPoints ? 1.0f : 0.0f;
+    item.paramCount = 2;
+    item.starts = list.starts.data();
+    item.counts = list.counts.data();
+    item.drawCount = (GLsizei)list.starts.size();
+    queue.submit(item);
+}
+
+void PointLayer::setPointBudget(unsigned int budget) {
+    m_pointBudget = budget;
+}
+
+unsigned int PointLayer::getDrawnPointCount() const {
+    return m_drawnPointCount;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+
+#include "LineLayer.h"
+
+// A layer of unconnected points drawn as GL_POINTS. It reuses LineLayer's
+// buffer, bounds and culling, with each "polyline" being a chunk of up to
+// CHUNK_SIZE points. upload() sorts the points by cell id, so each chunk
+// covers a small patch of the globe and culls well, and shuffles each
+// chunk, so any prefix of it is an even thinning of the whole.
+class PointLayer :
+    public LineLayer
+{
+public:
+    static const unsigned int CHUNK_SIZE = 4096;
+
+    // pointSize is the diameter in pixels at one earth radius from the eye
+    PointLayer(Color color, float pointSize, bool roundPoints);
+    virtual ~PointLayer();
+
+    void addPoints(const std::vector<vec3dd::Vec3Dd>& points);
+
+    virtual void upload();
+    virtual void cullViews(const Frustum* frusta, unsigned int viewCount);
+    virtual void submit(RenderQueue& queue, unsigned int view = 0);
+
+    // Caps the points drawn per frame. When more are visible, every visible
+    // chunk draws the same fraction of its points. 0 means no cap. With
+    // several views each gets the whole budget.
+    void setPointBudget(unsigned int budget);
+    unsigned int getDrawnPointCount() const;
+
+protected:
+    void sortIntoChunks();
+
+    float m_pointSize;
+    bool m_roundPoints;
+    unsigned int m_pointBudget;
+    unsigned int m_drawnPointCount;
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+// A read-only view of a layer's polylines as used by the CPU-side spatial
+// and analysis code. Points are packed x, y, z floats; polyline i covers
+// points [starts[i], starts[i] + counts[i]).
+struct PolylineSet {
+    const float* coords;
+    const int* starts;
+    const int* counts;
+    unsigned int polylineCount;
+    unsigned int pointCount;
+
+    PolylineSet() :
+        coords(nullptr),
+        starts(nullptr),
+        counts(nullptr),
+        polylineCount(0),
+        pointCount(0) {
+    }
+
+    // Returns the polyline that owns the given point index.
+    unsigned int findPolyline(unsigned int point) const {
+        unsigned int lo = 0;
+        unsigned int hi = polylineCount;
+        while (hi - lo > 1) {
+            unsigned int mid = (lo + hi) / 2;
+            if ((unsigned int)starts[mid] <= point) {
+                lo = mid;
+            }
+            else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+};
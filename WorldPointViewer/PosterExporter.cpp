@@ -0,0 +1,193 @@
+#include "PosterExporter.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "FileUtils.h"
+#include "Projection.h"
+
+namespace {
+    const int BMP_HEADER_SIZE = 54;
+    const int BYTES_PER_PIXEL = 3;
+
+    void putLE(unsigned char* dest, unsigned int value, int bytes) {
+        for (int i = 0; i < bytes; i++) {
+            dest[i] = (unsigned char)(value >> (8 * i));
+        }
+    }
+}
+
+PosterExporter::PosterExporter(int tileSize) :
+    m_tileSize(tileSize),
+    m_width(0),
+    m_height(0),
+    m_rowSize(0),
+    m_file(nullptr)
+{
+    m_pbos[0] = 0;
+    m_pbos[1] = 0;
+}
+
+PosterExporter::~PosterExporter()
+{
+}
+
+bool PosterExporter::exportImage(
+    const char* filename, int width, int height,
+    const mat4df::Mat4Df& projection, DrawFunc draw) {
+
+    m_width = width;
+    m_height = height;
+    // BMP rows are padded to four bytes
+    m_rowSize = ((long long)width * BYTES_PER_PIXEL + 3) & ~3LL;
+
+    // BMP sizes are 32 bit
+    if (BMP_HEADER_SIZE + m_rowSize * height > 0xffffffffLL) {
+        printf("%d x %d is too big for a BMP file\n", width, height);
+        return false;
+    }
+
+    m_file = fopen(filename, "wb");
+    if (!m_file) {
+        printf("can't open %s\n", filename);
+        return false;
+    }
+
+    if (!writeHeader() || !setup()) {
+        cleanup();
+        return false;
+    }
+
+    std::vector<Tile> tiles;
+    for (int y = 0; y < height; y += m_tileSize) {
+        for (int x = 0; x < width; x += m_tileSize) {
+            Tile tile;
+            tile.x = x;
+            tile.y = y;
+            tile.width = std::min(m_tileSize, width - x);
+            tile.height = std::min(m_tileSize, height - y);
+            tiles.push_back(tile);
+        }
+    }
+
+    // Tile i is read into m_pbos[i % 2] and written out after tile i + 1
+    // has been drawn, so the copy has had a whole tile's drawing to finish.
+    bool ok = true;
+    for (size_t i = 0; i < tiles.size() && ok; i++) {
+        const Tile& tile = tiles[i];
+
+        m_target.bind();
+        glViewport(0, 0, tile.width, tile.height);
+        draw(projection::createSubProjection(projection,
+            2.0f * tile.x / width - 1.0f,
+            2.0f * tile.y / height - 1.0f,
+            2.0f * (tile.x + tile.width) / width - 1.0f,
+            2.0f * (tile.y + tile.height) / height - 1.0f));
+
+        readTile(tile, m_pbos[i % 2]);
+
+        if (i > 0) {
+            ok = writeTile(tiles[i - 1], m_pbos[(i - 1) % 2]);
+        }
+    }
+    if (ok && !tiles.empty()) {
+        ok = writeTile(tiles.back(), m_pbos[(tiles.size() - 1) % 2]);
+    }
+
+    m_target.unbind();
+    cleanup();
+
+    if (!ok) {
+        printf("failed writing %s\n", filename);
+    }
+    return ok;
+}
+
+bool PosterExporter::setup() {
+    GLint maxRenderbufferSize = 0;
+    glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxRenderbufferSize);
+    GLint maxViewport[2] = { 0, 0 };
+    glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxViewport);
+    m_tileSize = std::min(m_tileSize,
+        (int)std::min(maxRenderbufferSize, std::min(maxViewport[0], maxViewport[1])));
+
+    if (!m_target.setup(m_tileSize, m_tileSize)) {
+        return false;
+    }
+
+    const GLsizeiptr TILE_BYTES = (GLsizeiptr)m_tileSize * m_tileSize * BYTES_PER_PIXEL;
+    glGenBuffers(2, m_pbos);
+    for (int i = 0; i < 2; i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbos[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, TILE_BYTES, nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return true;
+}
+
+void PosterExporter::cleanup() {
+    m_target.cleanup();
+
+    glDeleteBuffers(2, m_pbos);
+    m_pbos[0] = 0;
+    m_pbos[1] = 0;
+
+    if (m_file) {
+        fclose(m_file);
+        m_file = nullptr;
+    }
+}
+
+bool PosterExporter::writeHeader() {
+    const unsigned int IMAGE_SIZE = (unsigned int)(m_rowSize * m_height);
+
+    // BITMAPFILEHEADER then BITMAPINFOHEADER. A positive height makes the
+    // rows bottom-up, the same order glReadPixels returns them in.
+    unsigned char header[BMP_HEADER_SIZE] = { 'B', 'M' };
+    putLE(header + 2, BMP_HEADER_SIZE + IMAGE_SIZE, 4);
+    putLE(header + 10, BMP_HEADER_SIZE, 4);
+    putLE(header + 14, 40, 4);
+    putLE(header + 18, m_width, 4);
+    putLE(header + 22, m_height, 4);
+    putLE(header + 26, 1, 2);
+    putLE(header + 28, BYTES_PER_PIXEL * 8, 2);
+    putLE(header + 34, IMAGE_SIZE, 4);
+    if (fwrite(header, sizeof(header), 1, m_file) != 1) {
+        return false;
+    }
+
+    // Size the file up front so every tile row can be written in place.
+    if (seekFile(m_file, BMP_HEADER_SIZE + (long long)IMAGE_SIZE - 1, SEEK_SET) != 0) {
+        return false;
+    }
+    return fputc(0, m_file) != EOF;
+}
+
+void PosterExporter::readTile(const Tile& tile, GLuint pbo) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, tile.width, tile.height, GL_BGR, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+bool PosterExporter::writeTile(const Tile& tile, GLuint pbo) {
+    const GLsizeiptr TILE_ROW_BYTES = (GLsizeiptr)tile.width * BYTES_PER_PIXEL;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    const unsigned char* pixels = (const unsigned char*)glMapBufferRange(
+        GL_PIXEL_PACK_BUFFER, 0, TILE_ROW_BYTES * tile.height, GL_MAP_READ_BIT);
+
+    bool ok = pixels != nullptr;
+    for (int row = 0; row < tile.height && ok; row++) {
+        long long offset = BMP_HEADER_SIZE + (tile.y + row) * m_rowSize +
+            (long long)tile.x * BYTES_PER_PIXEL;
+        ok = seekFile(m_file, offset, SEEK_SET) == 0 &&
+            fwrite(pixels + row * TILE_ROW_BYTES, TILE_ROW_BYTES, 1, m_file) == 1;
+    }
+
+    if (pixels) {
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return ok;
+}
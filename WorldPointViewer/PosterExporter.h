@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdio>
+#include <functional>
+
+#include <GL/glew.h>
+
+#include "Matrix4Df.h"
+#include "OffscreenTarget.h"
+
+// Renders images bigger than any framebuffer by splitting the view into
+// tiles, each drawn offscreen with an off-center projection. Tiles are
+// written straight into place in an uncompressed BMP file, so only a tile
+// or two are ever in memory. Each tile is read back into one of two pixel
+// pack buffers while the next one draws.
+class PosterExporter
+{
+public:
+    // Draws the scene with the given projection into the bound framebuffer.
+    typedef std::function<void(const mat4df::Mat4Df& projection)> DrawFunc;
+
+    // tileSize is capped at what the driver's renderbuffers allow
+    PosterExporter(int tileSize = 4096);
+    ~PosterExporter();
+
+    // projection is for the whole width x height image. Leaves the
+    // window's framebuffer bound; the caller restores its viewport.
+    bool exportImage(
+        const char* filename, int width, int height,
+        const mat4df::Mat4Df& projection, DrawFunc draw);
+
+protected:
+    struct Tile {
+        int x;
+        int y;
+        int width;
+        int height;
+    };
+
+    bool setup();
+    void cleanup();
+
+    bool writeHeader();
+    void readTile(const Tile& tile, GLuint pbo);
+    bool writeTile(const Tile& tile, GLuint pbo);
+
+    int m_tileSize;
+    int m_width;
+    int m_height;
+    long long m_rowSize;
+
+    OffscreenTarget m_target;
+    GLuint m_pbos[2];
+
+    FILE* m_file;
+};
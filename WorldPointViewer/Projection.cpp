@@ -89,4 +89,18 @@ mat4df::Mat4Df createPerspective(
     return mat;
 }
 
+mat4df::Mat4Df createSubProjection(
+    const mat4df::Mat4Df& projection, float left, float bottom, float right, float top) {
+
+    // scales and shifts clip space x and y, in units of w
+    mat4df::Mat4Df crop;
+    crop.setIdentity();
+    crop(0, 0) = 2.0f / (right - left);
+    crop(3, 0) = -(right + left) / (right - left);
+    crop(1, 1) = 2.0f / (top - bottom);
+    crop(3, 1) = -(top + bottom) / (top - bottom);
+
+    return crop * projection;
+}
+
 }
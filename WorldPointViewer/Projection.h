@@ -14,6 +14,13 @@ mat4df::Mat4Df createLookAt(
 mat4df::Mat4Df createPerspective(
     float fov_x, float width, float height, float near_dist, float far_dist);
 
+// Narrows a projection to the part of its view that falls in the given
+// normalized device coordinate bounds, which then fill the viewport. Depth
+// and w are left alone, so a tile drawn with it matches the same region of
+// a full frame.
+mat4df::Mat4Df createSubProjection(
+    const mat4df::Mat4Df& projection, float left, float bottom, float right, float top);
+
 //mat4df::Mat4Df createOrtho(
 //    float left, float top, float right, float bottom, float near_dist, float far_dist);
 
@@ -0,0 +1,205 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+
+RenderQueue::RenderQueue() :
+    m_program(0),
+    m_vao(0),
+    m_texture(0),
+    m_blend(-1)
+{
+    m_stats.drawCalls = 0;
+    m_stats.stateChanges = 0;
+    m_stats.uniformBytes = 0;
+}
+
+RenderQueue::~RenderQueue()
+{
+}
+
+RenderQueue::DrawItem RenderQueue::makeItem(
+    GLuint program, GLuint vao, GLenum mode, Color color) {
+
+    DrawItem item;
+    item.pass = PASS_SCENE;
+    item.blend = BLEND_ALPHA;
+    item.program = program;
+    item.vao = vao;
+    item.texture = 0;
+    item.textureTarget = GL_TEXTURE_2D;
+    item.color = color;
+    item.paramCount = 0;
+    item.mode = mode;
+    item.first = 0;
+    item.count = 0;
+    item.starts = nullptr;
+    item.counts = nullptr;
+    item.drawCount = 0;
+    item.instanceCount = 0;
+    return item;
+}
+
+void RenderQueue::submit(const DrawItem& item) {
+    if (item.starts ? (item.drawCount == 0) : (item.count == 0)) {
+        return;
+    }
+    m_items.push_back(item);
+}
+
+void RenderQueue::setPassCallback(PassCallback callback) {
+    m_passCallback = callback;
+}
+
+void RenderQueue::flush() {
+    m_stats.drawCalls = 0;
+    m_stats.stateChanges = 0;
+    m_stats.uniformBytes = 0;
+
+    // pass | blend | program | vao, with GL names assumed to fit in 24 bits
+    const unsigned long long NAME_MASK = 0xffffff;
+    m_keys.resize(m_items.size());
+    m_order.resize(m_items.size());
+    for (size_t i = 0; i < m_items.size(); i++) {
+        const DrawItem& item = m_items[i];
+        m_keys[i] =
+            ((unsigned long long)item.pass << 56) |
+            ((unsigned long long)item.blend << 48) |
+            ((item.program & NAME_MASK) << 24) |
+            (item.vao & NAME_MASK);
+        m_order[i] = (unsigned int)i;
+    }
+
+    // stable, so items with the same state keep their submission order
+    std::stable_sort(m_order.begin(), m_order.end(),
+        [&](unsigned int a, unsigned int b) { return m_keys[a] < m_keys[b]; });
+
+    int pass = -1;
+    for (auto idx : m_order) {
+        const DrawItem& item = m_items[idx];
+
+        if (item.pass != pass) {
+            pass = item.pass;
+            if (m_passCallback) {
+                m_passCallback(pass);
+            }
+        }
+
+        if (item.blend != m_blend) {
+            if (item.blend == BLEND_ALPHA) {
+                glEnable(GL_BLEND);
+                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            }
+            else {
+                glDisable(GL_BLEND);
+            }
+            GLboolean colorWrite = item.blend != BLEND_DEPTH_ONLY;
+            glColorMask(colorWrite, colorWrite, colorWrite, colorWrite);
+            m_blend = item.blend;
+            m_stats.stateChanges++;
+        }
+
+        if (item.program != m_program) {
+            glUseProgram(item.program);
+            m_program = item.program;
+            m_stats.stateChanges++;
+        }
+
+        if (item.vao != m_vao) {
+            glBindVertexArray(item.vao);
+            m_vao = item.vao;
+            m_stats.stateChanges++;
+        }
+
+        if (item.texture && item.texture != m_texture) {
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(item.textureTarget, item.texture);
+            m_texture = item.texture;
+            m_stats.stateChanges++;
+        }
+
+        // depth-only programs have no color to set
+        if (item.blend != BLEND_DEPTH_ONLY) {
+            applyUniforms(item);
+        }
+
+        if (item.starts) {
+            glMultiDrawArrays(item.mode, item.starts, item.counts, item.drawCount);
+        }
+        else if (item.instanceCount) {
+            glDrawArraysInstanced(item.mode, item.first, item.count, item.instanceCount);
+        }
+        else {
+            glDrawArrays(item.mode, item.first, item.count);
+        }
+        m_stats.drawCalls++;
+    }
+
+    if (m_passCallback && pass >= 0) {
+        m_passCallback(PASS_COUNT);
+    }
+
+    // glClear honors the color mask, so don't leave it off
+    if (m_blend == BLEND_DEPTH_ONLY) {
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        m_blend = -1;
+    }
+
+    m_items.clear();
+}
+
+void RenderQueue::applyUniforms(const DrawItem& item) {
+    const GLuint PROG4_COLOR_LOC = 0;
+    const GLuint FIRST_PARAM_LOC = 2;
+
+    ProgramUniforms* uniforms = nullptr;
+    for (auto& u : m_uniforms) {
+        if (u.program == item.program) {
+            uniforms = &u;
+            break;
+        }
+    }
+
+    bool setColor = true;
+    if (uniforms) {
+        const Color& c = uniforms->color;
+        setColor = c.r != item.color.r || c.g != item.color.g ||
+            c.b != item.color.b || c.a != item.color.a;
+    }
+    else {
+        m_uniforms.push_back(ProgramUniforms());
+        uniforms = &m_uniforms.back();
+        uniforms->program = item.program;
+        uniforms->paramCount = 0;
+    }
+
+    if (setColor) {
+        glUniform4f(PROG4_COLOR_LOC,
+            (float)item.color.r / 255.0f,
+            (float)item.color.g / 255.0f,
+            (float)item.color.b / 255.0f,
+            (float)item.color.a / 255.0f);
+        uniforms->color = item.color;
+        m_stats.uniformBytes += 4 * sizeof(GLfloat);
+    }
+
+    for (unsigned int i = 0; i < item.paramCount; i++) {
+        if (i < uniforms->paramCount && uniforms->params[i] == item.params[i]) {
+            continue;
+        }
+        glUniform1f(FIRST_PARAM_LOC + i, item.params[i]);
+        uniforms->params[i] = item.params[i];
+        m_stats.uniformBytes += sizeof(GLfloat);
+    }
+    uniforms->paramCount = std::max(uniforms->paramCount, item.paramCount);
+}
+
+void RenderQueue::invalidate() {
+    m_program = 0;
+    m_vao = 0;
+    m_texture = 0;
+    m_blend = -1;
+}
+
+const RenderQueue::Stats& RenderQueue::getStats() const {
+    return m_stats;
+}
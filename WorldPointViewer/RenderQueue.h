@@ -0,0 +1,124 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "Color.h"
+
+// Collects the frame's draws and issues them sorted by GL state, so that
+// consecutive draws sharing a program, vertex array or blend mode don't
+// re-bind it. Uniform values are remembered per program and only re-sent
+// when they change; drawables that share a program keep per-drawable
+// colors in their vertex arrays rather than in the color uniform (see
+// BufferDrawable::setVertexColor), so that it doesn't change between them.
+class RenderQueue
+{
+public:
+    // BLEND_DEPTH_ONLY masks off color writes, for occluders
+    enum Blend {
+        BLEND_NONE,
+        BLEND_ALPHA,
+        BLEND_DEPTH_ONLY,
+    };
+
+    // Passes are drawn in order; within a pass items are sorted by state.
+    // PASS_DEPTH fills the depth buffer so that the scene's hidden
+    // fragments fail the depth test before they're shaded.
+    // PASS_BACKGROUND is the globe and its reference lines.
+    enum Pass {
+        PASS_DEPTH,
+        PASS_BACKGROUND,
+        PASS_SCENE,
+        PASS_OVERLAY,
+        PASS_COUNT,
+    };
+
+    // Called by flush() before the first draw of each pass that has any,
+    // and with PASS_COUNT after the last draw.
+    typedef std::function<void(int pass)> PassCallback;
+
+    // float uniforms at locations 2 and up, for programs that take more
+    // than a color
+    static const unsigned int MAX_PARAMS = 2;
+
+    struct DrawItem {
+        unsigned char pass;
+        unsigned char blend;
+        GLuint program;
+        GLuint vao;
+        // bound to textureTarget on unit 0 if set
+        GLuint texture;
+        GLenum textureTarget;
+
+        // uniforms shared by every program
+        Color color;
+        float params[MAX_PARAMS];
+        unsigned int paramCount;
+
+        GLenum mode;
+        // a single glDrawArrays range, or a glMultiDrawArrays list when
+        // starts is set. The lists must stay valid until flush().
+        GLint first;
+        GLsizei count;
+        const GLint* starts;
+        const GLsizei* counts;
+        GLsizei drawCount;
+        // draws the single range this many times with glDrawArraysInstanced
+        // when set
+        GLsizei instanceCount;
+    };
+
+    struct Stats {
+        unsigned int drawCalls;
+        unsigned int stateChanges;
+        unsigned int uniformBytes;
+    };
+
+    RenderQueue();
+    ~RenderQueue();
+
+    static DrawItem makeItem(GLuint program, GLuint vao, GLenum mode, Color color);
+
+    void submit(const DrawItem& item);
+
+    void setPassCallback(PassCallback callback);
+
+    // Sorts and draws everything submitted since the last flush, then
+    // empties the queue.
+    void flush();
+
+    // Forgets the bound program, vertex array, texture and blend mode, for
+    // when something outside the queue may have changed them. Uniform
+    // values live in the programs, so they're still known.
+    void invalidate();
+
+    // counters for the last flush
+    const Stats& getStats() const;
+
+protected:
+    struct ProgramUniforms {
+        GLuint program;
+        Color color;
+        float params[MAX_PARAMS];
+        unsigned int paramCount;
+    };
+
+    void applyUniforms(const DrawItem& item);
+
+    std::vector<DrawItem> m_items;
+    std::vector<unsigned int> m_order;
+    std::vector<unsigned long long> m_keys;
+
+    // state left bound by the last flush
+    GLuint m_program;
+    GLuint m_vao;
+    GLuint m_texture;
+    int m_blend;
+
+    std::vector<ProgramUniforms> m_uniforms;
+
+    PassCallback m_passCallback;
+    Stats m_stats;
+};
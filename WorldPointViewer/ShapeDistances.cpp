@@ -0,0 +1,386 @@
+#include "ShapeDistances.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+
+#include "SphereIndex.h"
+#include "Utils.h"
+
+namespace {
+    inline double distanceSq(const double* p, const double* q) {
+        double dx = p[0] - q[0];
+        double dy = p[1] - q[1];
+        double dz = p[2] - q[2];
+        return dx * dx + dy * dy + dz * dz;
+    }
+
+    // Runs work(i) for i in [0, count) on threadCount threads, handing out
+    // one index at a time.
+    template <typename Work>
+    void parallelFor(unsigned int count, unsigned int threadCount, const Work& work) {
+        std::atomic<unsigned int> next(0);
+        auto worker = [&]() {
+            for (unsigned int i = next++; i < count; i = next++) {
+                work(i);
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (unsigned int t = 1; t < threadCount; t++) {
+            threads.push_back(std::thread(worker));
+        }
+        worker();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    double msSince(const std::chrono::high_resolution_clock::time_point& start) {
+        return std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - start).count();
+    }
+}
+
+const double ShapeDistances::BAND_FRACTION = 0.1;
+
+ShapeDistances::ShapeDistances() :
+    m_layerHausdorff(0),
+    m_hausdorffMs(0),
+    m_frechetMs(0),
+    m_layerHausdorffMs(0)
+{
+}
+
+ShapeDistances::~ShapeDistances()
+{
+}
+
+void ShapeDistances::compute(const TrackSet& actual, const TrackSet& approx,
+    const std::vector<int>& matches, unsigned int threadCount) {
+
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    const unsigned int TRACK_COUNT = actual.getTrackCount();
+    m_pairs.resize(TRACK_COUNT);
+    for (unsigned int t = 0; t < TRACK_COUNT; t++) {
+        PairDistances& pair = m_pairs[t];
+        pair.track = t;
+        pair.approxTrack = (t < matches.size()) ? matches[t] : -1;
+        pair.pointCount = actual.counts[t];
+        pair.approxPointCount = (pair.approxTrack >= 0) ? approx.counts[pair.approxTrack] : 0;
+        pair.hausdorff = -1;
+        pair.frechet = -1;
+    }
+
+    auto trackPoints = [](const TrackSet& set, unsigned int track) {
+        return &set.coords[set.starts[track] * 3];
+    };
+
+    auto start = std::chrono::high_resolution_clock::now();
+    parallelFor(TRACK_COUNT, threadCount, [&](unsigned int t) {
+        PairDistances& pair = m_pairs[t];
+        if (pair.approxTrack >= 0) {
+            pair.hausdorff = hausdorff(
+                trackPoints(actual, t), pair.pointCount,
+                trackPoints(approx, pair.approxTrack), pair.approxPointCount);
+        }
+    });
+    m_hausdorffMs = msSince(start);
+
+    start = std::chrono::high_resolution_clock::now();
+    parallelFor(TRACK_COUNT, threadCount, [&](unsigned int t) {
+        PairDistances& pair = m_pairs[t];
+        if (pair.approxTrack >= 0) {
+            pair.frechet = frechet(
+                trackPoints(actual, t), pair.pointCount,
+                trackPoints(approx, pair.approxTrack), pair.approxPointCount);
+        }
+    });
+    m_frechetMs = msSince(start);
+
+    start = std::chrono::high_resolution_clock::now();
+    m_layerHausdorff = std::max(
+        layerDirectedHausdorff(actual, approx, threadCount),
+        layerDirectedHausdorff(approx, actual, threadCount));
+    m_layerHausdorffMs = msSince(start);
+}
+
+double ShapeDistances::hausdorff(
+    const double* a, unsigned int aCount, const double* b, unsigned int bCount) {
+
+    if (aCount == 0 || bCount == 0) {
+        return -1;
+    }
+    return sqrt(std::max(
+        directedHausdorffSq(a, aCount, b, bCount),
+        directedHausdorffSq(b, bCount, a, aCount)));
+}
+
+double ShapeDistances::directedHausdorffSq(
+    const double* a, unsigned int aCount, const double* b, unsigned int bCount) {
+
+    double maxSq = 0;
+    // Consecutive points of a track are near each other, so the search for
+    // each point starts at the previous point's nearest and works outwards.
+    // Once it finds anything nearer than maxSq the point can't raise it.
+    unsigned int start = 0;
+    for (unsigned int i = 0; i < aCount; i++) {
+        const double* p = a + i * 3;
+        double minSq = HUGE_VAL;
+        unsigned int nearest = start;
+        bool below = false;
+
+        for (unsigned int offset = 0; offset < bCount && !below; offset++) {
+            for (int side = 0; side < 2; side++) {
+                if (offset == 0 && side == 1) {
+                    break;
+                }
+                long long j = (side == 0) ? (long long)start + offset : (long long)start - offset;
+                if (j < 0 || j >= bCount) {
+                    continue;
+                }
+                double dSq = distanceSq(p, b + j * 3);
+                if (dSq < minSq) {
+                    minSq = dSq;
+                    nearest = (unsigned int)j;
+                    if (minSq <= maxSq) {
+                        below = true;
+                        break;
+                    }
+                }
+            }
+            // both sides have run off the ends
+            if (offset > start && start + offset >= bCount) {
+                break;
+            }
+        }
+
+        maxSq = std::max(maxSq, minSq);
+        start = nearest;
+    }
+    return maxSq;
+}
+
+double ShapeDistances::frechet(
+    const double* a, unsigned int aCount, const double* b, unsigned int bCount,
+    unsigned int band) {
+
+    if (aCount == 0 || bCount == 0) {
+        return -1;
+    }
+
+    // Row i covers columns [lo, hi] around where the diagonal crosses it.
+    // The band is at least as wide as the diagonal's slope, so consecutive
+    // rows always overlap.
+    double slope = (aCount > 1) ? (double)(bCount - 1) / (aCount - 1) : 0;
+    if (band == 0) {
+        band = std::max(MIN_BAND,
+            (unsigned int)(std::max(aCount, bCount) * BAND_FRACTION));
+    }
+    band = std::max(band, (unsigned int)ceil(slope) + 1);
+
+    auto rowRange = [&](unsigned int i, unsigned int& lo, unsigned int& hi) {
+        long long center = (aCount > 1) ? (long long)(i * slope + 0.5) : 0;
+        lo = (unsigned int)std::max(0LL, center - (long long)band);
+        hi = (unsigned int)std::min((long long)bCount - 1, center + (long long)band);
+        if (i == aCount - 1) {
+            hi = bCount - 1;
+        }
+    };
+
+    // squared leash lengths for the previous and current rows
+    std::vector<double> prev(bCount), cur(bCount);
+    unsigned int prevLo = 0, prevHi = 0;
+
+    for (unsigned int i = 0; i < aCount; i++) {
+        const double* p = a + i * 3;
+        unsigned int lo, hi;
+        rowRange(i, lo, hi);
+
+        for (unsigned int j = lo; j <= hi; j++) {
+            double dSq = distanceSq(p, b + j * 3);
+            if (i == 0 && j == 0) {
+                cur[j] = dSq;
+                continue;
+            }
+
+            double best = HUGE_VAL;
+            if (i > 0 && j >= prevLo && j <= prevHi) {
+                best = prev[j];
+            }
+            if (i > 0 && j > prevLo && j - 1 <= prevHi) {
+                best = std::min(best, prev[j - 1]);
+            }
+            if (j > lo) {
+                best = std::min(best, cur[j - 1]);
+            }
+            cur[j] = std::max(dSq, best);
+        }
+
+        prev.swap(cur);
+        prevLo = lo;
+        prevHi = hi;
+    }
+
+    return sqrt(prev[bCount - 1]);
+}
+
+double ShapeDistances::layerDirectedHausdorff(
+    const TrackSet& from, const TrackSet& to, unsigned int threadCount) {
+
+    if (from.getPointCount() == 0 || to.getPointCount() == 0) {
+        return 0;
+    }
+
+    std::vector<float> coords;
+    std::vector<int> starts, counts;
+    PolylineSet set = to.toPolylineSet(coords, starts, counts);
+
+    SphereIndex index;
+    index.build(std::vector<PolylineSet>(1, set), threadCount);
+
+    // Every point has a neighbor within this.
+    const float ANYWHERE = (float)(EARTH_EQUITORIAL_RADIUS * 4);
+
+    // Threads take blocks of points and keep their own maximum. A point
+    // with a neighbor nearer than that can't raise it, and usually the
+    // points around the previous point's nearest neighbor show that
+    // without a search.
+    const unsigned int POINT_COUNT = from.getPointCount();
+    const unsigned int BLOCK_SIZE = 4096;
+    const unsigned int BLOCK_COUNT = (POINT_COUNT + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    std::vector<double> blockMax(BLOCK_COUNT, 0);
+
+    auto nearestDist = [&](const double* p, long long& nearest) {
+        SphereIndex::Hit hit;
+        if (!index.findNearest(vec3df::create((float)p[0], (float)p[1], (float)p[2]),
+                ANYWHERE, false, 1, hit)) {
+            return 0.0;
+        }
+        // the index is in floats; measure the winner in doubles
+        nearest = hit.point;
+        return sqrt(distanceSq(p, &to.coords[hit.point * 3]));
+    };
+
+    // Any point's distance is a lower bound on the result, so every block
+    // starts from the largest of a spread-out sample. Without it each
+    // block would search for most of its points before its maximum grew.
+    const unsigned int SEED_SAMPLES = std::min(POINT_COUNT, 1024u);
+    std::vector<double> seeds(SEED_SAMPLES, 0);
+    parallelFor(SEED_SAMPLES, threadCount, [&](unsigned int s) {
+        long long nearest;
+        seeds[s] = nearestDist(&from.coords[(size_t)POINT_COUNT * s / SEED_SAMPLES * 3], nearest);
+    });
+    const double SEED_DIST = *std::max_element(seeds.begin(), seeds.end());
+
+    parallelFor(BLOCK_COUNT, threadCount, [&](unsigned int block) {
+        const int WINDOW = 2;
+        const long long TO_COUNT = to.getPointCount();
+
+        double maxDist = SEED_DIST;
+        long long lastNearest = -1;
+        unsigned int last = std::min(POINT_COUNT, (block + 1) * BLOCK_SIZE);
+        for (unsigned int i = block * BLOCK_SIZE; i < last; i++) {
+            const double* p = &from.coords[i * 3];
+
+            if (lastNearest >= 0) {
+                long long first = std::max(0LL, lastNearest - WINDOW);
+                long long end = std::min(TO_COUNT, lastNearest + WINDOW + 1);
+                double minSq = HUGE_VAL;
+                for (long long j = first; j < end; j++) {
+                    double dSq = distanceSq(p, &to.coords[j * 3]);
+                    if (dSq < minSq) {
+                        minSq = dSq;
+                        // follows the track along
+                        lastNearest = j;
+                    }
+                }
+                if (minSq <= maxDist * maxDist) {
+                    continue;
+                }
+            }
+
+            auto pos = vec3df::create((float)p[0], (float)p[1], (float)p[2]);
+            unsigned int point;
+            if (maxDist > 0 && index.findAnyPoint(pos, (float)maxDist, 1, point)) {
+                lastNearest = point;
+                continue;
+            }
+            maxDist = std::max(maxDist, nearestDist(p, lastNearest));
+        }
+        blockMax[block] = maxDist;
+    });
+
+    return *std::max_element(blockMax.begin(), blockMax.end());
+}
+
+const std::vector<ShapeDistances::PairDistances>& ShapeDistances::getPairDistances() const {
+    return m_pairs;
+}
+
+double ShapeDistances::getLayerHausdorff() const {
+    return m_layerHausdorff;
+}
+
+double ShapeDistances::getHausdorffMs() const {
+    return m_hausdorffMs;
+}
+
+double ShapeDistances::getFrechetMs() const {
+    return m_frechetMs;
+}
+
+double ShapeDistances::getLayerHausdorffMs() const {
+    return m_layerHausdorffMs;
+}
+
+bool ShapeDistances::writeCsv(const char* filename) const {
+    FILE* file = fopen(filename, "w");
+    if (!file) {
+        return false;
+    }
+
+    fprintf(file, "track,approx_track,points,approx_points,hausdorff_m,frechet_m\n");
+    for (auto& pair : m_pairs) {
+        fprintf(file, "%u,%d,%u,%u,%.4f,%.4f\n",
+            pair.track, pair.approxTrack, pair.pointCount, pair.approxPointCount,
+            pair.hausdorff, pair.frechet);
+    }
+
+    fclose(file);
+    return true;
+}
+
+bool ShapeDistances::writeJson(const char* filename) const {
+    FILE* file = fopen(filename, "w");
+    if (!file) {
+        return false;
+    }
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"tracks\": %u,\n", (unsigned int)m_pairs.size());
+    fprintf(file, "  \"layer_hausdorff_m\": %.4f,\n", m_layerHausdorff);
+    fprintf(file, "  \"hausdorff_ms\": %.3f,\n", m_hausdorffMs);
+    fprintf(file, "  \"frechet_ms\": %.3f,\n", m_frechetMs);
+    fprintf(file, "  \"layer_hausdorff_ms\": %.3f,\n", m_layerHausdorffMs);
+
+    fprintf(file, "  \"per_track\": [\n");
+    for (size_t i = 0; i < m_pairs.size(); i++) {
+        const PairDistances& pair = m_pairs[i];
+        fprintf(file, "    {\"track\": %u, \"approx_track\": %d, \"points\": %u, "
+            "\"approx_points\": %u, \"hausdorff_m\": %.4f, \"frechet_m\": %.4f}%s\n",
+            pair.track, pair.approxTrack, pair.pointCount, pair.approxPointCount,
+            pair.hausdorff, pair.frechet, (i + 1 < m_pairs.size()) ? "," : "");
+    }
+    fprintf(file, "  ]\n");
+    fprintf(file, "}\n");
+
+    fclose(file);
+    return true;
+}
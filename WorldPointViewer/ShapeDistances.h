@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+
+#include "TrackErrors.h"
+
+// Shape similarity between tracks that don't share sample points, in
+// meters through the earth:
+//
+// The Hausdorff distance is the farthest any point of one track is from
+// the nearest point of the other, either way round. Per track pair the
+// nearest point search starts where the previous point's ended and stops
+// as soon as it finds a point nearer than the running maximum; between
+// whole layers it goes through a SphereIndex.
+//
+// The discrete Frechet distance is the shortest leash that lets two
+// walkers step along the tracks' points in order. It's a dynamic program
+// over the pairs of points, kept to a band around the diagonal and done
+// two rows at a time, so each pair needs O(band) memory. If the best
+// coupling strays outside the band the result is an upper bound.
+class ShapeDistances
+{
+public:
+    // the band is this fraction of the longer track, but no narrower than
+    // MIN_BAND points
+    static const unsigned int MIN_BAND = 32;
+    static const double BAND_FRACTION;
+
+    struct PairDistances {
+        unsigned int track;
+        // -1, with negative distances, if nothing matched
+        int approxTrack;
+        unsigned int pointCount;
+        unsigned int approxPointCount;
+        double hausdorff;
+        double frechet;
+    };
+
+    ShapeDistances();
+    ~ShapeDistances();
+
+    // Measures every matched pair (see TrackErrors::matchTracks) and the
+    // two sets as a whole, using threadCount worker threads (0 picks one
+    // per hardware thread).
+    void compute(const TrackSet& actual, const TrackSet& approx,
+        const std::vector<int>& matches, unsigned int threadCount = 0);
+
+    const std::vector<PairDistances>& getPairDistances() const;
+    double getLayerHausdorff() const;
+
+    // wall time of each part of the last compute()
+    double getHausdorffMs() const;
+    double getFrechetMs() const;
+    double getLayerHausdorffMs() const;
+
+    bool writeCsv(const char* filename) const;
+    bool writeJson(const char* filename) const;
+
+    static double hausdorff(const double* a, unsigned int aCount, const double* b, unsigned int bCount);
+    // band 0 picks one from BAND_FRACTION and MIN_BAND
+    static double frechet(const double* a, unsigned int aCount, const double* b, unsigned int bCount,
+        unsigned int band = 0);
+
+protected:
+    // squared, from a to b only
+    static double directedHausdorffSq(
+        const double* a, unsigned int aCount, const double* b, unsigned int bCount);
+    static double layerDirectedHausdorff(
+        const TrackSet& from, const TrackSet& to, unsigned int threadCount);
+
+    std::vector<PairDistances> m_pairs;
+    double m_layerHausdorff;
+
+    double m_hausdorffMs;
+    double m_frechetMs;
+    double m_layerHausdorffMs;
+};
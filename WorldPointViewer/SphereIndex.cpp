@@ -0,0 +1,705 @@
+#include "SphereIndex.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <queue>
+#include <thread>
+
+namespace {
+
+unsigned long long spreadBits(unsigned int v) {
+    unsigned long long x = v;
+    x = (x | (x << 16)) & 0x0000FFFF0000FFFFull;
+    x = (x | (x << 8)) & 0x00FF00FF00FF00FFull;
+    x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0Full;
+    x = (x | (x << 2)) & 0x3333333333333333ull;
+    x = (x | (x << 1)) & 0x5555555555555555ull;
+    return x;
+}
+
+unsigned long long makeCellId(int face, unsigned int i, unsigned int j) {
+    return ((unsigned long long)face << (2 * SphereIndex::LEAF_LEVEL)) |
+        spreadBits(i) | (spreadBits(j) << 1);
+}
+
+void toFaceUV(float x, float y, float z, int& face, float& u, float& v) {
+    float ax = fabsf(x);
+    float ay = fabsf(y);
+    float az = fabsf(z);
+
+    if (ax >= ay && ax >= az) {
+        face = (x > 0) ? 0 : 3;
+        u = y / ax;
+        v = z / ax;
+    }
+    else if (ay >= az) {
+        face = (y > 0) ? 1 : 4;
+        u = x / ay;
+        v = z / ay;
+    }
+    else {
+        face = (z > 0) ? 2 : 5;
+        u = x / az;
+        v = y / az;
+    }
+}
+
+vec3df::Vec3Df fromFaceUV(int face, float u, float v) {
+    float major = (face < 3) ? 1.0f : -1.0f;
+    switch (face % 3) {
+    case 0: return vec3df::create(major, u, v).getUnit();
+    case 1: return vec3df::create(u, major, v).getUnit();
+    default: return vec3df::create(u, v, major).getUnit();
+    }
+}
+
+unsigned int toLeafCoord(float uv) {
+    const unsigned int LEAF_CELLS = 1u << SphereIndex::LEAF_LEVEL;
+    int c = (int)((uv + 1.0f) * 0.5f * LEAF_CELLS);
+    return (unsigned int)std::min(std::max(c, 0), (int)LEAF_CELLS - 1);
+}
+
+bool runLess(const SphereIndex::Run& a, const SphereIndex::Run& b) {
+    if (a.cell != b.cell) {
+        return a.cell < b.cell;
+    }
+    if (a.layer != b.layer) {
+        return a.layer < b.layer;
+    }
+    return a.firstPoint < b.firstPoint;
+}
+
+struct RunCellLess {
+    bool operator()(const SphereIndex::Run& run, unsigned long long cell) const {
+        return run.cell < cell;
+    }
+};
+
+// Angle between two unit vectors, accurate for the tiny angles of deep cells.
+float angleBetween(const vec3df::Vec3Df& a, const vec3df::Vec3Df& b) {
+    float chord = (a - b).length();
+    return 2.0f * asinf(std::min(1.0f, chord * 0.5f));
+}
+
+float distanceToSegmentSq(const float* p, const float* a, const float* b) {
+    float abx = b[0] - a[0], aby = b[1] - a[1], abz = b[2] - a[2];
+    float apx = p[0] - a[0], apy = p[1] - a[1], apz = p[2] - a[2];
+    float lenSq = abx * abx + aby * aby + abz * abz;
+    float t = (lenSq > 0) ? (apx * abx + apy * aby + apz * abz) / lenSq : 0;
+    t = std::min(std::max(t, 0.0f), 1.0f);
+    float dx = apx - abx * t, dy = apy - aby * t, dz = apz - abz * t;
+    return dx * dx + dy * dy + dz * dz;
+}
+
+} // of anonymous namespace
+
+SphereIndex::SphereIndex() :
+    m_minRadius(0),
+    m_maxRadius(0),
+    m_maxSegmentLength(0) {
+    m_buildStats.pointCount = 0;
+    m_buildStats.runCount = 0;
+    m_buildStats.threadCount = 0;
+    m_buildStats.ms = 0;
+}
+
+SphereIndex::~SphereIndex() {
+}
+
+unsigned long long SphereIndex::cellIdFor(float x, float y, float z) {
+    int face;
+    float u, v;
+    toFaceUV(x, y, z, face, u, v);
+    return makeCellId(face, toLeafCoord(u), toLeafCoord(v));
+}
+
+void SphereIndex::clear() {
+    m_layers.clear();
+    m_runs.clear();
+    m_minRadius = 0;
+    m_maxRadius = 0;
+    m_maxSegmentLength = 0;
+}
+
+void SphereIndex::buildRuns(
+    unsigned int layer, unsigned int firstPolyline, unsigned int lastPolyline,
+    std::vector<Run>& runs, float& minRadius, float& maxRadius, float& maxSegment) const {
+
+    const PolylineSet& set = m_layers[layer];
+    const unsigned int MAX_RUN_POINTS = 0xffff;
+
+    auto addRun = [&](Run& run, unsigned char flags) {
+        run.flags = flags;
+        runs.push_back(run);
+        run.pointCount = 0;
+    };
+
+    for (unsigned int poly = firstPolyline; poly < lastPolyline; poly++) {
+        unsigned int start = set.starts[poly];
+        unsigned int end = start + set.counts[poly];
+
+        Run run;
+        run.layer = (unsigned char)layer;
+        run.pointCount = 0;
+
+        for (unsigned int pt = start; pt < end; pt++) {
+            const float* p = set.coords + pt * 3;
+            unsigned long long cell = cellIdFor(p[0], p[1], p[2]);
+
+            float r = sqrtf(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+            minRadius = std::min(minRadius, r);
+            maxRadius = std::max(maxRadius, r);
+
+            if (pt > start) {
+                const float* prev = p - 3;
+                float dx = p[0] - prev[0], dy = p[1] - prev[1], dz = p[2] - prev[2];
+                float length = sqrtf(dx * dx + dy * dy + dz * dz);
+
+                if (length > MAX_SEGMENT_SPACING) {
+                    // Index samples along long segments so that no part of
+                    // a segment is farther than MAX_SEGMENT_SPACING / 2 from
+                    // an indexed position.
+                    addRun(run, RUN_CONTINUES);
+
+                    int samples = (int)(length / MAX_SEGMENT_SPACING);
+                    for (int s = 1; s <= samples; s++) {
+                        float t = (float)s / (float)(samples + 1);
+                        float sx = prev[0] + dx * t;
+                        float sy = prev[1] + dy * t;
+                        float sz = prev[2] + dz * t;
+
+                        float sr = sqrtf(sx * sx + sy * sy + sz * sz);
+                        minRadius = std::min(minRadius, sr);
+                        maxRadius = std::max(maxRadius, sr);
+
+                        Run sample;
+                        sample.cell = cellIdFor(sx, sy, sz);
+                        sample.firstPoint = pt - 1;
+                        sample.pointCount = 1;
+                        sample.layer = (unsigned char)layer;
+                        addRun(sample, RUN_CONTINUES | RUN_SEGMENT_ONLY);
+                    }
+                    length = MAX_SEGMENT_SPACING;
+                }
+                maxSegment = std::max(maxSegment, length);
+            }
+
+            if (run.pointCount > 0 && (cell != run.cell || run.pointCount == MAX_RUN_POINTS)) {
+                addRun(run, RUN_CONTINUES);
+            }
+            if (run.pointCount == 0) {
+                run.cell = cell;
+                run.firstPoint = pt;
+            }
+            run.pointCount++;
+        }
+
+        if (run.pointCount > 0) {
+            addRun(run, 0);
+        }
+    }
+}
+
+void SphereIndex::build(const std::vector<PolylineSet>& layers, unsigned int threadCount) {
+    auto startTime = std::chrono::steady_clock::now();
+
+    clear();
+    m_layers = layers;
+
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Split the polylines into chunks of roughly CHUNK_POINTS points that
+    // the workers pull from a shared counter.
+    struct Chunk {
+        unsigned int layer;
+        unsigned int firstPolyline;
+        unsigned int lastPolyline;
+    };
+
+    const unsigned int CHUNK_POINTS = 1 << 16;
+    std::vector<Chunk> chunks;
+    for (unsigned int layer = 0; layer < m_layers.size(); layer++) {
+        const PolylineSet& set = m_layers[layer];
+        unsigned int first = 0;
+        unsigned int points = 0;
+        for (unsigned int poly = 0; poly < set.polylineCount; poly++) {
+            points += set.counts[poly];
+            if (points >= CHUNK_POINTS) {
+                Chunk chunk = { layer, first, poly + 1 };
+                chunks.push_back(chunk);
+                first = poly + 1;
+                points = 0;
+            }
+        }
+        if (first < set.polylineCount) {
+            Chunk chunk = { layer, first, set.polylineCount };
+            chunks.push_back(chunk);
+        }
+    }
+
+    threadCount = std::max(1u, std::min(threadCount, (unsigned int)chunks.size()));
+
+    std::vector<std::vector<Run> > threadRuns(threadCount);
+    std::vector<float> threadMinRadius(threadCount, 1e30f);
+    std::vector<float> threadMaxRadius(threadCount, 0.0f);
+    std::vector<float> threadMaxSegment(threadCount, 0.0f);
+    std::atomic<unsigned int> nextChunk(0);
+
+    auto worker = [&](unsigned int t) {
+        for (;;) {
+            unsigned int c = nextChunk++;
+            if (c >= chunks.size()) {
+                break;
+            }
+            buildRuns(chunks[c].layer, chunks[c].firstPolyline, chunks[c].lastPolyline,
+                threadRuns[t], threadMinRadius[t], threadMaxRadius[t], threadMaxSegment[t]);
+        }
+        std::sort(threadRuns[t].begin(), threadRuns[t].end(), runLess);
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int t = 1; t < threadCount; t++) {
+        threads.push_back(std::thread(worker, t));
+    }
+    worker(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+
+    m_minRadius = *std::min_element(threadMinRadius.begin(), threadMinRadius.end());
+    m_maxRadius = *std::max_element(threadMaxRadius.begin(), threadMaxRadius.end());
+    m_maxSegmentLength = *std::max_element(threadMaxSegment.begin(), threadMaxSegment.end());
+    if (m_minRadius > m_maxRadius) {
+        m_minRadius = m_maxRadius;
+    }
+
+    // Merge the sorted per-thread runs pairwise, a round at a time.
+    while (threadRuns.size() > 1) {
+        std::vector<std::vector<Run> > merged((threadRuns.size() + 1) / 2);
+        for (size_t m = 0; m < merged.size(); m++) {
+            auto mergePair = [&threadRuns, &merged, m]() {
+                size_t a = m * 2;
+                size_t b = a + 1;
+                if (b >= threadRuns.size()) {
+                    merged[m].swap(threadRuns[a]);
+                    return;
+                }
+                merged[m].resize(threadRuns[a].size() + threadRuns[b].size());
+                std::merge(
+                    threadRuns[a].begin(), threadRuns[a].end(),
+                    threadRuns[b].begin(), threadRuns[b].end(),
+                    merged[m].begin(), runLess);
+                std::vector<Run>().swap(threadRuns[a]);
+                std::vector<Run>().swap(threadRuns[b]);
+            };
+            threads.push_back(std::thread(mergePair));
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        threads.clear();
+        threadRuns.swap(merged);
+    }
+    if (!threadRuns.empty()) {
+        m_runs.swap(threadRuns[0]);
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - startTime);
+    m_buildStats.pointCount = 0;
+    for (auto& set : m_layers) {
+        m_buildStats.pointCount += set.pointCount;
+    }
+    m_buildStats.runCount = (unsigned int)m_runs.size();
+    m_buildStats.threadCount = threadCount;
+    m_buildStats.ms = elapsed.count() / 1000.0;
+}
+
+const SphereIndex::BuildStats& SphereIndex::getBuildStats() const {
+    return m_buildStats;
+}
+
+void SphereIndex::rootCells(std::vector<Cell>& cells) const {
+    for (int face = 0; face < 6; face++) {
+        Cell cell;
+        cell.face = face;
+        cell.level = 0;
+        cell.i = 0;
+        cell.j = 0;
+
+        unsigned long long first = makeCellId(face, 0, 0);
+        unsigned long long last = makeCellId(face + 1, 0, 0);
+        cell.lo = (unsigned int)(std::lower_bound(
+            m_runs.begin(), m_runs.end(), first, RunCellLess()) - m_runs.begin());
+        cell.hi = (unsigned int)(std::lower_bound(
+            m_runs.begin() + cell.lo, m_runs.end(), last, RunCellLess()) - m_runs.begin());
+
+        if (cell.hi > cell.lo) {
+            cells.push_back(cell);
+        }
+    }
+}
+
+void SphereIndex::childCells(const Cell& cell, Cell children[4], int& childCount) const {
+    childCount = 0;
+
+    int childLevel = cell.level + 1;
+    int shift = LEAF_LEVEL - childLevel;
+    unsigned int lo = cell.lo;
+
+    // Morton order: the children's id ranges are consecutive
+    for (unsigned int c = 0; c < 4; c++) {
+        Cell child;
+        child.face = cell.face;
+        child.level = childLevel;
+        child.i = cell.i * 2 + (c & 1);
+        child.j = cell.j * 2 + (c >> 1);
+
+        unsigned long long last = makeCellId(
+            cell.face, child.i << shift, child.j << shift) + (1ull << (2 * shift));
+
+        child.lo = lo;
+        child.hi = (unsigned int)(std::lower_bound(
+            m_runs.begin() + lo, m_runs.begin() + cell.hi, last, RunCellLess()) - m_runs.begin());
+        lo = child.hi;
+
+        if (child.hi > child.lo) {
+            children[childCount++] = child;
+        }
+    }
+}
+
+SphereIndex::CellBounds SphereIndex::cellBounds(const Cell& cell) const {
+    float cellSize = 2.0f / (float)(1u << cell.level);
+    float u0 = -1.0f + cell.i * cellSize;
+    float v0 = -1.0f + cell.j * cellSize;
+
+    CellBounds bounds;
+    bounds.dir = fromFaceUV(cell.face, u0 + cellSize * 0.5f, v0 + cellSize * 0.5f);
+
+    // The cell edges are great circles, so a cap that holds the corners
+    // holds the whole cell.
+    float angle = 0;
+    for (int c = 0; c < 4; c++) {
+        auto corner = fromFaceUV(cell.face,
+            u0 + ((c & 1) ? cellSize : 0), v0 + ((c >> 1) ? cellSize : 0));
+        angle = std::max(angle, angleBetween(corner, bounds.dir));
+    }
+    bounds.angle = angle * 1.001f + 1e-7f;
+
+    // Sphere around the cap extruded between the min and max data radius.
+    // Its farthest points are at the cap's rim or on its axis.
+    float minCos = cosf(bounds.angle);
+    float sinAngle = sinf(bounds.angle);
+    float centerDist = (m_minRadius * minCos + m_maxRadius) * 0.5f;
+    bounds.center = bounds.dir * centerDist;
+
+    auto distTo = [&](float r, float c, float s) {
+        float along = r * c - centerDist;
+        float perp = r * s;
+        return sqrtf(along * along + perp * perp);
+    };
+    bounds.radius = std::max(
+        std::max(distTo(m_minRadius, 1, 0), distTo(m_maxRadius, 1, 0)),
+        std::max(distTo(m_minRadius, minCos, sinAngle), distTo(m_maxRadius, minCos, sinAngle)));
+    bounds.radius = bounds.radius * 1.0001f + 1.0f;
+
+    return bounds;
+}
+
+void SphereIndex::appendRange(const Cell& cell, std::vector<unsigned int>& runs) const {
+    for (unsigned int r = cell.lo; r < cell.hi; r++) {
+        runs.push_back(r);
+    }
+}
+
+void SphereIndex::queryCap(
+    const vec3df::Vec3Df& dir, float angle, std::vector<unsigned int>& runs) const {
+
+    auto unitDir = dir.getUnit();
+
+    std::vector<Cell> stack;
+    rootCells(stack);
+
+    while (!stack.empty()) {
+        Cell cell = stack.back();
+        stack.pop_back();
+
+        CellBounds bounds = cellBounds(cell);
+        float centerAngle = angleBetween(unitDir, bounds.dir);
+        if (centerAngle > angle + bounds.angle) {
+            continue;
+        }
+
+        if (centerAngle + bounds.angle <= angle ||
+            cell.level == LEAF_LEVEL ||
+            cell.hi - cell.lo <= BUCKET_SIZE) {
+            appendRange(cell, runs);
+            continue;
+        }
+
+        Cell children[4];
+        int childCount;
+        childCells(cell, children, childCount);
+        for (int c = 0; c < childCount; c++) {
+            stack.push_back(children[c]);
+        }
+    }
+}
+
+void SphereIndex::queryFrustum(const Frustum& frustum, std::vector<unsigned int>& runs) const {
+    std::vector<Cell> stack;
+    rootCells(stack);
+
+    while (!stack.empty()) {
+        Cell cell = stack.back();
+        stack.pop_back();
+
+        CellBounds bounds = cellBounds(cell);
+        if (!frustum.intersectsSphere(bounds.center, bounds.radius)) {
+            continue;
+        }
+
+        if (frustum.containsSphere(bounds.center, bounds.radius) ||
+            cell.level == LEAF_LEVEL ||
+            cell.hi - cell.lo <= BUCKET_SIZE) {
+            appendRange(cell, runs);
+            continue;
+        }
+
+        Cell children[4];
+        int childCount;
+        childCells(cell, children, childCount);
+        for (int c = 0; c < childCount; c++) {
+            stack.push_back(children[c]);
+        }
+    }
+}
+
+bool SphereIndex::findNearest(
+    const vec3df::Vec3Df& pos, float maxDist, bool segments,
+    unsigned int layerMask, Hit& hit) const {
+
+    struct Entry {
+        float lowerBound;
+        Cell cell;
+
+        bool operator<(const Entry& rhs) const {
+            // std::priority_queue pops the largest, we want the nearest
+            return lowerBound > rhs.lowerBound;
+        }
+    };
+
+    // Segment (pt, pt + 1) is only tested from the runs holding pt, its
+    // first point or a sample along it, and the part of it nearest the
+    // query can be up to a whole segment (or sample spacing) from there.
+    float slack = segments ? m_maxSegmentLength : 0.0f;
+
+    float p[3] = { pos(0), pos(1), pos(2) };
+    float bestSq = maxDist * maxDist;
+    bool found = false;
+
+    std::priority_queue<Entry> queue;
+
+    auto push = [&](const Cell& cell) {
+        CellBounds bounds = cellBounds(cell);
+        float lowerBound = std::max(0.0f, (pos - bounds.center).length() - bounds.radius - slack);
+        if (lowerBound * lowerBound <= bestSq) {
+            Entry entry = { lowerBound, cell };
+            queue.push(entry);
+        }
+    };
+
+    std::vector<Cell> roots;
+    rootCells(roots);
+    for (auto& cell : roots) {
+        push(cell);
+    }
+
+    while (!queue.empty()) {
+        Entry entry = queue.top();
+        queue.pop();
+
+        if (entry.lowerBound * entry.lowerBound > bestSq) {
+            break;
+        }
+
+        const Cell& cell = entry.cell;
+        if (cell.level < LEAF_LEVEL && cell.hi - cell.lo > BUCKET_SIZE) {
+            Cell children[4];
+            int childCount;
+            childCells(cell, children, childCount);
+            for (int c = 0; c < childCount; c++) {
+                push(children[c]);
+            }
+            continue;
+        }
+
+        for (unsigned int r = cell.lo; r < cell.hi; r++) {
+            const Run& run = m_runs[r];
+            if (!(layerMask & (1u << run.layer))) {
+                continue;
+            }
+
+            const float* coords = m_layers[run.layer].coords;
+            unsigned int end = run.firstPoint + run.pointCount;
+            for (unsigned int pt = run.firstPoint; pt < end; pt++) {
+                const float* a = coords + pt * 3;
+
+                float dx = p[0] - a[0], dy = p[1] - a[1], dz = p[2] - a[2];
+                float distSq = (run.flags & RUN_SEGMENT_ONLY) ? bestSq : dx * dx + dy * dy + dz * dz;
+                bool onSegment = false;
+
+                bool hasNext = (pt + 1 < end) || (run.flags & RUN_CONTINUES);
+                if (segments && hasNext) {
+                    float segDistSq = distanceToSegmentSq(p, a, a + 3);
+                    if (segDistSq < distSq) {
+                        distSq = segDistSq;
+                        onSegment = true;
+                    }
+                }
+
+                if (distSq < bestSq) {
+                    bestSq = distSq;
+                    found = true;
+                    hit.layer = run.layer;
+                    hit.point = pt;
+                    hit.onSegment = onSegment;
+                }
+            }
+        }
+    }
+
+    if (found) {
+        hit.polyline = m_layers[hit.layer].findPolyline(hit.point);
+        hit.distance = sqrtf(bestSq);
+    }
+    return found;
+}
+
+bool SphereIndex::findAnyPoint(
+    const vec3df::Vec3Df& pos, float maxDist, unsigned int layerMask,
+    unsigned int& point) const {
+
+    struct Entry {
+        float lowerBound;
+        Cell cell;
+
+        bool operator<(const Entry& rhs) const {
+            return lowerBound > rhs.lowerBound;
+        }
+    };
+
+    float p[3] = { pos(0), pos(1), pos(2) };
+    const float MAX_SQ = maxDist * maxDist;
+
+    // nearest cells first, so a point within reach usually turns up in
+    // the first leaf
+    std::priority_queue<Entry> queue;
+    auto push = [&](const Cell& cell) {
+        CellBounds bounds = cellBounds(cell);
+        float lowerBound = std::max(0.0f, (pos - bounds.center).length() - bounds.radius);
+        if (lowerBound <= maxDist) {
+            Entry entry = { lowerBound, cell };
+            queue.push(entry);
+        }
+    };
+
+    std::vector<Cell> roots;
+    rootCells(roots);
+    for (auto& cell : roots) {
+        push(cell);
+    }
+
+    while (!queue.empty()) {
+        Cell cell = queue.top().cell;
+        queue.pop();
+
+        if (cell.level < LEAF_LEVEL && cell.hi - cell.lo > BUCKET_SIZE) {
+            Cell children[4];
+            int childCount;
+            childCells(cell, children, childCount);
+            for (int c = 0; c < childCount; c++) {
+                push(children[c]);
+            }
+            continue;
+        }
+
+        for (unsigned int r = cell.lo; r < cell.hi; r++) {
+            const Run& run = m_runs[r];
+            if (!(layerMask & (1u << run.layer)) || (run.flags & RUN_SEGMENT_ONLY)) {
+                continue;
+            }
+
+            const float* coords = m_layers[run.layer].coords;
+            unsigned int end = run.firstPoint + run.pointCount;
+            for (unsigned int pt = run.firstPoint; pt < end; pt++) {
+                const float* a = coords + pt * 3;
+                float dx = p[0] - a[0], dy = p[1] - a[1], dz = p[2] - a[2];
+                if (dx * dx + dy * dy + dz * dz <= MAX_SQ) {
+                    point = pt;
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+unsigned int SphereIndex::checkNearest(
+    const std::vector<vec3df::Vec3Df>& queries, float maxDist, bool segments,
+    unsigned int layerMask) const {
+
+    unsigned int mismatches = 0;
+    for (auto& query : queries) {
+        float p[3] = { query(0), query(1), query(2) };
+        float bestSq = maxDist * maxDist;
+        bool found = false;
+
+        for (unsigned int layer = 0; layer < m_layers.size(); layer++) {
+            if (!(layerMask & (1u << layer))) {
+                continue;
+            }
+            const PolylineSet& set = m_layers[layer];
+            for (unsigned int poly = 0; poly < set.polylineCount; poly++) {
+                unsigned int end = set.starts[poly] + set.counts[poly];
+                for (unsigned int pt = set.starts[poly]; pt < end; pt++) {
+                    const float* a = set.coords + pt * 3;
+                    float dx = p[0] - a[0], dy = p[1] - a[1], dz = p[2] - a[2];
+                    float distSq = dx * dx + dy * dy + dz * dz;
+                    if (segments && pt + 1 < end) {
+                        distSq = std::min(distSq, distanceToSegmentSq(p, a, a + 3));
+                    }
+                    if (distSq < bestSq) {
+                        bestSq = distSq;
+                        found = true;
+                    }
+                }
+            }
+        }
+
+        Hit hit;
+        bool indexFound = findNearest(query, maxDist, segments, layerMask, hit);
+        if (indexFound != found || (found && hit.distance != sqrtf(bestSq))) {
+            mismatches++;
+        }
+    }
+    return mismatches;
+}
+
+const SphereIndex::Run& SphereIndex::getRun(unsigned int idx) const {
+    return m_runs[idx];
+}
+
+unsigned int SphereIndex::getRunCount() const {
+    return (unsigned int)m_runs.size();
+}
+
+const PolylineSet& SphereIndex::getLayer(unsigned int layer) const {
+    return m_layers[layer];
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <vector>
+
+#include "Frustum.h"
+#include "PolylineSet.h"
+#include "Vec3Df.h"
+
+// Cube-face quadtree over the sphere. Each point maps to one of the six cube
+// faces and then to a leaf cell of a 2^LEAF_LEVEL x 2^LEAF_LEVEL grid on that
+// face. Consecutive points of a polyline that land in the same leaf cell are
+// stored as one run, and the runs are sorted by a Morton-ordered cell id, so
+// every quadtree cell at every level is a contiguous range of the run array
+// that can be found with a binary search.
+class SphereIndex
+{
+public:
+    static const int LEAF_LEVEL = 18;
+
+    struct Run {
+        unsigned long long cell;
+        unsigned int firstPoint;
+        unsigned short pointCount;
+        unsigned char layer;
+        unsigned char flags;
+    };
+
+    // the run's last point connects to the point after the run
+    static const unsigned char RUN_CONTINUES = 1;
+    // a sample along a long segment rather than a point; only the segment
+    // starting at firstPoint is in the cell
+    static const unsigned char RUN_SEGMENT_ONLY = 2;
+
+    // spacing of the samples indexed along long segments, in meters
+    static const int MAX_SEGMENT_SPACING = 2000;
+
+    struct Hit {
+        unsigned int layer;
+        unsigned int polyline;
+        // the nearest point, or the first point of the nearest segment
+        unsigned int point;
+        float distance;
+        bool onSegment;
+    };
+
+    SphereIndex();
+    ~SphereIndex();
+
+    struct BuildStats {
+        unsigned int pointCount;
+        unsigned int runCount;
+        unsigned int threadCount;
+        double ms;
+    };
+
+    // Builds the index over the given layers using threadCount worker
+    // threads (0 picks one per hardware thread). The layers must outlive
+    // the index.
+    void build(const std::vector<PolylineSet>& layers, unsigned int threadCount = 0);
+    void clear();
+
+    // what the last build() did
+    const BuildStats& getBuildStats() const;
+
+    // Appends the indices of the runs in every cell that may intersect the
+    // query. The results are conservative; callers do any exact tests.
+    void queryCap(const vec3df::Vec3Df& dir, float angle, std::vector<unsigned int>& runs) const;
+    void queryFrustum(const Frustum& frustum, std::vector<unsigned int>& runs) const;
+
+    // Finds the point (or, with segments set, the polyline segment) nearest
+    // to pos that is within maxDist. Layers whose bit is clear in layerMask
+    // are skipped.
+    bool findNearest(
+        const vec3df::Vec3Df& pos, float maxDist, bool segments,
+        unsigned int layerMask, Hit& hit) const;
+
+    // Finds any point of the layers in layerMask within maxDist of pos.
+    // Cheaper than findNearest() since it stops at the first one.
+    bool findAnyPoint(
+        const vec3df::Vec3Df& pos, float maxDist, unsigned int layerMask,
+        unsigned int& point) const;
+
+    // Runs findNearest() for each query and compares it with a scan of
+    // every point (and segment) of the layers. Returns the number of
+    // queries where the two disagree; for checking the index's pruning.
+    unsigned int checkNearest(
+        const std::vector<vec3df::Vec3Df>& queries, float maxDist, bool segments,
+        unsigned int layerMask) const;
+
+    const Run& getRun(unsigned int idx) const;
+    unsigned int getRunCount() const;
+    const PolylineSet& getLayer(unsigned int layer) const;
+
+    static unsigned long long cellIdFor(float x, float y, float z);
+
+protected:
+    struct Cell {
+        int face;
+        int level;
+        unsigned int i;
+        unsigned int j;
+        // range of m_runs covered by this cell
+        unsigned int lo;
+        unsigned int hi;
+    };
+
+    struct CellBounds {
+        // cap on the unit sphere
+        vec3df::Vec3Df dir;
+        float angle;
+        // sphere around the part of the data shell under the cap
+        vec3df::Vec3Df center;
+        float radius;
+    };
+
+    static const unsigned int BUCKET_SIZE = 16;
+
+    void rootCells(std::vector<Cell>& cells) const;
+    void childCells(const Cell& cell, Cell children[4], int& childCount) const;
+    CellBounds cellBounds(const Cell& cell) const;
+    void appendRange(const Cell& cell, std::vector<unsigned int>& runs) const;
+
+    void buildRuns(
+        unsigned int layer, unsigned int firstPolyline, unsigned int lastPolyline,
+        std::vector<Run>& runs, float& minRadius, float& maxRadius, float& maxSegment) const;
+
+    std::vector<PolylineSet> m_layers;
+    std::vector<Run> m_runs;
+
+    float m_minRadius;
+    float m_maxRadius;
+    float m_maxSegmentLength;
+
+    BuildStats m_buildStats;
+};
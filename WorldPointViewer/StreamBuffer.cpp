@@ -0,0 +1,144 @@
+#include "StreamBuffer.h"
+
+StreamBuffer::StreamBuffer() :
+    m_buffer(0),
+    m_segmentSize(0),
+    m_persistent(false),
+    m_mapped(nullptr),
+    m_segment(0),
+    m_stallCount(0)
+{
+    for (unsigned int i = 0; i < SEGMENT_COUNT; i++) {
+        m_fences[i] = 0;
+    }
+}
+
+StreamBuffer::~StreamBuffer()
+{
+}
+
+void StreamBuffer::setup(GLsizeiptr segmentSize) {
+    cleanup();
+
+    m_segmentSize = segmentSize;
+    m_persistent = GLEW_ARB_buffer_storage != 0;
+    m_segment = 0;
+
+    const GLsizeiptr BUFFER_SIZE = segmentSize * SEGMENT_COUNT;
+
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+
+    if (m_persistent) {
+        const GLbitfield FLAGS =
+            GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, BUFFER_SIZE, nullptr, FLAGS);
+        m_mapped = (unsigned char*)glMapBufferRange(
+            GL_ARRAY_BUFFER, 0, BUFFER_SIZE, FLAGS);
+    }
+    else {
+        glBufferData(GL_ARRAY_BUFFER, BUFFER_SIZE, nullptr, GL_STREAM_DRAW);
+    }
+}
+
+void StreamBuffer::cleanup() {
+    if (!m_buffer) {
+        return;
+    }
+
+    for (unsigned int i = 0; i < SEGMENT_COUNT; i++) {
+        if (m_fences[i]) {
+            glDeleteSync(m_fences[i]);
+            m_fences[i] = 0;
+        }
+    }
+
+    if (m_mapped) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        m_mapped = nullptr;
+    }
+
+    glDeleteBuffers(1, &m_buffer);
+    m_buffer = 0;
+}
+
+void* StreamBuffer::beginWrite() {
+    const GLintptr OFFSET = m_segmentSize * m_segment;
+
+    if (m_persistent) {
+        if (!m_mapped) {
+            return nullptr;
+        }
+        waitForSegment(m_segment);
+        return m_mapped + OFFSET;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    if (m_segment == 0) {
+        // The GPU may still be reading any segment, so give the old storage
+        // to the driver to free when it's done and write into new storage.
+        glBufferData(GL_ARRAY_BUFFER,
+            m_segmentSize * SEGMENT_COUNT, nullptr, GL_STREAM_DRAW);
+    }
+    // nothing in flight reads this segment of the new storage
+    void* mapped = glMapBufferRange(GL_ARRAY_BUFFER, OFFSET, m_segmentSize,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (!mapped) {
+        // a lost context or no memory for the new storage; start the ring
+        // over so the next write orphans again
+        m_segment = 0;
+    }
+    return mapped;
+}
+
+GLintptr StreamBuffer::endWrite() {
+    if (!m_persistent) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+    return m_segmentSize * m_segment;
+}
+
+void StreamBuffer::fence() {
+    if (m_persistent) {
+        m_fences[m_segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+    m_segment = (m_segment + 1) % SEGMENT_COUNT;
+}
+
+void StreamBuffer::waitForSegment(unsigned int segment) {
+    GLsync fence = m_fences[segment];
+    if (!fence) {
+        return;
+    }
+
+    GLenum result = glClientWaitSync(fence, 0, 0);
+    if (result == GL_TIMEOUT_EXPIRED) {
+        m_stallCount++;
+
+        const GLuint64 ONE_SECOND_NS = 1000000000;
+        do {
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, ONE_SECOND_NS);
+        } while (result == GL_TIMEOUT_EXPIRED);
+    }
+
+    glDeleteSync(fence);
+    m_fences[segment] = 0;
+}
+
+GLuint StreamBuffer::getBuffer() const {
+    return m_buffer;
+}
+
+GLsizeiptr StreamBuffer::getSegmentSize() const {
+    return m_segmentSize;
+}
+
+bool StreamBuffer::isPersistent() const {
+    return m_persistent;
+}
+
+unsigned int StreamBuffer::getStallCount() const {
+    return m_stallCount;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <GL/glew.h>
+
+// A vertex buffer for data that's rewritten every frame. The buffer is a
+// ring of SEGMENT_COUNT segments; each frame writes the next one while the
+// GPU may still be reading the previous ones, so writes don't wait on the
+// draws that came before them.
+//
+// With ARB_buffer_storage the buffer is mapped once, persistently, and a
+// fence placed after each segment's draws keeps a write from overtaking
+// them. Without it (plain GL 4.1) each segment is mapped unsynchronized and
+// the whole buffer is orphaned each time the ring wraps.
+class StreamBuffer
+{
+public:
+    static const unsigned int SEGMENT_COUNT = 3;
+
+    StreamBuffer();
+    ~StreamBuffer();
+
+    void setup(GLsizeiptr segmentSize);
+    void cleanup();
+
+    // Returns somewhere to write up to getSegmentSize() bytes. There's one
+    // write per segment: call endWrite, issue the draws that read it, then
+    // fence before the next beginWrite. Returns nullptr if the buffer can't
+    // be mapped, in which case there's nothing to end, draw or fence.
+    void* beginWrite();
+    // Returns the offset of the written data in the buffer.
+    GLintptr endWrite();
+    // Marks the end of the draws reading the current segment and moves on
+    // to the next one.
+    void fence();
+
+    GLuint getBuffer() const;
+    GLsizeiptr getSegmentSize() const;
+    bool isPersistent() const;
+
+    // times beginWrite had to wait for the GPU
+    unsigned int getStallCount() const;
+
+protected:
+    void waitForSegment(unsigned int segment);
+
+    GLuint m_buffer;
+    GLsizeiptr m_segmentSize;
+    bool m_persistent;
+
+    // the persistent mapping of the whole buffer
+    unsigned char* m_mapped;
+
+    unsigned int m_segment;
+    GLsync m_fences[SEGMENT_COUNT];
+
+    unsigned int m_stallCount;
+};
@@ -0,0 +1,415 @@
+#include "TrackErrors.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+
+#include <emmintrin.h>
+
+#include "SphereIndex.h"
+#include "Utils.h"
+
+void TrackSet::addTrack(const std::vector<vec3dd::Vec3Dd>& points) {
+    if (points.empty()) {
+        return;
+    }
+    starts.push_back(getPointCount());
+    counts.push_back((unsigned int)points.size());
+    for (auto& p : points) {
+        coords.push_back(p(0));
+        coords.push_back(p(1));
+        coords.push_back(p(2));
+    }
+}
+
+unsigned int TrackSet::getTrackCount() const {
+    return (unsigned int)starts.size();
+}
+
+unsigned int TrackSet::getPointCount() const {
+    return (unsigned int)(coords.size() / 3);
+}
+
+PolylineSet TrackSet::toPolylineSet(
+    std::vector<float>& floatCoords, std::vector<int>& floatStarts,
+    std::vector<int>& floatCounts) const {
+
+    floatCoords.assign(coords.begin(), coords.end());
+    floatStarts.assign(starts.begin(), starts.end());
+    floatCounts.assign(counts.begin(), counts.end());
+
+    PolylineSet set;
+    set.coords = floatCoords.data();
+    set.starts = floatStarts.data();
+    set.counts = floatCounts.data();
+    set.polylineCount = getTrackCount();
+    set.pointCount = getPointCount();
+    return set;
+}
+
+TrackErrors::TrackErrors() :
+    m_computeMs(0)
+{
+}
+
+TrackErrors::~TrackErrors()
+{
+}
+
+void TrackErrors::compute(
+    const TrackSet& actual, const TrackSet& approx, Matching matching,
+    unsigned int threadCount) {
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    const unsigned int TRACK_COUNT = actual.getTrackCount();
+    std::vector<int> matches;
+    matchTracks(actual, approx, matching, matches, threadCount);
+
+    m_pointErrors.resize(actual.getPointCount());
+    m_trackStats.resize(TRACK_COUNT);
+
+    // Tracks vary a lot in length, so threads take them one at a time
+    // rather than in fixed ranges.
+    std::atomic<unsigned int> nextTrack(0);
+    auto worker = [&]() {
+        Segments segments;
+        for (unsigned int t = nextTrack++; t < TRACK_COUNT; t = nextTrack++) {
+            PointError* errors = &m_pointErrors[actual.starts[t]];
+            const unsigned int COUNT = actual.counts[t];
+
+            if (matches[t] < 0) {
+                for (unsigned int i = 0; i < COUNT; i++) {
+                    errors[i].greatCircle = -1;
+                    errors[i].chord = -1;
+                }
+            }
+            else {
+                buildSegments(approx, matches[t], segments);
+                const double* points = &actual.coords[actual.starts[t] * 3];
+                for (unsigned int i = 0; i < COUNT; i++) {
+                    const double* p = points + i * 3;
+                    double q[3];
+                    nearestOnSegments(p, segments, q);
+
+                    vec3dd::Vec3Dd pv = vec3dd::create(p[0], p[1], p[2]);
+                    vec3dd::Vec3Dd qv = vec3dd::create(q[0], q[1], q[2]);
+                    double angle = atan2(vec3dd::cross(pv, qv).length(), pv.dot(qv));
+                    errors[i].greatCircle = (float)(angle * EARTH_EQUITORIAL_RADIUS);
+                    errors[i].chord = (float)(pv - qv).length();
+                }
+            }
+
+            m_trackStats[t] = summarize(errors, (matches[t] < 0) ? 0 : COUNT);
+            m_trackStats[t].track = t;
+            m_trackStats[t].approxTrack = matches[t];
+            m_trackStats[t].pointCount = COUNT;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int t = 1; t < threadCount; t++) {
+        threads.push_back(std::thread(worker));
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    m_computeMs = std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void TrackErrors::matchTracks(const TrackSet& actual, const TrackSet& approx,
+    Matching matching, std::vector<int>& matches, unsigned int threadCount) {
+
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    const unsigned int TRACK_COUNT = actual.getTrackCount();
+    matches.assign(TRACK_COUNT, -1);
+    if (matching == MATCH_BY_NEAREST) {
+        matchByNearest(actual, approx, matches, threadCount);
+    }
+    else {
+        for (unsigned int i = 0; i < std::min(TRACK_COUNT, approx.getTrackCount()); i++) {
+            matches[i] = (int)i;
+        }
+    }
+}
+
+void TrackErrors::matchByNearest(const TrackSet& actual, const TrackSet& approx,
+    std::vector<int>& matches, unsigned int threadCount) {
+
+    // The index only needs float precision to tell tracks apart.
+    std::vector<float> coords;
+    std::vector<int> starts, counts;
+    PolylineSet set = approx.toPolylineSet(coords, starts, counts);
+
+    SphereIndex index;
+    index.build(std::vector<PolylineSet>(1, set), threadCount);
+
+    const unsigned int TRACK_COUNT = actual.getTrackCount();
+    std::atomic<unsigned int> nextTrack(0);
+    auto worker = [&]() {
+        std::vector<unsigned int> votes;
+        for (unsigned int t = nextTrack++; t < TRACK_COUNT; t = nextTrack++) {
+            // each of up to MATCH_SAMPLES evenly spaced points votes for the
+            // track nearest to it
+            votes.clear();
+            const unsigned int COUNT = actual.counts[t];
+            const unsigned int SAMPLES = std::min(COUNT, MATCH_SAMPLES);
+            for (unsigned int s = 0; s < SAMPLES; s++) {
+                unsigned int i = (SAMPLES > 1) ? s * (COUNT - 1) / (SAMPLES - 1) : 0;
+                const double* p = &actual.coords[(actual.starts[t] + i) * 3];
+                SphereIndex::Hit hit;
+                if (index.findNearest(vec3df::create((float)p[0], (float)p[1], (float)p[2]),
+                        (float)MATCH_DISTANCE, true, 1, hit)) {
+                    votes.push_back(hit.polyline);
+                }
+            }
+
+            std::sort(votes.begin(), votes.end());
+            unsigned int bestVotes = 0;
+            for (size_t i = 0; i < votes.size();) {
+                size_t j = i;
+                while (j < votes.size() && votes[j] == votes[i]) {
+                    j++;
+                }
+                if (j - i > bestVotes) {
+                    bestVotes = (unsigned int)(j - i);
+                    matches[t] = (int)votes[i];
+                }
+                i = j;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int t = 1; t < threadCount; t++) {
+        threads.push_back(std::thread(worker));
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+void TrackErrors::buildSegments(const TrackSet& tracks, unsigned int track, Segments& segments) {
+    const double* points = &tracks.coords[tracks.starts[track] * 3];
+    const unsigned int COUNT = tracks.counts[track];
+    // a single point is one zero-length segment
+    const unsigned int SEGMENT_COUNT = std::max(1u, COUNT - 1);
+    const unsigned int PADDED_COUNT = (SEGMENT_COUNT + 1) & ~1u;
+
+    segments.ax.resize(PADDED_COUNT);
+    segments.ay.resize(PADDED_COUNT);
+    segments.az.resize(PADDED_COUNT);
+    segments.dx.resize(PADDED_COUNT);
+    segments.dy.resize(PADDED_COUNT);
+    segments.dz.resize(PADDED_COUNT);
+    segments.invLengthSq.resize(PADDED_COUNT);
+
+    for (unsigned int k = 0; k < PADDED_COUNT; k++) {
+        // the padding repeats the last segment
+        unsigned int s = std::min(k, SEGMENT_COUNT - 1);
+        const double* a = points + s * 3;
+        const double* b = (COUNT > 1) ? a + 3 : a;
+        segments.ax[k] = a[0];
+        segments.ay[k] = a[1];
+        segments.az[k] = a[2];
+        segments.dx[k] = b[0] - a[0];
+        segments.dy[k] = b[1] - a[1];
+        segments.dz[k] = b[2] - a[2];
+        double lengthSq =
+            segments.dx[k] * segments.dx[k] +
+            segments.dy[k] * segments.dy[k] +
+            segments.dz[k] * segments.dz[k];
+        segments.invLengthSq[k] = (lengthSq > 0) ? 1 / lengthSq : 0;
+    }
+}
+
+void TrackErrors::nearestOnSegments(const double p[3], const Segments& segments, double q[3]) {
+    const __m128d ZERO = _mm_setzero_pd();
+    const __m128d ONE = _mm_set1_pd(1);
+    const __m128d TWO = _mm_set1_pd(2);
+
+    __m128d px = _mm_set1_pd(p[0]);
+    __m128d py = _mm_set1_pd(p[1]);
+    __m128d pz = _mm_set1_pd(p[2]);
+
+    __m128d bestSq = _mm_set1_pd(HUGE_VAL);
+    // segment indices as doubles, which blend like the distances do
+    __m128d bestIdx = ZERO;
+    __m128d idx = _mm_set_pd(1, 0);
+
+    const size_t COUNT = segments.ax.size();
+    for (size_t k = 0; k < COUNT; k += 2) {
+        __m128d dx = _mm_loadu_pd(&segments.dx[k]);
+        __m128d dy = _mm_loadu_pd(&segments.dy[k]);
+        __m128d dz = _mm_loadu_pd(&segments.dz[k]);
+        __m128d wx = _mm_sub_pd(px, _mm_loadu_pd(&segments.ax[k]));
+        __m128d wy = _mm_sub_pd(py, _mm_loadu_pd(&segments.ay[k]));
+        __m128d wz = _mm_sub_pd(pz, _mm_loadu_pd(&segments.az[k]));
+
+        // parameter of the nearest point, clamped to the segment
+        __m128d t = _mm_mul_pd(
+            _mm_add_pd(_mm_add_pd(_mm_mul_pd(wx, dx), _mm_mul_pd(wy, dy)), _mm_mul_pd(wz, dz)),
+            _mm_loadu_pd(&segments.invLengthSq[k]));
+        t = _mm_min_pd(_mm_max_pd(t, ZERO), ONE);
+
+        __m128d ex = _mm_sub_pd(wx, _mm_mul_pd(t, dx));
+        __m128d ey = _mm_sub_pd(wy, _mm_mul_pd(t, dy));
+        __m128d ez = _mm_sub_pd(wz, _mm_mul_pd(t, dz));
+        __m128d distSq = _mm_add_pd(
+            _mm_add_pd(_mm_mul_pd(ex, ex), _mm_mul_pd(ey, ey)), _mm_mul_pd(ez, ez));
+
+        __m128d closer = _mm_cmplt_pd(distSq, bestSq);
+        bestSq = _mm_min_pd(distSq, bestSq);
+        bestIdx = _mm_or_pd(_mm_and_pd(closer, idx), _mm_andnot_pd(closer, bestIdx));
+        idx = _mm_add_pd(idx, TWO);
+    }
+
+    double dists[2], indices[2];
+    _mm_storeu_pd(dists, bestSq);
+    _mm_storeu_pd(indices, bestIdx);
+    size_t k = (size_t)((dists[1] < dists[0]) ? indices[1] : indices[0]);
+
+    // redo the winner in scalar for the point itself
+    double dx = segments.dx[k], dy = segments.dy[k], dz = segments.dz[k];
+    double t =
+        ((p[0] - segments.ax[k]) * dx + (p[1] - segments.ay[k]) * dy + (p[2] - segments.az[k]) * dz) *
+        segments.invLengthSq[k];
+    t = std::min(std::max(t, 0.0), 1.0);
+    q[0] = segments.ax[k] + t * dx;
+    q[1] = segments.ay[k] + t * dy;
+    q[2] = segments.az[k] + t * dz;
+}
+
+TrackErrors::TrackStats TrackErrors::summarize(const PointError* errors, unsigned int count) {
+    TrackStats stats = {};
+    stats.approxTrack = -1;
+    stats.pointCount = count;
+    if (count == 0) {
+        return stats;
+    }
+
+    std::vector<float> greatCircle(count);
+    double greatCircleSq = 0;
+    double chordSq = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        greatCircle[i] = errors[i].greatCircle;
+        greatCircleSq += (double)errors[i].greatCircle * errors[i].greatCircle;
+        chordSq += (double)errors[i].chord * errors[i].chord;
+        stats.chordMax = std::max(stats.chordMax, (double)errors[i].chord);
+    }
+    stats.greatCircleRms = sqrt(greatCircleSq / count);
+    stats.chordRms = sqrt(chordSq / count);
+
+    auto percentile = [&](double fraction) {
+        auto nth = greatCircle.begin() + (size_t)((count - 1) * fraction);
+        std::nth_element(greatCircle.begin(), nth, greatCircle.end());
+        return (double)*nth;
+    };
+    stats.greatCircleP50 = percentile(0.5);
+    stats.greatCircleP95 = percentile(0.95);
+    stats.greatCircleP99 = percentile(0.99);
+    stats.greatCircleMax = *std::max_element(greatCircle.begin(), greatCircle.end());
+    return stats;
+}
+
+const std::vector<TrackErrors::PointError>& TrackErrors::getPointErrors() const {
+    return m_pointErrors;
+}
+
+const std::vector<TrackErrors::TrackStats>& TrackErrors::getTrackStats() const {
+    return m_trackStats;
+}
+
+TrackErrors::TrackStats TrackErrors::getOverallStats() const {
+    std::vector<PointError> matched;
+    matched.reserve(m_pointErrors.size());
+    for (auto& error : m_pointErrors) {
+        if (error.greatCircle >= 0) {
+            matched.push_back(error);
+        }
+    }
+
+    TrackStats stats = summarize(matched.data(), (unsigned int)matched.size());
+    stats.track = (unsigned int)m_trackStats.size();
+    return stats;
+}
+
+double TrackErrors::getComputeMs() const {
+    return m_computeMs;
+}
+
+bool TrackErrors::writeCsv(const char* filename) const {
+    FILE* file = fopen(filename, "w");
+    if (!file) {
+        return false;
+    }
+
+    fprintf(file, "track,approx_track,points,gc_rms_m,gc_p50_m,gc_p95_m,gc_p99_m,gc_max_m,"
+        "chord_rms_m,chord_max_m\n");
+    for (auto& s : m_trackStats) {
+        fprintf(file, "%u,%d,%u,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n",
+            s.track, s.approxTrack, s.pointCount,
+            s.greatCircleRms, s.greatCircleP50, s.greatCircleP95, s.greatCircleP99,
+            s.greatCircleMax, s.chordRms, s.chordMax);
+    }
+
+    fclose(file);
+    return true;
+}
+
+bool TrackErrors::writeJson(const char* filename) const {
+    FILE* file = fopen(filename, "w");
+    if (!file) {
+        return false;
+    }
+
+    auto writeStats = [&](const TrackStats& s) {
+        fprintf(file, "\"points\": %u, \"gc_rms_m\": %.4f, \"gc_p50_m\": %.4f, "
+            "\"gc_p95_m\": %.4f, \"gc_p99_m\": %.4f, \"gc_max_m\": %.4f, "
+            "\"chord_rms_m\": %.4f, \"chord_max_m\": %.4f",
+            s.pointCount, s.greatCircleRms, s.greatCircleP50, s.greatCircleP95,
+            s.greatCircleP99, s.greatCircleMax, s.chordRms, s.chordMax);
+    };
+
+    unsigned int matchedCount = 0;
+    for (auto& s : m_trackStats) {
+        if (s.approxTrack >= 0) {
+            matchedCount++;
+        }
+    }
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"tracks\": %u,\n", (unsigned int)m_trackStats.size());
+    fprintf(file, "  \"matched_tracks\": %u,\n", matchedCount);
+    fprintf(file, "  \"compute_ms\": %.3f,\n", m_computeMs);
+    fprintf(file, "  \"overall\": {");
+    writeStats(getOverallStats());
+    fprintf(file, "},\n");
+
+    fprintf(file, "  \"per_track\": [\n");
+    for (size_t i = 0; i < m_trackStats.size(); i++) {
+        const TrackStats& s = m_trackStats[i];
+        fprintf(file, "    {\"track\": %u, \"approx_track\": %d, ", s.track, s.approxTrack);
+        writeStats(s);
+        fprintf(file, "}%s\n", (i + 1 < m_trackStats.size()) ? "," : "");
+    }
+    fprintf(file, "  ]\n");
+    fprintf(file, "}\n");
+
+    fclose(file);
+    return true;
+}
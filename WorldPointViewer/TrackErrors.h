@@ -0,0 +1,108 @@
+#pragma once
+
+#include <vector>
+
+#include "PolylineSet.h"
+#include "Vec3Dd.h"
+
+// Polylines in full double precision, for analysis. Points are packed
+// x, y, z; track i covers points [starts[i], starts[i] + counts[i]).
+struct TrackSet {
+    std::vector<double> coords;
+    std::vector<unsigned int> starts;
+    std::vector<unsigned int> counts;
+
+    void addTrack(const std::vector<vec3dd::Vec3Dd>& points);
+    unsigned int getTrackCount() const;
+    unsigned int getPointCount() const;
+
+    // A float copy for SphereIndex, kept in the given vectors.
+    PolylineSet toPolylineSet(
+        std::vector<float>& floatCoords, std::vector<int>& floatStarts,
+        std::vector<int>& floatCounts) const;
+};
+
+// Measures how far each point of the actual tracks is from the matching
+// approximated track: the distance to the nearest point on any of its
+// segments, both straight through the earth and along the surface of a
+// sphere of EARTH_EQUITORIAL_RADIUS. Tracks are spread over worker threads,
+// and the nearest-segment search tests two segments at a time.
+class TrackErrors
+{
+public:
+    enum Matching {
+        // actual track i goes with approximated track i
+        MATCH_BY_INDEX,
+        // with the approximated track nearest to a sample of its points
+        MATCH_BY_NEAREST,
+    };
+
+    // how far apart a sample point and a track can be and still match, in
+    // meters
+    static const int MATCH_DISTANCE = 50000;
+    static const unsigned int MATCH_SAMPLES = 16;
+
+    // per point of the actual tracks, in meters; both are negative when
+    // the track had no match
+    struct PointError {
+        float greatCircle;
+        float chord;
+    };
+
+    struct TrackStats {
+        unsigned int track;
+        // -1 if nothing matched
+        int approxTrack;
+        unsigned int pointCount;
+        double greatCircleRms;
+        double greatCircleMax;
+        double greatCircleP50;
+        double greatCircleP95;
+        double greatCircleP99;
+        double chordRms;
+        double chordMax;
+    };
+
+    TrackErrors();
+    ~TrackErrors();
+
+    // Sets matches[i] to the approximated track for actual track i, or -1.
+    static void matchTracks(const TrackSet& actual, const TrackSet& approx, Matching matching,
+        std::vector<int>& matches, unsigned int threadCount = 0);
+
+    // Uses threadCount worker threads (0 picks one per hardware thread).
+    void compute(const TrackSet& actual, const TrackSet& approx, Matching matching,
+        unsigned int threadCount = 0);
+
+    const std::vector<PointError>& getPointErrors() const;
+    const std::vector<TrackStats>& getTrackStats() const;
+    // over every matched point
+    TrackStats getOverallStats() const;
+    double getComputeMs() const;
+
+    // one row per actual track
+    bool writeCsv(const char* filename) const;
+    // the overall stats followed by every track's
+    bool writeJson(const char* filename) const;
+
+protected:
+    // segments of one approximated track as structures of arrays, padded
+    // to an even count
+    struct Segments {
+        std::vector<double> ax, ay, az;
+        std::vector<double> dx, dy, dz;
+        // 1 / |d|^2, or 0 for a zero-length segment
+        std::vector<double> invLengthSq;
+    };
+
+    static void buildSegments(const TrackSet& tracks, unsigned int track, Segments& segments);
+    static void nearestOnSegments(const double p[3], const Segments& segments, double q[3]);
+    static TrackStats summarize(const PointError* errors, unsigned int count);
+
+    static void matchByNearest(const TrackSet& actual, const TrackSet& approx,
+        std::vector<int>& matches, unsigned int threadCount);
+
+    std::vector<PointError> m_pointErrors;
+    std::vector<TrackStats> m_trackStats;
+    double m_computeMs;
+};
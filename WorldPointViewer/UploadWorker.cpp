@@ -0,0 +1,196 @@
+#include "UploadWorker.h"
+
+#ifdef _WIN32
+#include <GL/Wglew.h>
+#endif
+
+#include "FrameScheduler.h"
+
+UploadWorker::UploadWorker() :
+#ifdef _WIN32
+    m_notifyWindow(0),
+    m_dc(0),
+    m_context(0),
+#endif
+    m_stopping(false),
+    m_outstanding(0)
+{
+}
+
+UploadWorker::~UploadWorker()
+{
+}
+
+#ifdef _WIN32
+bool UploadWorker::start(HWND notifyWindow, HDC dc, HGLRC shareContext, const int* contextAttribs) {
+    m_notifyWindow = notifyWindow;
+    m_dc = dc;
+    m_stopping = false;
+
+    if (wglewIsSupported("WGL_ARB_create_context") == 1) {
+        m_context = wglCreateContextAttribsARB(dc, shareContext, contextAttribs);
+    }
+    if (!m_context) {
+        return false;
+    }
+
+    m_thread = std::thread([this]() { workerLoop(); });
+    return true;
+}
+#endif
+
+void UploadWorker::stop() {
+    if (m_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_changed.notify_all();
+        m_thread.join();
+    }
+
+#ifdef _WIN32
+    if (m_context) {
+        wglDeleteContext(m_context);
+        m_context = 0;
+    }
+#endif
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& task : m_finished) {
+        glDeleteSync(task.fence);
+    }
+    m_queued.clear();
+    m_finished.clear();
+    m_outstanding = 0;
+}
+
+void UploadWorker::submit(const Step& upload, const Step& publish) {
+    Task task;
+    task.upload = upload;
+    task.publish = publish;
+    task.fence = 0;
+
+    if (!m_thread.joinable()) {
+        runUpload(task);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_finished.push_back(task);
+        m_outstanding++;
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queued.push_back(task);
+        m_outstanding++;
+    }
+    m_changed.notify_all();
+}
+
+void UploadWorker::workerLoop() {
+#ifdef _WIN32
+    wglMakeCurrent(m_dc, m_context);
+#endif
+
+    while (true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_changed.wait(lock, [this]() { return m_stopping || !m_queued.empty(); });
+            if (m_stopping) {
+                break;
+            }
+            task = m_queued.front();
+            m_queued.pop_front();
+        }
+
+        runUpload(task);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_finished.push_back(task);
+        }
+        m_changed.notify_all();
+#ifdef _WIN32
+        if (m_notifyWindow) {
+            ::PostMessage(m_notifyWindow, WM_NULL, 0, 0);
+        }
+#endif
+    }
+
+#ifdef _WIN32
+    wglMakeCurrent(NULL, NULL);
+#endif
+}
+
+void UploadWorker::runUpload(Task& task) {
+    task.upload();
+    // The flush makes sure the fence reaches the GPU, so another context
+    // waiting on it doesn't wait forever.
+    task.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+}
+
+unsigned int UploadWorker::publishReady(double budgetMs) {
+    long long start = FrameScheduler::now();
+    unsigned int published = 0;
+
+    while (true) {
+        Task task;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_finished.empty()) {
+                break;
+            }
+            task = m_finished.front();
+        }
+
+        GLenum result = glClientWaitSync(task.fence, 0, 0);
+        if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) {
+            break;
+        }
+        glDeleteSync(task.fence);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_finished.pop_front();
+            m_outstanding--;
+        }
+        task.publish();
+        published++;
+
+        if (FrameScheduler::ticksToMs(FrameScheduler::now() - start) >= budgetMs) {
+            break;
+        }
+    }
+    return published;
+}
+
+void UploadWorker::publishAll() {
+    while (true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_outstanding == 0) {
+                return;
+            }
+            m_changed.wait(lock, [this]() { return !m_finished.empty(); });
+            task = m_finished.front();
+            m_finished.pop_front();
+            m_outstanding--;
+        }
+        glClientWaitSync(task.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(task.fence);
+        task.publish();
+    }
+}
+
+unsigned int UploadWorker::getReadyCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return (unsigned int)m_finished.size();
+}
+
+unsigned int UploadWorker::getOutstandingCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_outstanding;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include <GL/glew.h>
+
+// Runs buffer uploads on a thread with its own GL context, which shares
+// objects with the drawing context. Each task is an upload step, run on
+// the worker, and a publish step, run on the drawing thread once the
+// upload's commands have completed. The publish step is where a drawable
+// makes its vertex arrays (which aren't shared between contexts) and
+// becomes visible, so it appears all at once.
+//
+// Until start() is called, and always off Windows, where there's no
+// shared context, the uploads run on the thread that submits them.
+class UploadWorker
+{
+public:
+    typedef std::function<void()> Step;
+
+    UploadWorker();
+    ~UploadWorker();
+
+    // Creates the worker's context on dc, sharing objects with
+    // shareContext, and starts the thread. notifyWindow is posted WM_NULL
+    // whenever an upload finishes, so a waiting message loop wakes up. If
+    // the driver can't make a shared context, the uploads run on the
+    // calling thread instead and false is returned.
+#ifdef _WIN32
+    bool start(HWND notifyWindow, HDC dc, HGLRC shareContext, const int* contextAttribs);
+#endif
+    // Stops after the upload in progress; queued tasks are dropped.
+    void stop();
+
+    void submit(const Step& upload, const Step& publish);
+
+    // Publishes finished uploads in submission order until budgetMs has
+    // been spent, always publishing at least one if it's ready. Returns
+    // the number published.
+    unsigned int publishReady(double budgetMs);
+    // Waits for every submitted task and publishes it.
+    void publishAll();
+
+    // uploads that are finished but not yet published
+    unsigned int getReadyCount() const;
+    // tasks submitted but not yet published
+    unsigned int getOutstandingCount() const;
+
+protected:
+    struct Task {
+        Step upload;
+        Step publish;
+        GLsync fence;
+    };
+
+    void workerLoop();
+    void runUpload(Task& task);
+
+#ifdef _WIN32
+    HWND m_notifyWindow;
+    HDC m_dc;
+    HGLRC m_context;
+#endif
+    std::thread m_thread;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::deque<Task> m_queued;
+    std::deque<Task> m_finished;
+    bool m_stopping;
+    unsigned int m_outstanding;
+};
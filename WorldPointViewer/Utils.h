@@ -21,3 +21,10 @@ inline float randAngle() {
 inline float degToRad(float deg) {
     return (deg / DEG_PER_CIRCLE) * RAD_PER_CIRCLE;
 }
+
+// Splits a double into a float and the float remainder, so that
+// high + low carries about 48 bits of the original mantissa.
+inline void splitDouble(double value, float& high, float& low) {
+    high = (float)value;
+    low = (float)(value - (double)high);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <math.h>
+#include "Vector.h"
+#include "Vec3Df.h"
+
+namespace vec3dd {
+
+typedef vec::Vector<double, 3> Vec3Dd;
+
+inline Vec3Dd create(double x, double y, double z) {
+    Vec3Dd vec;
+    vec(0) = x;
+    vec(1) = y;
+    vec(2) = z;
+    return vec;
+}
+
+inline Vec3Dd create(const vec3df::Vec3Df& vec3f) {
+    return create(vec3f(0), vec3f(1), vec3f(2));
+}
+
+inline Vec3Dd create() {
+    return create(0, 0, 0);
+}
+
+inline vec3df::Vec3Df toFloat(const Vec3Dd& vec) {
+    return vec3df::create((float)vec(0), (float)vec(1), (float)vec(2));
+}
+
+inline Vec3Dd& rotateZ(Vec3Dd& vec, double theta) {
+    double c = cos(theta);
+    double s = sin(theta);
+    double x = vec(0);
+    double y = vec(1);
+    vec(0) = x * c - y * s;
+    vec(1) = x * s + y * c;
+    return vec;
+}
+
+inline Vec3Dd cross(const Vec3Dd& vec, const Vec3Dd& rhs) {
+    Vec3Dd result;
+    result(0) = vec(1) * rhs(2) - vec(2) * rhs(1);
+    result(1) = vec(2) * rhs(0) - vec(0) * rhs(2);
+    result(2) = vec(0) * rhs(1) - vec(1) * rhs(0);
+    return result;
+}
+
+// Rodrigues' rotation of vec about axis by theta.
+inline Vec3Dd rotateAbout(const Vec3Dd& vec, const Vec3Dd& axis, double theta) {
+    Vec3Dd k = axis.getUnit();
+    double c = cos(theta);
+    double s = sin(theta);
+    return vec * c + cross(k, vec) * s + k * (k.dot(vec) * (1 - c));
+}
+
+} // of namespace vec3dd
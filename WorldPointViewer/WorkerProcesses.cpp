@@ -0,0 +1,80 @@
+#include "WorkerProcesses.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+unsigned int WorkerProcesses::run(const std::vector<std::vector<std::string> >& argLists) {
+    unsigned int failed = 0;
+
+#ifdef _WIN32
+    char exePath[MAX_PATH];
+    if (!::GetModuleFileNameA(nullptr, exePath, MAX_PATH)) {
+        return (unsigned int)argLists.size();
+    }
+
+    std::vector<HANDLE> processes;
+    for (auto& args : argLists) {
+        // WinMain splits its command line on whitespace, so the arguments
+        // go in as they are
+        std::string cmdLine = std::string("\"") + exePath + "\"";
+        for (auto& arg : args) {
+            cmdLine += " " + arg;
+        }
+
+        STARTUPINFOA startup = {};
+        startup.cb = sizeof(startup);
+        PROCESS_INFORMATION info = {};
+        if (!::CreateProcessA(exePath, &cmdLine[0], nullptr, nullptr, FALSE, 0,
+            nullptr, nullptr, &startup, &info)) {
+            failed++;
+            continue;
+        }
+        ::CloseHandle(info.hThread);
+        processes.push_back(info.hProcess);
+    }
+
+    for (HANDLE process : processes) {
+        DWORD exitCode = 1;
+        ::WaitForSingleObject(process, INFINITE);
+        ::GetExitCodeProcess(process, &exitCode);
+        if (exitCode != 0) {
+            failed++;
+        }
+        ::CloseHandle(process);
+    }
+#else
+    std::vector<pid_t> processes;
+    for (auto& args : argLists) {
+        std::vector<char*> argv;
+        argv.push_back(const_cast<char*>("WorldPointViewer"));
+        for (auto& arg : args) {
+            argv.push_back(const_cast<char*>(arg.c_str()));
+        }
+        argv.push_back(nullptr);
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            execv("/proc/self/exe", argv.data());
+            _exit(127);
+        }
+        if (pid < 0) {
+            failed++;
+            continue;
+        }
+        processes.push_back(pid);
+    }
+
+    for (pid_t pid : processes) {
+        int status = 0;
+        if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            failed++;
+        }
+    }
+#endif
+
+    return failed;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Runs copies of this program side by side and waits for them, for batch
+// modes that split their work over several processes. Each copy gets its
+// own address space and, in the render batch, its own GL context.
+class WorkerProcesses
+{
+public:
+    // Starts this executable once per argument list (program arguments
+    // only, without the program name), waits for every one and returns
+    // how many couldn't be started or exited with a non-zero code.
+    static unsigned int run(const std::vector<std::vector<std::string> >& argLists);
+};
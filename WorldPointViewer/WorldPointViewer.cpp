@@ -1,25 +1,55 @@
+#ifdef _WIN32
 #include <windows.h>
 #include <windowsx.h>
-
-#include <gdiplus.h>
+#endif
 
 #include <algorithm>
+#include <cstdlib>
 #include <fstream>
+#include <functional>
+#include <memory>
+#include <sstream>
 #include <string>
 #include <vector>
 
 #include <GL/glew.h>
+#ifdef _WIN32
 #include <GL/Wglew.h>
+#endif
 
 #include "Matrix4Df.h"
 #include "Vector.h"
 #include "Vec3Df.h"
+#include "Vec3Dd.h"
 #include "Projection.h"
+#include "Frustum.h"
+#include "SphereIndex.h"
+#include "DensityBinner.h"
+#include "TrackErrors.h"
+#include "Picking.h"
 
 #include "GLPrograms.h"
+#include "FrameUniforms.h"
+#include "RenderQueue.h"
+#include "FrameScheduler.h"
+#include "PassTimer.h"
+#include "FrameCapture.h"
+#include "UploadWorker.h"
+#include "PosterExporter.h"
+#include "FileUtils.h"
+#include "BatchModes.h"
+#include "WorldPointViewer.h"
 
 #include "Globe.h"
+#include "Occluder.h"
 #include "LineSegs.h"
+#include "LineBatch.h"
+#include "LineLayer.h"
+#include "MarkerLayer.h"
+#include "PointLayer.h"
+#include "HeatmapLayer.h"
+#include "HoverHighlight.h"
+#include "ColorRamp.h"
 
 #include "Camera.h"
 #include "Utils.h"
@@ -36,11 +66,18 @@ struct Mouse {
     }
 } g_mouse;
 
+// a view's place in the window, in window coordinates
+struct ViewRect {
+    int left, top, right, bottom;
+};
+
 // Windows globals, defines, and prototypes
+#ifdef _WIN32
 WCHAR szAppName[] = L"World Point Viewer";
 HWND  ghWnd;
 HDC   ghDC;
 HGLRC ghRC;
+#endif
 
 const int GRID_WIDTH = 800;
 const int GRID_HEIGHT = 800;
@@ -52,34 +89,158 @@ const int WIN_HEIGHT = GRID_HEIGHT + (3 * GRID_BUFFER);
 const float MOVE_AMOUNT = 5;
 const float SPIN_AMOUNT = degToRad(5.0f);
 
+#ifdef _WIN32
 LONG WINAPI MainWndProc(HWND, UINT, WPARAM, LPARAM);
 BOOL setupPixelFormat(HDC);
 void doCleanup(HWND);
-void CALLBACK DrawTimerProc(HWND hwnd, UINT uMsg, UINT_PTR idEvent, DWORD dwTime);
+void drawContinuousFrame(HWND hWnd);
+void setContinuous(HWND hWnd, bool continuous);
+void attachBatchConsole();
+#endif
 
 GLvoid resize(int width, int height);
 void redoModelViewMatrix();
-void redoProjectionMatrix(int width, int height);
 void moveCameraByMouseMove(int x, int y, int last_x, int last_y);
 void zoomCameraByMouseWheel(int delta);
+void updateHover(int x, int y);
+void invalidateIfChanged();
 void initializeGL();
 GLvoid drawScene(int width, int height);
+void renderViews(int width, int height);
+void beginScene();
+void submitBackground();
+void submitLayers(unsigned int layerMask, unsigned int view);
+void endScene();
+ViewRect getViewRect(unsigned int view, int width, int height);
+unsigned int getViewAt(int x, int y, int width, int height);
+void toggleViewLayer(unsigned int layer);
 void createSwarm(int width, int height);
-void setupData(int width, int height);
+void binLoadedLayers(int order);
+void measureLoadedErrors();
+void checkLoadedIndex();
+TrackSet toTrackSet(const LineLayer& layer);
 
 const int SWARM_SIZE = 500;
 
+const float FOV = 70;
+const float NEAR_DIST = 0.5f;
+const float FAR_DIST = (float)(EARTH_EQUITORIAL_RADIUS * 3.0);
+
+#ifdef _WIN32
+// My card currently only supports OpenGL 4.1 -- jbl
+const int CONTEXT_ATTRIBS[] = {
+    WGL_CONTEXT_MAJOR_VERSION_ARB, 4,
+    WGL_CONTEXT_MINOR_VERSION_ARB, 1,
+    WGL_CONTEXT_FLAGS_ARB, 0,
+    0
+};
+#endif
+
 GLPrograms g_programs;
+FrameUniforms g_frameUniforms;
+RenderQueue g_renderQueue;
+FrameScheduler g_scheduler(60);
 
 Globe g_globe(1);
+Occluder g_occluder;
 LineSegs g_equator(Color{ 128, 128, 0, 255 });
 LineSegs g_prime_meridian(Color{ 128, 128, 0, 255 });
-std::vector<LineSegs> g_actual_points;
-std::vector<LineSegs> g_approx_points;
-std::vector<LineSegs> g_approx_offset_points;
-std::vector<LineSegs> g_axis_points;
 
-const UINT_PTR DRAW_TIMER_ID = 1;
+const Color ACTUAL_POINTS_COLOR = Color{ 255, 0, 0, 255 };
+const Color APPROX_POINTS_COLOR = Color{ 0, 255, 0, 255 };
+const Color APPROX_OFFSET_POINTS_COLOR = Color{ 0, 0, 255, 255 };
+const Color AXIS_POINTS_COLOR = Color{ 255, 255, 0, 255 };
+
+LineLayer g_actual_points(ACTUAL_POINTS_COLOR);
+LineLayer g_approx_points(APPROX_POINTS_COLOR);
+LineLayer g_approx_offset_points(APPROX_OFFSET_POINTS_COLOR);
+LineLayer g_axis_points(AXIS_POINTS_COLOR);
+
+LineLayer* const g_layers[] = {
+    &g_actual_points,
+    &g_approx_points,
+    &g_approx_offset_points,
+    &g_axis_points,
+};
+
+// The line layers merged into one buffer with a palette id per vertex, so
+// all of them draw in one call. 'M' switches back to a draw per layer.
+// Layers colored by scalars are always drawn on their own.
+LineBatch g_lineBatch;
+bool g_batchLayers = true;
+
+// A marker at the start and end of every track of the line layers and at
+// each waypoint in WAYPOINTS_FILE, all in one instanced draw. A marker's
+// id is its line layer (LINE_LAYER_COUNT for waypoints) in the top byte
+// and its polyline or waypoint below that. 'K' hides them.
+const Color TRACK_START_COLOR = Color{ 255, 255, 255, 255 };
+const Color TRACK_END_COLOR = Color{ 255, 0, 255, 255 };
+const Color WAYPOINT_COLOR = Color{ 0, 255, 255, 255 };
+const float TRACK_END_MARKER_SCALE = 3;
+const float WAYPOINT_MARKER_SCALE = 5;
+const char* const WAYPOINTS_FILE = "waypoints.txt";
+MarkerLayer g_markers;
+bool g_showMarkers = true;
+
+const char* const g_layerNames[] = {
+    "actual",
+    "approx",
+    "approx offset",
+    "axis",
+};
+
+// unconnected points; not indexed for picking
+const Color CLOUD_POINTS_COLOR = Color{ 255, 128, 0, 255 };
+const float CLOUD_POINT_SIZE = 2;
+const unsigned int CLOUD_POINT_BUDGET = 20000000;
+
+PointLayer g_cloud_points(CLOUD_POINTS_COLOR, CLOUD_POINT_SIZE, true);
+
+PointLayer* const g_pointLayers[] = {
+    &g_cloud_points,
+};
+
+const unsigned int LINE_LAYER_COUNT = sizeof(g_layers) / sizeof(g_layers[0]);
+const unsigned int POINT_LAYER_COUNT = sizeof(g_pointLayers) / sizeof(g_pointLayers[0]);
+
+// 'S' splits the window into up to MAX_VIEWS views from the same camera,
+// each drawing its own set of layers out of the same buffers. '1' and up
+// toggle a layer in the view under the mouse. Bit i of a view's layers is
+// g_layers[i], and the point layers follow.
+const unsigned int MAX_VIEWS = LineLayer::MAX_VIEWS;
+const unsigned int ALL_LAYERS = ~0u;
+unsigned int g_viewCount = 1;
+unsigned int g_viewLayers[MAX_VIEWS] = { 1 << 0, 1 << 1, 1 << 2, ALL_LAYERS };
+
+// Draws point density instead of the layers when on. Each frame counts at
+// most HEATMAP_POINTS_PER_FRAME of the queued points, so a big load fills
+// the map in over a few frames rather than stalling one.
+HeatmapLayer g_heatmap(2048, 1024);
+
+// order of the HEALPix grid 'B' bins the layers into; cells are about
+// 27 km across
+const int DENSITY_ORDER = 8;
+const char* const DENSITY_FILE = "density.csv";
+
+// 'E' measures how far the actual tracks are from the approximated ones,
+// writes ERRORS_PREFIX.csv and .json and colors the actual layer by the
+// great-circle error, from 0 (blue) to g_errorRangeMax (red); '[' and ']'
+// change that. 'E' again goes back to the layer's color.
+TrackErrors g_trackErrors;
+const char* const ERRORS_PREFIX = "errors";
+ColorRamp g_errorRamp;
+float g_errorRangeMax = 1;
+
+// 'X' renders the current view this wide, a tile at a time
+const int POSTER_WIDTH = 16384;
+const char* const POSTER_FILE = "poster.bmp";
+bool g_showHeatmap = false;
+const unsigned int HEATMAP_POINTS_PER_FRAME = 8000000;
+
+const Color HOVER_COLOR = Color{ 255, 255, 255, 255 };
+HoverHighlight g_hoverHighlight(HOVER_COLOR);
+// batched layers recolor the hovered polyline in place instead
+const unsigned char HOVER_PALETTE_ID = LineBatch::PALETTE_SIZE - 1;
 
 Camera g_camera(
     vec3df::create(
@@ -88,18 +249,80 @@ Camera g_camera(
         0.0f),
     degToRad(0), 0);
 
+// g_modelView is the full view, for CPU-side work like culling and picking.
+// Drawing uses g_modelViewRte, the view with the eye at the origin, and the
+// shaders subtract the eye from each vertex.
 mat4df::Mat4Df g_modelView;
+mat4df::Mat4Df g_modelViewRte;
 mat4df::Mat4Df g_projection;
+Frustum g_frustum;
+SphereIndex g_index;
+// set once the upload worker has built g_index
+bool g_indexReady = false;
+
+// Layers are loaded on the upload worker. Publishing a loaded layer is
+// cheap, but a frame stops publishing once it has spent this long on it.
+UploadWorker g_uploader;
+const double UPLOAD_BUDGET_MS = 2.0;
+
+bool g_hoverValid = false;
+SphereIndex::Hit g_hover;
+unsigned int g_hoverVersion = 0;
+// bumped by anything that changes how the scene is drawn, like the heatmap
+// toggle
+unsigned int g_displayVersion = 0;
+
+// Everything a frame depends on. Outside of continuous mode a frame is only
+// drawn when this differs from what the last frame showed.
+struct SceneState {
+    unsigned int cameraVersion;
+    unsigned int dataVersion;
+    unsigned int hoverVersion;
+    unsigned int displayVersion;
+    // points still to be counted into the heatmap
+    unsigned int heatmapPending;
+    // loaded layers waiting to be published
+    unsigned int uploadsReady;
+    int width;
+    int height;
+
+    bool operator==(const SceneState& other) const {
+        return cameraVersion == other.cameraVersion &&
+            dataVersion == other.dataVersion &&
+            hoverVersion == other.hoverVersion &&
+            displayVersion == other.displayVersion &&
+            heatmapPending == other.heatmapPending &&
+            uploadsReady == other.uploadsReady &&
+            width == other.width &&
+            height == other.height;
+    }
+};
 
-//FrameRateCounter g_frameRateCounter(5000);
+SceneState g_drawnState = {};
 
 bool g_shiftPressed = false;
 bool g_paused = false;
+// redraw at 60 FPS (or the refresh rate, with vsync) whether or not
+// anything changed, for benchmarking
+bool g_continuous = false;
+bool g_printFrameStats = false;
+bool g_printSubmitTime = false;
+
+// CPU and GPU time per section of the frame; the render queue's passes are
+// sections of their own
+PassTimer g_passTimer;
+const char* const PASS_NAMES[RenderQueue::PASS_COUNT] = {
+    "depth", "background", "scene", "overlay"
+};
+
+// 'R' records every frame to CAPTURE_DIR, drawing continuously meanwhile
+FrameCapture g_capture;
+const char* const CAPTURE_DIR = "capture";
+bool g_continuousBeforeCapture = false;
 
 const bool CREATE_CONSOLE = true;
 
-ULONG_PTR g_gdiplusToken;
-
+#ifdef _WIN32
 int WINAPI WinMain(
     _In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
     _In_ LPSTR lpCmdLine, _In_ int nCmdShow) {
@@ -119,6 +342,20 @@ int WINAPI WinMain(
     wndclass.lpszMenuName = szAppName;
     wndclass.lpszClassName = szAppName;
 
+    std::vector<std::string> args;
+    std::istringstream cmdLine(lpCmdLine);
+    std::string arg;
+    while (cmdLine >> arg) {
+        args.push_back(arg);
+    }
+
+    // headless: --bin, --errors, --shape, --render and --poster (see
+    // BatchModes.h)
+    if (isBatchMode(args)) {
+        attachBatchConsole();
+        return runBatchMode(args);
+    }
+
     if (!::RegisterClass(&wndclass)) {
         return FALSE;
     }
@@ -130,9 +367,6 @@ int WINAPI WinMain(
         freopen("conout$", "w", stderr);
     }
 
-    Gdiplus::GdiplusStartupInput gdiplusStartupInput;
-    Gdiplus::GdiplusStartup(&g_gdiplusToken, &gdiplusStartupInput, nullptr);
-
     // Create the frame
     ghWnd = ::CreateWindow(szAppName,
         szAppName,
@@ -156,39 +390,90 @@ int WINAPI WinMain(
 
     ::UpdateWindow(ghWnd);
 
-    while (::GetMessage(&msg, NULL, 0, 0)) {
-        ::TranslateMessage(&msg);
-        ::DispatchMessage(&msg);
+    while (true) {
+        if (g_continuous && !g_paused) {
+            while (::PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
+                if (msg.message == WM_QUIT) {
+                    return TRUE;
+                }
+                ::TranslateMessage(&msg);
+                ::DispatchMessage(&msg);
+            }
+            drawContinuousFrame(ghWnd);
+        }
+        else {
+            if (!::GetMessage(&msg, NULL, 0, 0)) {
+                break;
+            }
+            ::TranslateMessage(&msg);
+            ::DispatchMessage(&msg);
+            invalidateIfChanged();
+        }
     }
     return TRUE;
 }
 
-DWORD g_lastTime = 0;
-void CALLBACK DrawTimerProc(HWND hwnd, UINT uMsg, UINT_PTR idEvent, DWORD dwTime) {
-    if (g_paused) {
-        return;
+void attachBatchConsole() {
+    if (!::AttachConsole(ATTACH_PARENT_PROCESS)) {
+        ::AllocConsole();
     }
+    freopen("conout$", "w", stdout);
+    freopen("conout$", "w", stderr);
+}
 
-    ::KillTimer(hwnd, idEvent);
+void drawContinuousFrame(HWND hWnd) {
+    if (!ghRC) {
+        return;
+    }
 
-    DWORD currentTime = timeGetTime();
+    g_scheduler.waitForNextFrame();
 
-    const float TARGET_FPS = 60;
-    const UINT TIME_PER_FRAME = (UINT)(1000 / TARGET_FPS);
+    RECT rect;
+    ::GetClientRect(hWnd, &rect);
+    drawScene(rect.right - rect.left, rect.bottom - rect.top);
+}
 
-    DWORD nextTime = (g_lastTime > 0) ?
-        (g_lastTime + TIME_PER_FRAME) : (currentTime + TIME_PER_FRAME);
-    DWORD delay = (nextTime >= currentTime) ? (nextTime - currentTime) : 0;
-    ::SetTimer(hwnd, DRAW_TIMER_ID, delay, DrawTimerProc);
+void setContinuous(HWND hWnd, bool continuous) {
+    g_continuous = continuous;
+    g_scheduler.setContinuous(continuous);
+}
 
-    //if (g_lastTime > 0) {
-    //    printf("time: %u\n", currentTime - g_lastTime);
-    //}
-    g_lastTime = currentTime;
+SceneState currentSceneState() {
+    SceneState state;
+    state.cameraVersion = g_camera.getVersion();
+    state.dataVersion = 0;
+    for (auto layer : g_layers) {
+        state.dataVersion += layer->getVersion();
+    }
+    for (auto layer : g_pointLayers) {
+        state.dataVersion += layer->getVersion();
+    }
+    state.hoverVersion = g_hoverVersion;
+    state.displayVersion = g_displayVersion;
+    state.heatmapPending = g_showHeatmap ? g_heatmap.getPendingCount() : 0;
+    state.uploadsReady = g_uploader.getReadyCount();
 
     RECT rect;
-    ::GetWindowRect(hwnd, &rect);
-    drawScene(rect.right - rect.left, rect.bottom - rect.top);
+    ::GetClientRect(ghWnd, &rect);
+    state.width = rect.right - rect.left;
+    state.height = rect.bottom - rect.top;
+
+    return state;
+}
+
+// Called after every message. Invalidating only queues a WM_PAINT, which
+// Windows sends once the queue is otherwise empty, so a burst of mouse
+// moves still draws a single frame.
+void invalidateIfChanged() {
+    if (g_continuous || !ghWnd) {
+        return;
+    }
+    // Finished uploads are published by drawing, so keep drawing until
+    // they're all out.
+    SceneState state = currentSceneState();
+    if (!(state == g_drawnState) || state.uploadsReady > 0) {
+        ::InvalidateRect(ghWnd, nullptr, FALSE);
+    }
 }
 
 // main window procedure
@@ -209,15 +494,33 @@ LONG WINAPI MainWndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
         GetClientRect(hWnd, &rect);
         resize(rect.right, rect.bottom); // added in leiu of passing dims to initialize
         g_programs.compilePrograms();
+        g_scheduler.setVsync(true);
+        g_passTimer.setup();
+        g_renderQueue.setPassCallback([](int pass) {
+            if (pass < RenderQueue::PASS_COUNT) {
+                g_passTimer.begin(PASS_NAMES[pass]);
+            }
+            else {
+                g_passTimer.end();
+            }
+        });
+        if (!g_uploader.start(hWnd, ghDC, ghRC, CONTEXT_ATTRIBS)) {
+            printf("no shared GL context; loading layers on the UI thread\n");
+        }
 
         setupData(rect.right, rect.bottom);
 
-        ::SetTimer(hWnd, DRAW_TIMER_ID, 0, DrawTimerProc);
+        setContinuous(hWnd, g_continuous);
 
         break;
 
     case WM_PAINT:
         BeginPaint(hWnd, &ps);
+        // in continuous mode the message loop draws, paced by g_scheduler
+        if (!g_continuous) {
+            GetClientRect(hWnd, &rect);
+            drawScene(rect.right, rect.bottom);
+        }
         EndPaint(hWnd, &ps);
         break;
 
@@ -240,6 +543,132 @@ LONG WINAPI MainWndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
         switch (wParam) {
         case 'P':
             g_paused = !g_paused;
+            g_scheduler.reset();
+            break;
+
+        case 'T':
+            g_printSubmitTime = !g_printSubmitTime;
+            break;
+
+        case 'C':
+            setContinuous(hWnd, !g_continuous);
+            printf("drawing %s\n", g_continuous ? "continuously" : "on demand");
+            break;
+
+        case 'V':
+            if (g_scheduler.setVsync(!g_scheduler.isVsync())) {
+                printf("vsync %s\n", g_scheduler.isVsync() ? "on" : "off");
+            }
+            else {
+                printf("vsync can't be changed on this driver\n");
+            }
+            break;
+
+        case 'F':
+            g_printFrameStats = !g_printFrameStats;
+            break;
+
+        case 'H':
+            g_showHeatmap = !g_showHeatmap;
+            g_displayVersion++;
+            break;
+
+        case VK_OEM_PLUS:
+        case VK_OEM_MINUS:
+            g_heatmap.setSaturation(std::max(1.0f,
+                g_heatmap.getSaturation() * ((wParam == VK_OEM_PLUS) ? 2.0f : 0.5f)));
+            printf("heatmap saturates at %.0f points per texel\n", g_heatmap.getSaturation());
+            g_displayVersion++;
+            break;
+
+        case 'B':
+            binLoadedLayers(DENSITY_ORDER);
+            break;
+
+        case 'E':
+            if (g_actual_points.hasScalars()) {
+                g_actual_points.clearScalars();
+            }
+            else {
+                measureLoadedErrors();
+            }
+            break;
+
+        case 'I':
+            checkLoadedIndex();
+            break;
+
+        case VK_OEM_4:
+        case VK_OEM_6:
+            if (g_actual_points.hasScalars()) {
+                g_errorRangeMax *= (wParam == VK_OEM_6) ? 2.0f : 0.5f;
+                g_actual_points.setScalarRange(0, g_errorRangeMax);
+                printf("error colors reach red at %.3g m\n", g_errorRangeMax);
+            }
+            break;
+
+        case 'M':
+            g_batchLayers = !g_batchLayers;
+            g_displayVersion++;
+            printf("line layers drawn %s\n", g_batchLayers ? "in one batch" : "one draw each");
+            break;
+
+        case 'K':
+            g_showMarkers = !g_showMarkers;
+            g_displayVersion++;
+            break;
+
+        case 'S':
+            g_viewCount = g_viewCount % MAX_VIEWS + 1;
+            g_displayVersion++;
+            printf("%u view%s\n", g_viewCount, (g_viewCount == 1) ? "" : "s");
+            break;
+
+        case '1':
+        case '2':
+        case '3':
+        case '4':
+        case '5':
+            toggleViewLayer((unsigned int)(wParam - '1'));
+            break;
+
+        case 'J': {
+            const char* const FRAME_STATS_FILE = "frame_stats.json";
+            if (g_scheduler.writeJson(FRAME_STATS_FILE)) {
+                printf("wrote %s\n", FRAME_STATS_FILE);
+            }
+            break;
+        }
+
+        case 'G': {
+            const char* const FRAME_TRACE_FILE = "frame_trace.json";
+            if (g_passTimer.writeTrace(FRAME_TRACE_FILE)) {
+                printf("wrote %s\n", FRAME_TRACE_FILE);
+            }
+            break;
+        }
+
+        case 'R':
+            if (g_capture.isCapturing()) {
+                g_capture.stop();
+                setContinuous(hWnd, g_continuousBeforeCapture);
+            }
+            else {
+                makeDirectory(CAPTURE_DIR);
+                GetClientRect(hWnd, &rect);
+                g_capture.start(std::string(CAPTURE_DIR) + "/frame", rect.right, rect.bottom);
+                g_continuousBeforeCapture = g_continuous;
+                setContinuous(hWnd, true);
+                printf("capturing to %s\n", CAPTURE_DIR);
+            }
+            break;
+
+        case 'X':
+            GetClientRect(hWnd, &rect);
+            if (rect.right > 0 && rect.bottom > 0) {
+                exportPoster(POSTER_FILE, POSTER_WIDTH,
+                    (int)((long long)POSTER_WIDTH * rect.bottom / rect.right));
+            }
             break;
 
         //case 'W':
@@ -340,6 +769,9 @@ LONG WINAPI MainWndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
         if (g_mouse.l_btn_down) {
             moveCameraByMouseMove(x, y, g_mouse.last_x, g_mouse.last_y);
         }
+        else {
+            updateHover(x, y);
+        }
         g_mouse.last_x = x;
         g_mouse.last_y = y;
         break;
@@ -365,27 +797,11 @@ void doCleanup(HWND hWnd) {
         ::FreeConsole();
     }
 
-    g_globe.cleanup();
-
-    g_equator.cleanup();
-    g_prime_meridian.cleanup();
-
-    for (auto& s : g_actual_points) {
-        s.cleanup();
-    }
-    for (auto& s : g_approx_points) {
-        s.cleanup();
-    }
-    for (auto& s : g_approx_offset_points) {
-        s.cleanup();
-    }
-    for (auto& s : g_axis_points) {
-        s.cleanup();
-    }
-
-    g_programs.cleanupPrograms();
+    g_capture.stop();
+    g_uploader.stop();
+    g_passTimer.cleanup();
 
-    Gdiplus::GdiplusShutdown(g_gdiplusToken);
+    cleanupScene();
 
     if (ghRC) {
         wglDeleteContext(ghRC);
@@ -407,7 +823,7 @@ BOOL setupPixelFormat(HDC hdc) {
     pfd.dwLayerMask = PFD_MAIN_PLANE;
     pfd.iPixelType = PFD_TYPE_RGBA;
     pfd.cColorBits = 32;
-    pfd.cDepthBits = 0;// 16;
+    pfd.cDepthBits = 24;
     pfd.cAccumBits = 0;
     pfd.cStencilBits = 0;
 
@@ -425,6 +841,31 @@ BOOL setupPixelFormat(HDC hdc) {
 
     return TRUE;
 }
+#endif
+
+// Deletes the scene's GL objects, while its context is still current.
+void cleanupScene() {
+    g_globe.cleanup();
+    g_occluder.cleanup();
+
+    g_equator.cleanup();
+    g_prime_meridian.cleanup();
+
+    for (auto layer : g_layers) {
+        layer->cleanup();
+    }
+    g_lineBatch.cleanup();
+    g_markers.cleanup();
+    for (auto layer : g_pointLayers) {
+        layer->cleanup();
+    }
+    g_heatmap.cleanup();
+    g_hoverHighlight.cleanup();
+    g_errorRamp.cleanup();
+
+    g_frameUniforms.cleanup();
+    g_programs.cleanupPrograms();
+}
 
 // OpenGL code
 
@@ -437,13 +878,12 @@ GLvoid resize(int width, int height) {
 void redoModelViewMatrix() {
     g_modelView = projection::createLookAt(
         g_camera.getPosition(), g_camera.getTarget(), g_camera.getUp());
+    g_modelViewRte = projection::createLookAt(
+        vec3df::create(), g_camera.getTarget() - g_camera.getPosition(), g_camera.getUp());
 }
 
-void redoProjectionMatrix(int width, int height) {
-    const float NEAR_DIST = 0.5f;
-    const float FAR_DIST = (float)(EARTH_EQUITORIAL_RADIUS * 3.0);
-    const float FOV = 70;
 
+void redoProjectionMatrix(int width, int height) {
     g_projection = projection::createPerspective(FOV, (float)width, (float)height, NEAR_DIST, FAR_DIST);
 }
 
@@ -452,9 +892,10 @@ void moveCameraByMouseMove(int x, int y, int last_x, int last_y) {
     int dy = y - last_y;
 
     float PIX_TO_DEG = 0.04f;
-    auto pos = g_camera.getPosition();
+    auto pos = g_camera.getPositionPrecise();
+    auto len = pos.length();
 
-    auto alt = pos.length() - EARTH_EQUITORIAL_RADIUS;
+    auto alt = len - EARTH_EQUITORIAL_RADIUS;
     auto scale_factor = 1.0;
     //auto scale_factor = alt / EARTH_EQUITORIAL_RADIUS;
 
@@ -462,11 +903,11 @@ void moveCameraByMouseMove(int x, int y, int last_x, int last_y) {
         PIX_TO_DEG = 0.001f;
     }
 
-    pos = vec3df::rotateZ(pos, -degToRad(dx * PIX_TO_DEG) * scale_factor);
+    pos = vec3dd::rotateZ(pos, -degToRad(dx * PIX_TO_DEG) * scale_factor);
 
-    float dx_for_atan = vec3df::create(pos(0), pos(1), 0).length();
-    float dy_for_atan = pos(2);
-    float angle = atan2(dy_for_atan, dx_for_atan);
+    double dx_for_atan = vec3dd::create(pos(0), pos(1), 0).length();
+    double dy_for_atan = pos(2);
+    float angle = (float)atan2(dy_for_atan, dx_for_atan);
 
     const float MAX_ANGLE = degToRad(89);
 
@@ -477,16 +918,18 @@ void moveCameraByMouseMove(int x, int y, int last_x, int last_y) {
     if (angle + delta_angle < -MAX_ANGLE) {
         delta_angle = -MAX_ANGLE - angle;
     }
-    auto axis = vec3df::cross(pos, vec3df::create(0, 0, 1));
-    auto rot = mat4df::createRotationAbout(axis, delta_angle * scale_factor * 0.5);
-    pos = mat4df::mul(rot, pos);
+    auto axis = vec3dd::cross(pos, vec3dd::create(0, 0, 1));
+    pos = vec3dd::rotateAbout(pos, axis, delta_angle * scale_factor * 0.5);
+
+    // keep the altitude exact through the rotations
+    pos = pos.getUnit() * len;
 
     g_camera.setPosition(pos);
 }
 
 void zoomCameraByMouseWheel(int delta) {
-    const float ZOOM_FACTOR = 1.1f;
-    auto pos = g_camera.getPosition();
+    const double ZOOM_FACTOR = 1.1;
+    auto pos = g_camera.getPositionPrecise();
     auto len = pos.length();
 
     //if (delta < 0) {
@@ -504,7 +947,7 @@ void zoomCameraByMouseWheel(int delta) {
         }
     }
     else if (delta > 0) {
-        alt *= 1.0f / ZOOM_FACTOR;
+        alt *= 1.0 / ZOOM_FACTOR;
     }
     pos = pos.getUnit() * (EARTH_EQUITORIAL_RADIUS + alt);
 
@@ -512,6 +955,83 @@ void zoomCameraByMouseWheel(int delta) {
     g_camera.setPosition(pos);
 }
 
+#ifdef _WIN32
+void updateHover(int x, int y) {
+    const float PICK_RADIUS_PIXELS = 6;
+
+    LARGE_INTEGER startTime, endTime, frequency;
+    ::QueryPerformanceCounter(&startTime);
+
+    RECT rect;
+    ::GetClientRect(ghWnd, &rect);
+    float width = (float)(rect.right - rect.left);
+    float height = (float)(rect.bottom - rect.top);
+
+    // with split views, pick in the view under the mouse among its layers
+    mat4df::Mat4Df projection = g_projection;
+    unsigned int layerMask = ALL_LAYERS;
+    if (g_viewCount > 1) {
+        unsigned int view = getViewAt(x, y, rect.right, rect.bottom);
+        ViewRect viewRect = getViewRect(view, rect.right, rect.bottom);
+        x -= viewRect.left;
+        y -= viewRect.top;
+        width = (float)(viewRect.right - viewRect.left);
+        height = (float)(viewRect.bottom - viewRect.top);
+        projection = projection::createPerspective(FOV, width, height, NEAR_DIST, FAR_DIST);
+        layerMask = g_viewLayers[view];
+    }
+
+    bool valid = false;
+    SphereIndex::Hit hit;
+
+    vec3df::Vec3Df origin, dir, surface;
+    if (width > 0 && height > 0 &&
+        picking::unprojectRay((float)x, (float)y, width, height,
+            g_modelView, projection, origin, dir) &&
+        // the globe is drawn as a sphere, so pick against one
+        picking::intersectEllipsoid(origin, dir,
+            EARTH_EQUITORIAL_RADIUS, EARTH_EQUITORIAL_RADIUS, surface)) {
+
+        float pixelAngle = picking::radiansPerPixel(
+            (float)x, (float)y, width, height, g_modelView, projection);
+        float maxDist = (surface - origin).length() * pixelAngle * PICK_RADIUS_PIXELS;
+
+        valid = g_indexReady && g_index.findNearest(surface, maxDist, true, layerMask, hit);
+    }
+
+    ::QueryPerformanceCounter(&endTime);
+    ::QueryPerformanceFrequency(&frequency);
+
+    bool changed = (valid != g_hoverValid) ||
+        (valid && (hit.layer != g_hover.layer || hit.polyline != g_hover.polyline));
+    if (changed) {
+        double micros = (double)(endTime.QuadPart - startTime.QuadPart) * 1e6 /
+            (double)frequency.QuadPart;
+        if (valid) {
+            printf("pick: %s polyline %u point %u, %.1f m away (%.0f us)\n",
+                g_layerNames[hit.layer], hit.polyline,
+                hit.point - g_layers[hit.layer]->getPolylineSet().starts[hit.polyline],
+                hit.distance, micros);
+        }
+        else {
+            printf("pick: nothing (%.0f us)\n", micros);
+        }
+    }
+
+    if (changed) {
+        g_hoverVersion++;
+        // back to its layer's color
+        if (g_hoverValid) {
+            g_lineBatch.setPolylinePalette(g_hover.layer, g_hover.polyline, (unsigned char)g_hover.layer);
+        }
+        if (valid) {
+            g_lineBatch.setPolylinePalette(hit.layer, hit.polyline, HOVER_PALETTE_ID);
+        }
+    }
+    g_hoverValid = valid;
+    g_hover = hit;
+}
+
 void initializeGL() {
     HGLRC tempContext = wglCreateContext(ghDC);
     wglMakeCurrent(ghDC, tempContext);
@@ -521,16 +1041,8 @@ void initializeGL() {
         // failed to initialize GLEW!
     }
 
-    // My card currently only supports OpenGL 4.1 -- jbl
-    int attribs[] = {
-        WGL_CONTEXT_MAJOR_VERSION_ARB, 4,
-        WGL_CONTEXT_MINOR_VERSION_ARB, 1,
-        WGL_CONTEXT_FLAGS_ARB, 0,
-        0
-    };
-
     if (wglewIsSupported("WGL_ARB_create_context") == 1) {
-        ghRC = wglCreateContextAttribsARB(ghDC, 0, attribs);
+        ghRC = wglCreateContextAttribsARB(ghDC, 0, CONTEXT_ATTRIBS);
         wglMakeCurrent(NULL, NULL);
         wglDeleteContext(tempContext);
         wglMakeCurrent(ghDC, ghRC);
@@ -544,11 +1056,17 @@ void initializeGL() {
     glGetIntegerv(GL_MAJOR_VERSION, &OpenGLVersion[0]);
     glGetIntegerv(GL_MINOR_VERSION, &OpenGLVersion[1]);
 }
+#endif
 
 void setupData(int width, int height) {
 
+    g_frameUniforms.setup();
+
     g_globe.setProgram(g_programs.getSimpleProg());
     g_globe.setup();
+
+    g_occluder.setProgram(g_programs.getOccluderProg());
+    g_occluder.setup();
 
     const float RAD = (float)EARTH_EQUITORIAL_RADIUS;
 
@@ -581,98 +1099,561 @@ void setupData(int width, int height) {
     g_prime_meridian.setup(points);
     points.clear();
 
-    auto tryAddPoints = [&](
-        std::vector<LineSegs>& segs_list, Color color, std::vector<vec3df::Vec3Df>& points) {
-
-        if (points.empty()) {
-            return;
-        }
-
-        segs_list.push_back(LineSegs(color));
-        LineSegs& segs = segs_list.back();
-        segs.setProgram(g_programs.getSimpleProg());
-        segs.setup(points);
-        points.clear();
+    g_heatmap.setProgram(g_programs.getHeatRampProg());
+    g_heatmap.setAccumulateProgram(g_programs.getHeatAccumulateProg());
+    g_heatmap.setup();
+
+    g_hoverHighlight.setProgram(g_programs.getSimpleProg());
+    g_hoverHighlight.setup();
+
+    g_errorRamp.setup();
+
+    // Each layer is read and uploaded on the upload worker, and shows up,
+    // along with its heatmap points, once it's published.
+    auto loadLayer = [](LineLayer* layer, const std::function<void()>& read) {
+        auto lonLat = std::make_shared<std::vector<GLfloat> >();
+        g_uploader.submit(
+            [=]() {
+                read();
+                layer->upload();
+                HeatmapLayer::toLonLat(layer->getPolylineSet(), *lonLat);
+            },
+            [=]() {
+                layer->publish();
+                g_heatmap.addLonLat(*lonLat);
+            });
     };
 
-    auto processFile = [&](
-        const char* filename, std::vector<LineSegs>& segs_list, Color color) {
+    auto loadLineFile = [&](const char* filename, LineLayer* layer) {
+        layer->setProgram(g_programs.getSimpleProg());
+        loadLayer(layer, [=]() {
+            readPointFile(filename, [=](const std::vector<vec3dd::Vec3Dd>& points) {
+                layer->addPolyline(points);
+            });
+        });
+    };
 
-        std::vector<vec3df::Vec3Df> points;
+    auto loadPointFile = [&](const char* filename, PointLayer* layer) {
+        layer->setProgram(g_programs.getPointProg());
+        layer->setPointBudget(CLOUD_POINT_BUDGET);
+        loadLayer(layer, [=]() {
+            readPointFile(filename, [=](const std::vector<vec3dd::Vec3Dd>& points) {
+                layer->addPoints(points);
+            });
+        });
+    };
 
-        std::ifstream actual_points(filename);
-        std::string str;
-        while (std::getline(actual_points, str))
-        {
-            if (str.empty()) {
-                tryAddPoints(segs_list, color, points);
+    loadLineFile("actual_points.txt", &g_actual_points);
+    loadLineFile("approx_points.txt", &g_approx_points);
+    loadLineFile("approx_offset_points.txt", &g_approx_offset_points);
+    loadLineFile("axis_points.txt", &g_axis_points);
+
+    // The worker runs tasks in order, so the line layers are loaded by the
+    // time it builds the index.
+    g_uploader.submit(
+        []() {
+            std::vector<PolylineSet> layerSets;
+            for (auto layer : g_layers) {
+                layerSets.push_back(layer->getPolylineSet());
             }
-            else {
-                size_t comma1 = str.find(",", 0);
-                size_t comma2 = str.find(",", comma1 + 1);
-                std::string str1 = str.substr(0, comma1);
-                std::string str2 = str.substr(comma1 + 1, comma2 - comma1 - 1);
-                std::string str3 = str.substr(comma2 + 1);
-
-                vec3df::Vec3Df p = vec3df::create(
-                    (float)atof(str1.c_str()), (float)atof(str2.c_str()), (float)atof(str3.c_str()));
-                points.push_back(p);
+            g_index.build(layerSets);
+        },
+        []() {
+            g_indexReady = true;
+            const SphereIndex::BuildStats& stats = g_index.getBuildStats();
+            printf("spatial index: %u points in %u runs, built in %.0f ms on %u threads\n",
+                stats.pointCount, stats.runCount, stats.ms, stats.threadCount);
+        });
+
+    // copies the line layers' buffers, so it also comes after them
+    g_lineBatch.setProgram(g_programs.getPaletteProg());
+    g_lineBatch.setLayers(std::vector<LineLayer*>(g_layers, g_layers + LINE_LAYER_COUNT));
+    g_lineBatch.setPaletteColor(HOVER_PALETTE_ID, HOVER_COLOR);
+    g_uploader.submit(
+        []() {
+            g_lineBatch.upload();
+        },
+        []() {
+            g_lineBatch.publish();
+            if (g_hoverValid) {
+                g_lineBatch.setPolylinePalette(g_hover.layer, g_hover.polyline, HOVER_PALETTE_ID);
             }
+        });
+
+    g_markers.setProgram(g_programs.getMarkerProg());
+    g_uploader.submit(
+        []() {
+            for (unsigned int i = 0; i < LINE_LAYER_COUNT; i++) {
+                PolylineSet set = g_layers[i]->getPolylineSet();
+                for (unsigned int j = 0; j < set.polylineCount; j++) {
+                    const unsigned int ID = (i << 24) | j;
+                    g_markers.addMarker(g_layers[i]->getPoint(set.starts[j]),
+                        TRACK_START_COLOR, TRACK_END_MARKER_SCALE, ID);
+                    g_markers.addMarker(g_layers[i]->getPoint(set.starts[j] + set.counts[j] - 1),
+                        TRACK_END_COLOR, TRACK_END_MARKER_SCALE, ID);
+                }
+            }
+            unsigned int waypoint = 0;
+            readPointFile(WAYPOINTS_FILE, [&](const std::vector<vec3dd::Vec3Dd>& points) {
+                for (auto& p : points) {
+                    g_markers.addMarker(p, WAYPOINT_COLOR, WAYPOINT_MARKER_SCALE,
+                        (LINE_LAYER_COUNT << 24) | waypoint++);
+                }
+            });
+            g_markers.upload();
+        },
+        []() {
+            g_markers.publish();
+        });
+
+    loadPointFile("cloud_points.txt", &g_cloud_points);
+}
+
+// addPoints gets each run of points between blank lines
+void readPointFile(const char* filename,
+    const std::function<void(const std::vector<vec3dd::Vec3Dd>&)>& addPoints) {
+
+    std::vector<vec3dd::Vec3Dd> points;
+
+    std::ifstream actual_points(filename);
+    std::string str;
+    while (std::getline(actual_points, str))
+    {
+        if (str.empty()) {
+            addPoints(points);
+            points.clear();
+        }
+        else {
+            size_t comma1 = str.find(",", 0);
+            size_t comma2 = str.find(",", comma1 + 1);
+            std::string str1 = str.substr(0, comma1);
+            std::string str2 = str.substr(comma1 + 1, comma2 - comma1 - 1);
+            std::string str3 = str.substr(comma2 + 1);
+
+            vec3dd::Vec3Dd p = vec3dd::create(
+                atof(str1.c_str()), atof(str2.c_str()), atof(str3.c_str()));
+            points.push_back(p);
         }
-        tryAddPoints(segs_list, color, points);
+    }
+    addPoints(points);
+}
+
+void binLoadedLayers(int order) {
+    DensityBinner binner(order);
+
+    long long start = FrameScheduler::now();
+    unsigned long long pointCount = 0;
+    auto binLayer = [&](const LineLayer& layer) {
+        PolylineSet set = layer.getPolylineSet();
+        binner.bin(set.coords, set.pointCount);
+        pointCount += set.pointCount;
     };
+    for (auto layer : g_layers) {
+        if (layer->isReady()) {
+            binLayer(*layer);
+        }
+    }
+    for (auto layer : g_pointLayers) {
+        if (layer->isReady()) {
+            binLayer(*layer);
+        }
+    }
+    double ms = FrameScheduler::ticksToMs(FrameScheduler::now() - start);
+
+    const std::vector<unsigned long long>& counts = binner.getCounts();
+    unsigned int nonEmpty = (unsigned int)(counts.size() - std::count(counts.begin(), counts.end(), 0ull));
+    unsigned long long maxCount = *std::max_element(counts.begin(), counts.end());
+
+    printf("binned %llu points into %u of %u cells in %.1f ms (%.1f M points/s); "
+        "densest cell %llu points, %.3g per km^2\n",
+        pointCount, nonEmpty, binner.getCellCount(), ms,
+        (ms > 0) ? (pointCount / ms / 1000.0) : 0.0,
+        maxCount, maxCount / (binner.getCellArea(EARTH_EQUITORIAL_RADIUS) / 1e6));
+
+    if (binner.writeCsv(DENSITY_FILE, EARTH_EQUITORIAL_RADIUS)) {
+        printf("wrote %s\n", DENSITY_FILE);
+    }
+}
+
+void measureLoadedErrors() {
+    if (!g_actual_points.isReady() || !g_approx_points.isReady()) {
+        printf("the actual and approx layers are still loading\n");
+        return;
+    }
+
+    g_trackErrors.compute(toTrackSet(g_actual_points), toTrackSet(g_approx_points),
+        TrackErrors::MATCH_BY_INDEX);
+    writeErrors(g_trackErrors, ERRORS_PREFIX);
+
+    // the layer's points are in the same order as the errors
+    const std::vector<TrackErrors::PointError>& errors = g_trackErrors.getPointErrors();
+    std::vector<float> greatCircle(errors.size());
+    for (size_t i = 0; i < errors.size(); i++) {
+        greatCircle[i] = errors[i].greatCircle;
+    }
+    g_actual_points.setScalars(greatCircle,
+        g_programs.getScalarRampProg(), g_errorRamp.getTexture());
+
+    // start with the worst 5% in red
+    g_errorRangeMax = std::max(0.001f, (float)g_trackErrors.getOverallStats().greatCircleP95);
+    g_actual_points.setScalarRange(0, g_errorRangeMax);
+    printf("error colors reach red at %.3g m\n", g_errorRangeMax);
+}
+
+// Checks g_index's nearest point and segment searches against a scan of
+// every point, from positions scattered around the loaded points.
+void checkLoadedIndex() {
+    if (!g_indexReady) {
+        printf("the spatial index is still building\n");
+        return;
+    }
+
+    const unsigned int QUERY_COUNT = 200;
+    const int QUERY_SCATTER = 1500;
+    const float MAX_DIST = 5000;
+
+    std::vector<vec3df::Vec3Df> queries;
+    for (unsigned int i = 0; i < QUERY_COUNT; i++) {
+        const PolylineSet& set = g_index.getLayer(rand() % LINE_LAYER_COUNT);
+        if (set.pointCount == 0) {
+            continue;
+        }
+        const float* p = set.coords + ((rand() * (RAND_MAX + 1u) + rand()) % set.pointCount) * 3;
+        queries.push_back(vec3df::create(
+            p[0] + (float)(rand() % (2 * QUERY_SCATTER) - QUERY_SCATTER),
+            p[1] + (float)(rand() % (2 * QUERY_SCATTER) - QUERY_SCATTER),
+            p[2] + (float)(rand() % (2 * QUERY_SCATTER) - QUERY_SCATTER)));
+    }
+
+    long long start = FrameScheduler::now();
+    unsigned int pointMismatches = g_index.checkNearest(queries, MAX_DIST, false, ALL_LAYERS);
+    unsigned int segmentMismatches = g_index.checkNearest(queries, MAX_DIST, true, ALL_LAYERS);
+    printf("spatial index check: %u of %u nearest points and %u nearest segments "
+        "differ from a full scan (%.1f ms)\n",
+        pointMismatches, (unsigned int)queries.size(), segmentMismatches,
+        FrameScheduler::ticksToMs(FrameScheduler::now() - start));
+}
+
+// The layers keep each coordinate as a float and its float remainder, so
+// their sum recovers the double.
+TrackSet toTrackSet(const LineLayer& layer) {
+    TrackSet tracks;
+    std::vector<GLfloat> interleaved;
+    std::vector<vec3dd::Vec3Dd> points;
+    PolylineSet set = layer.getPolylineSet();
+    for (unsigned int i = 0; i < set.polylineCount; i++) {
+        interleaved.resize(set.counts[i] * 6);
+        layer.copyPolyline(i, interleaved.data());
+
+        points.clear();
+        for (int j = 0; j < set.counts[i]; j++) {
+            const GLfloat* p = &interleaved[j * 6];
+            points.push_back(vec3dd::create(
+                (double)p[0] + p[3], (double)p[1] + p[4], (double)p[2] + p[5]));
+        }
+        tracks.addTrack(points);
+    }
+    return tracks;
+}
+
+bool writeErrors(const TrackErrors& errors, const std::string& prefix) {
+    TrackErrors::TrackStats overall = errors.getOverallStats();
+    printf("measured %u points of %u tracks in %.1f ms: great circle rms %.3f m, "
+        "p95 %.3f m, max %.3f m; chord rms %.3f m\n",
+        overall.pointCount, (unsigned int)errors.getTrackStats().size(), errors.getComputeMs(),
+        overall.greatCircleRms, overall.greatCircleP95, overall.greatCircleMax, overall.chordRms);
+
+    std::string csvFile = prefix + ".csv";
+    std::string jsonFile = prefix + ".json";
+    if (!errors.writeCsv(csvFile.c_str()) || !errors.writeJson(jsonFile.c_str())) {
+        printf("can't write %s\n", csvFile.c_str());
+        return false;
+    }
+    printf("wrote %s and %s\n", csvFile.c_str(), jsonFile.c_str());
+    return true;
+}
+
+// Renders the current view at width x height, which can be far bigger
+// than the window or any framebuffer, into an uncompressed BMP.
+bool exportPoster(const char* filename, int width, int height) {
+    const mat4df::Mat4Df WINDOW_PROJECTION = g_projection;
+    redoProjectionMatrix(width, height);
+    const mat4df::Mat4Df POSTER_PROJECTION = g_projection;
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
 
-    const Color ACTUAL_POINTS_COLOR = Color{ 255, 0, 0, 255 };
-    const Color APPROX_POINTS_COLOR = Color{ 0, 255, 0, 255 };
-    const Color APPROX_OFFSET_POINTS_COLOR = Color{ 0, 0, 255, 255 };
-    const Color AXIS_POINTS_COLOR = Color{ 255, 255, 0, 255 };
+    long long start = FrameScheduler::now();
 
-    processFile("actual_points.txt", g_actual_points, ACTUAL_POINTS_COLOR);
-    processFile("approx_points.txt", g_approx_points, APPROX_POINTS_COLOR);
-    processFile("approx_offset_points.txt", g_approx_offset_points, APPROX_OFFSET_POINTS_COLOR);
-    processFile("axis_points.txt", g_axis_points, AXIS_POINTS_COLOR);
+    PosterExporter exporter;
+    bool ok = exporter.exportImage(filename, width, height, POSTER_PROJECTION,
+        [](const mat4df::Mat4Df& projection) {
+            g_projection = projection;
+            renderScene();
+        });
+
+    g_projection = WINDOW_PROJECTION;
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+    if (ok) {
+        printf("wrote %s, %d x %d, in %.1f ms\n", filename, width, height,
+            FrameScheduler::ticksToMs(FrameScheduler::now() - start));
+    }
+    return ok;
 }
 
-unsigned int g_lastFrameRatePrintTime = 0;
+#ifdef _WIN32
+LONGLONG g_submitTicks = 0;
+unsigned int g_submitFrames = 0;
+DWORD g_lastSubmitPrintTime = 0;
+
 void drawScene(int width, int height) {
+    g_scheduler.beginFrame();
+    g_passTimer.beginFrame();
+    LONGLONG submitStart = FrameScheduler::now();
+
+    g_passTimer.begin("uploads");
+    g_uploader.publishReady(UPLOAD_BUDGET_MS);
+    g_passTimer.end();
+
+    g_drawnState = currentSceneState();
+
+    if (g_viewCount > 1) {
+        renderViews(width, height);
+    }
+    else {
+        renderScene();
+    }
+
+    // CPU time spent issuing the frame's GL calls, not counting the swap
+    g_submitTicks += FrameScheduler::now() - submitStart;
+    g_submitFrames++;
+
+    DWORD currentTime = timeGetTime();
+    if (currentTime - g_lastSubmitPrintTime > 1000) {
+        if (g_printSubmitTime) {
+            const RenderQueue::Stats& stats = g_renderQueue.getStats();
+            printf("submit: %.3f ms/frame, %u draws, %u state changes, %u uniform bytes\n",
+                FrameScheduler::ticksToMs(g_submitTicks) / g_submitFrames,
+                stats.drawCalls, stats.stateChanges,
+                stats.uniformBytes + g_frameUniforms.getUploadSize());
+        }
+        if (g_printFrameStats) {
+            g_scheduler.printStats();
+            g_passTimer.printStats();
+        }
+        g_submitTicks = 0;
+        g_submitFrames = 0;
+        g_lastSubmitPrintTime = currentTime;
+    }
+
+    if (g_capture.isCapturing()) {
+        g_passTimer.begin("capture");
+        g_capture.captureFrame(width, height);
+    }
+
+    g_passTimer.begin("swap");
+    ::SwapBuffers(ghDC);
+    g_passTimer.endFrame();
+    g_scheduler.endFrame();
+}
+#endif
+
+// Draws the scene from g_camera into the bound framebuffer, using the
+// current projection.
+void renderScene() {
+    beginScene();
+
+    g_passTimer.begin("cull");
+    g_frameUniforms.update(g_modelViewRte, g_projection, g_camera.getPositionPrecise(), FAR_DIST);
+
+    submitBackground();
+
+    // the caller has set the viewport
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    g_markers.setViewportSize(viewport[2], viewport[3]);
+
+    g_frustum.setFromMatrix(g_projection * g_modelView);
+    if (!g_showHeatmap) {
+        for (auto layer : g_layers) {
+            layer->cull(g_frustum);
+        }
+        for (auto layer : g_pointLayers) {
+            layer->cull(g_frustum);
+        }
+    }
+    submitLayers(ALL_LAYERS, 0);
+
+    g_renderQueue.flush();
+
+    endScene();
+}
+
+// Draws g_viewCount views side by side into the window. The views share
+// the camera and every buffer; each layer is culled for all of them in
+// one pass over its bounds, and only the frame uniforms change between
+// views.
+void renderViews(int width, int height) {
+    beginScene();
+
+    g_passTimer.begin("cull");
+    ViewRect rects[MAX_VIEWS];
+    mat4df::Mat4Df projections[MAX_VIEWS];
+    Frustum frusta[MAX_VIEWS];
+    for (unsigned int v = 0; v < g_viewCount; v++) {
+        rects[v] = getViewRect(v, width, height);
+        projections[v] = projection::createPerspective(FOV,
+            (float)(rects[v].right - rects[v].left), (float)(rects[v].bottom - rects[v].top),
+            NEAR_DIST, FAR_DIST);
+        frusta[v].setFromMatrix(projections[v] * g_modelView);
+    }
+
+    if (!g_showHeatmap) {
+        for (auto layer : g_layers) {
+            layer->cullViews(frusta, g_viewCount);
+        }
+        for (auto layer : g_pointLayers) {
+            layer->cullViews(frusta, g_viewCount);
+        }
+    }
+
+    for (unsigned int v = 0; v < g_viewCount; v++) {
+        // GL's viewport origin is the bottom left
+        glViewport(rects[v].left, height - rects[v].bottom,
+            rects[v].right - rects[v].left, rects[v].bottom - rects[v].top);
+        g_frameUniforms.update(g_modelViewRte, projections[v],
+            g_camera.getPositionPrecise(), FAR_DIST);
+
+        submitBackground();
+        g_markers.setViewportSize(rects[v].right - rects[v].left, rects[v].bottom - rects[v].top);
+        submitLayers(g_viewLayers[v], v);
+        g_renderQueue.flush();
+    }
+    glViewport(0, 0, width, height);
+
+    endScene();
+}
+
+void beginScene() {
     redoModelViewMatrix();
 
+    glDepthMask(GL_TRUE);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glDepthMask(true);
 
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_LEQUAL);
 
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glEnable(GL_PROGRAM_POINT_SIZE);
 
-    g_globe.draw(g_modelView, g_projection);
+    if (g_showHeatmap) {
+        g_passTimer.begin("heatmap");
+        if (g_heatmap.update(HEATMAP_POINTS_PER_FRAME)) {
+            g_renderQueue.invalidate();
+        }
+    }
+}
 
-    g_equator.draw(g_modelView, g_projection);
-    g_prime_meridian.draw(g_modelView, g_projection);
+void submitBackground() {
+    g_occluder.submit(g_renderQueue);
+    g_globe.submit(g_renderQueue);
 
-    for (auto& s : g_actual_points) {
-        s.draw(g_modelView, g_projection);
+    g_equator.submit(g_renderQueue);
+    g_prime_meridian.submit(g_renderQueue);
+}
+
+// Submits the layers in layerMask using the draw lists culled for view.
+void submitLayers(unsigned int layerMask, unsigned int view) {
+    unsigned int batchMask = 0;
+    if (g_showHeatmap) {
+        g_heatmap.submit(g_renderQueue);
     }
-    for (auto& s : g_approx_points) {
-        s.draw(g_modelView, g_projection);
+    else {
+        if (g_batchLayers && g_lineBatch.isReady()) {
+            for (unsigned int i = 0; i < LINE_LAYER_COUNT; i++) {
+                if ((layerMask & (1 << i)) && !g_layers[i]->hasScalars()) {
+                    batchMask |= 1 << i;
+                }
+            }
+            g_lineBatch.submit(g_renderQueue, batchMask, view);
+        }
+        for (unsigned int i = 0; i < LINE_LAYER_COUNT; i++) {
+            if ((layerMask & (1 << i)) && !(batchMask & (1 << i))) {
+                g_layers[i]->submit(g_renderQueue, view);
+            }
+        }
+        for (unsigned int i = 0; i < POINT_LAYER_COUNT; i++) {
+            if (layerMask & (1 << (LINE_LAYER_COUNT + i))) {
+                g_pointLayers[i]->submit(g_renderQueue, view);
+            }
+        }
     }
-    for (auto& s : g_approx_offset_points) {
-        s.draw(g_modelView, g_projection);
+
+    if (g_showMarkers && !g_showHeatmap) {
+        g_markers.submit(g_renderQueue);
     }
-    for (auto& s : g_axis_points) {
-        s.draw(g_modelView, g_projection);
+
+    // the batch already draws the hovered polyline in HOVER_COLOR
+    if (g_hoverValid && (layerMask & (1 << g_hover.layer)) && !(batchMask & (1 << g_hover.layer))) {
+        g_hoverHighlight.submit(g_renderQueue, *g_layers[g_hover.layer], g_hover.polyline);
     }
+}
+
+void endScene() {
+    g_hoverHighlight.endFrame();
 
-    glDisable(GL_BLEND);
     glDisable(GL_DEPTH_TEST);
+}
+
+// Columns for two or three views, a 2 x 2 grid for four. The rect is in
+// window coordinates.
+ViewRect getViewRect(unsigned int view, int width, int height) {
+    unsigned int columns = (g_viewCount == 4) ? 2 : g_viewCount;
+    unsigned int rows = (g_viewCount + columns - 1) / columns;
+    unsigned int column = view % columns;
+    unsigned int row = view / columns;
+
+    ViewRect rect;
+    rect.left = width * column / columns;
+    rect.right = width * (column + 1) / columns;
+    rect.top = height * row / rows;
+    rect.bottom = height * (row + 1) / rows;
+    return rect;
+}
 
-    //DWORD currentTime = timeGetTime();
-    //float frameRate = g_frameRateCounter.incorportateTime(currentTime);
-    //if ((currentTime - g_lastFrameRatePrintTime) > 1000) {
-    //    printf("fps: %f\n", frameRate);
-    //    g_lastFrameRatePrintTime = currentTime;
-    //}
+unsigned int getViewAt(int x, int y, int width, int height) {
+    for (unsigned int v = 0; v < g_viewCount; v++) {
+        ViewRect rect = getViewRect(v, width, height);
+        if (x >= rect.left && x < rect.right && y >= rect.top && y < rect.bottom) {
+            return v;
+        }
+    }
+    return 0;
+}
 
-    ::SwapBuffers(ghDC);
+#ifdef _WIN32
+// Shows or hides a layer in the view under the mouse.
+void toggleViewLayer(unsigned int layer) {
+    if (g_viewCount < 2 || layer >= LINE_LAYER_COUNT + POINT_LAYER_COUNT) {
+        return;
+    }
+
+    RECT rect;
+    ::GetClientRect(ghWnd, &rect);
+    unsigned int view = getViewAt(g_mouse.last_x, g_mouse.last_y, rect.right, rect.bottom);
+    g_viewLayers[view] ^= 1 << layer;
+    g_displayVersion++;
+
+    printf("view %u:", view + 1);
+    for (unsigned int i = 0; i < LINE_LAYER_COUNT; i++) {
+        if (g_viewLayers[view] & (1 << i)) {
+            printf(" %s", g_layerNames[i]);
+        }
+    }
+    for (unsigned int i = 0; i < POINT_LAYER_COUNT; i++) {
+        if (g_viewLayers[view] & (1 << (LINE_LAYER_COUNT + i))) {
+            printf(" points %u", i + 1);
+        }
+    }
+    printf("\n");
 }
+#endif
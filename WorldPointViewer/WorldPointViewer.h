@@ -0,0 +1,32 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "Vec3Dd.h"
+#include "Camera.h"
+#include "GLPrograms.h"
+#include "TrackErrors.h"
+#include "UploadWorker.h"
+
+// The parts of the viewer's scene (WorldPointViewer.cpp) that the batch
+// modes (BatchModes.cpp) drive without a window.
+
+extern GLPrograms g_programs;
+extern UploadWorker g_uploader;
+extern Camera g_camera;
+
+// Loads the layers through g_uploader; with no worker started, they're
+// read by the time this returns and published by g_uploader.publishAll().
+void setupData(int width, int height);
+void cleanupScene();
+void redoProjectionMatrix(int width, int height);
+void renderScene();
+
+void readPointFile(const char* filename,
+    const std::function<void(const std::vector<vec3dd::Vec3Dd>&)>& addPoints);
+bool writeErrors(const TrackErrors& errors, const std::string& prefix);
+bool exportPoster(const char* filename, int width, int height);